@@ -44,20 +44,168 @@ import java.net.InetAddress;
 import java.net.Socket;
 import java.net.SocketException;
 import java.net.UnknownHostException;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.charset.Charset;
 import java.util.HashMap;
+import java.util.concurrent.ConcurrentHashMap;
 import java.util.concurrent.LinkedBlockingQueue;
 
 public class Miner {
     private static Thread miningThread = null;
     private static final LinkedBlockingQueue miningSharesQueue = new LinkedBlockingQueue();
+    // shares of the extra job slots, slot 0 is the one start() connects and uses miningSharesQueue
+    private static final ConcurrentHashMap<Integer, LinkedBlockingQueue> slotSharesQueues =
+            new ConcurrentHashMap<Integer, LinkedBlockingQueue>();
     private static boolean shouldStop = false;
 
+    // JobRecord layout in marshal.h, little-endian
+    private static final int JOB_ID_SIZE = 0;
+    private static final int JOB_ID = 1;
+    private static final int JOB_BLOB_SIZE = JOB_ID + 64;
+    private static final int JOB_BLOB = JOB_BLOB_SIZE + 1;
+    private static final int JOB_SEED_HASH = JOB_BLOB + 128;
+    private static final int JOB_HEIGHT = JOB_SEED_HASH + 32;
+    private static final int JOB_TARGET_SIZE = JOB_HEIGHT + 8;
+    private static final int JOB_TARGET = JOB_TARGET_SIZE + 1;
+    private static final int JOB_RECORD_SIZE = JOB_TARGET + 8;
+    // ShareRecord layout in marshal.h, one record per share of a delivered batch
+    private static final int SHARE_SLOT = 0;
+    private static final int SHARE_NONCE = 4;
+    private static final int SHARE_ID_SIZE = 8;
+    private static final int SHARE_ID = 12;
+    private static final int SHARE_HASH = SHARE_ID + 64;
+    private static final int SHARE_RECORD_SIZE = 128;
+    private static final int SHARE_RECORDS = 16;
+    private static final char[] HEX_DIGITS = "0123456789abcdef".toCharArray();
+
+    // shared with the native side, jobs are decoded straight into jobBuffer and shares read straight out of
+    // shareBuffer
+    private static final ByteBuffer jobBuffer =
+            ByteBuffer.allocateDirect(JOB_RECORD_SIZE).order(ByteOrder.LITTLE_ENDIAN);
+    private static final ByteBuffer shareBuffer =
+            ByteBuffer.allocateDirect(SHARE_RECORDS * SHARE_RECORD_SIZE).order(ByteOrder.LITTLE_ENDIAN);
+
     static {
         System.loadLibrary("monero-android-miner");
+        setShareBuffer(shareBuffer);
     }
 
+    public static final int THROTTLE_DUTY_CYCLE = 0;
+    public static final int THROTTLE_PARK = 1;
+
+    // fraction of the whole CPU, returns the load actually applied
     public static native double adjustCpuLoad(double modifier);
+    public static native boolean setThrottleMode(int mode);
+    // resizes the hashing threads without restarting, returns the count applied
+    public static native int setThreads(int threads);
+    public static native int threads();
+    // adjusts the thread count and the load on its own to get the most sustained H/s out of the device while its
+    // CPU stays below ceiling degrees Celsius and the battery drain below powerLimit watts (0 for no limit). Set
+    // threads first, the governor never goes above them, and leave adjustCpuLoad alone until stopGovernor puts
+    // the previous settings back. root is the sysfs mount, null for /sys. False if there are no sensors to read.
+    public static native boolean startGovernor(double ceiling, double powerLimit, String root);
+    public static native void stopGovernor();
+    // [temperature C (NaN if unknown), clock fraction, watts, budget in threads, threads, H/s, overheats,
+    //  collapses], null without a governor
+    public static native double[] governorStats();
+    // [budget, samples, H/s, temperature C, watts] for every load level in half thread steps, null without one
+    public static native double[] governorCurve();
+    // parks the hashing threads for a screen-off or a lost charger while the connection stays up. VMs, caches and
+    // jobs stay resident for the idle timeout (5 minutes by default, negative for the whole pause), after that the
+    // memory is released and miningResume rebuilds it. Jobs arriving in between are picked up on resume.
+    public static native void miningPause();
+    public static native void miningResume();
+    public static native void setIdleTimeout(long milliseconds);
+    // ms from the last miningResume to the first hash after it, -1 until then
+    public static native double resumeLatency();
+    // nonce bits the miner may change (clear the pool reserved ones, e.g. 0x00ffffff for a fixed top byte) and
+    // the part of them this rig takes out of count rigs mining the same jobs, applies from the next job
+    public static native boolean setNonceSpace(int mask, int index, int count);
+    // pins hasher threads started afterwards to the cores picked from the CPU topology, on by default
+    public static native void setAffinity(boolean enabled);
     public static native double hashrate();
+    // [H/s 10s, H/s 60s, H/s 15m, total hashes, elapsed s, process CPU s, latency p50 ms, p90 ms, p99 ms,
+    //  thread count, then H/s 10s, 60s, 15m for every thread]
+    public static native double[] hashrateStats();
+    // takes effect on the next job, falls back to light mode if the dataset doesn't fit in memory
+    public static native void setFastMode(boolean enabled);
+    public static native boolean fastModeActive();
+
+    // benchmarks the RandomX flag sets on the first epoch and keeps the fastest, off by default. The choice is
+    // stored in file (e.g. under the app's files dir) for this CPU model, null repeats the trials on every start
+    public static native void setCalibration(boolean enabled, String file);
+    // e.g. "jit+hard-aes", null until the flags were chosen
+    public static native String randomxFlags();
+
+    // keeps initialized RandomX caches in directory (e.g. the app's cache dir) so restarts on the same seed skip
+    // the cache initialization, null disables it
+    public static native void setCacheStore(String directory);
+
+    public static final int PAGES_REGULAR = 0;
+    public static final int PAGES_TRANSPARENT = 1;
+    public static final int PAGES_HUGE = 2;
+
+    // takes effect on the next epoch, explicit huge pages first, then transparent ones
+    public static native void setHugePages(boolean enabled);
+    // [cache PAGES_*, dataset PAGES_* or -1 in light mode, scratchpads on huge pages, scratchpads],
+    // null until a job is being hashed
+    public static native int[] memoryPages();
+    // milliseconds until every hasher thread computed its first hash, -1 while starting up
+    public static native long startupTime();
+    public static native long residentMemory();
+    // recomputes every share on an interpreter VM before submitting it, off by default. Hashers producing wrong
+    // hashes are quarantined and replaced by one on another core.
+    public static native void setVerification(boolean enabled);
+    // [verified shares, hardware errors, state] for every hasher, the state is 0 if healthy, 1 if quarantined after
+    // wrong hashes or 2 if its thread failed
+    public static native long[] threadHealth();
+    // Chrome trace JSON of the recent hashing, delivery and epoch phases (open in ui.perfetto.dev), false unless
+    // the library was built with MINER_TRACE
+    public static native boolean writeTrace(String file);
+    public static native long sharesFound();
+    // shares lost because the native delivery queue was full
+    public static native long sharesDropped();
+
+    // extra job sources (a second pool, a solo node) hashed next to the one start() connects, which is slot 0.
+    // Threads are split across the slots with a job by weight, slots on the same seed share the RandomX cache.
+    public static native boolean setSlotJob(int slot, String id, byte[] blob, byte[] seedHash, long height,
+                                            byte[] target);
+    // weight 0 pauses the slot, new slots start at 1
+    public static native boolean setSlotWeight(int slot, double weight);
+    public static native void removeSlot(int slot);
+    // [active, weight, threads, hashes, shares, H/s 10s] for every slot
+    public static native double[] slotStats();
+
+    // connects the slot straight to the pools from native code, failing over along the list and reconnecting with
+    // backoff. Jobs and shares of the slot bypass Java, slotShares() stays empty for it.
+    public static native boolean startStratum(int slot, String[] hosts, int[] ports, String login, String password,
+                                              String rigId);
+    public static native void stopStratum(int slot);
+    // [connected, pool index, jobs, accepted, rejected, stale, reconnects, submit latency avg us, max us],
+    // null without a native connection on the slot
+    public static native long[] stratumStats(int slot);
+
+    // solo mines the slot against a monerod RPC port (18081 by default), found blocks pay wallet. Replaces any
+    // native connection of the slot, like startStratum the slot's jobs and blocks bypass Java.
+    public static native boolean startSolo(int slot, String host, int port, String wallet);
+    public static native void stopSolo(int slot);
+    // [connected, height, templates, extra nonces, blocks accepted, rejected, stale, template switch avg us,
+    //  max us], null without solo mining on the slot
+    public static native long[] soloStats(int slot);
+
+    // shares found for the jobs set with setSlotJob, to be submitted to that slot's source
+    public static LinkedBlockingQueue slotShares(int slot) {
+        if (slot == 0) {
+            return miningSharesQueue;
+        }
+        LinkedBlockingQueue queue = slotSharesQueues.get(slot);
+        if (queue == null) {
+            slotSharesQueues.putIfAbsent(slot, new LinkedBlockingQueue());
+            queue = slotSharesQueues.get(slot);
+        }
+        return queue;
+    }
 
     public static boolean start(final String host, final int port, final String address, final String worker) {
         if (miningThread != null) {
@@ -77,8 +225,8 @@ public class Miner {
                         }
                         Stratum stratum = new Stratum(host, port, address, worker, new NewJobCallback() {
                             @Override
-                            boolean handler(String id, byte[] blob, byte[] seedHash, long height, byte[] target) {
-                                return miningStart(id, blob, seedHash, height, target);
+                            boolean handler(String id, String blob, String seedHash, long height, String target) {
+                                return setJob(0, id, blob, seedHash, height, target);
                             }
                         }, new ShareProducer() {
                             @Override
@@ -119,9 +267,9 @@ public class Miner {
         return miningThread != null;
     }
 
-    public static void miningCallback(final String jobId, final String hash, final String nonce) {
+    public static void miningCallback(final int slot, final String jobId, final String hash, final String nonce) {
         try {
-            miningSharesQueue.put(new JSONObject(new HashMap<String, Object>() {{
+            slotShares(slot).put(new JSONObject(new HashMap<String, Object>() {{
                 put("job_id", jobId);
                 put("result", hash);
                 put("nonce", nonce);
@@ -130,12 +278,91 @@ public class Miner {
         }
     }
 
+    // called on the delivery thread with count ShareRecords at the start of shareBuffer, only valid until it returns
+    public static void sharesReady(int count) {
+        for (int index = 0; index < count; ++index) {
+            final int record = index * SHARE_RECORD_SIZE;
+            final byte[] id = new byte[shareBuffer.getInt(record + SHARE_ID_SIZE)];
+            for (int offset = 0; offset < id.length; ++offset) {
+                id[offset] = shareBuffer.get(record + SHARE_ID + offset);
+            }
+            miningCallback(
+                    shareBuffer.getInt(record + SHARE_SLOT),
+                    new String(id, Charset.forName("UTF-8")),
+                    toHex(shareBuffer, record + SHARE_HASH, 32),
+                    toHex(shareBuffer, record + SHARE_NONCE, 4));
+        }
+    }
+
+    // decodes the hex fields straight into the direct job buffer the native side reads in place
+    public static synchronized boolean setJob(int slot, String id, String blob, String seedHash, long height,
+                                              String target) {
+        final byte[] idBytes = id.getBytes(Charset.forName("UTF-8"));
+        if (idBytes.length > JOB_BLOB_SIZE - JOB_ID || blob.length() > 2 * (JOB_SEED_HASH - JOB_BLOB)
+                || seedHash.length() != 2 * (JOB_HEIGHT - JOB_SEED_HASH)
+                || target.length() > 2 * (JOB_RECORD_SIZE - JOB_TARGET)) {
+            return false;
+        }
+        jobBuffer.put(JOB_ID_SIZE, (byte) idBytes.length);
+        for (int index = 0; index < idBytes.length; ++index) {
+            jobBuffer.put(JOB_ID + index, idBytes[index]);
+        }
+        jobBuffer.put(JOB_BLOB_SIZE, (byte) (blob.length() / 2));
+        jobBuffer.putLong(JOB_HEIGHT, height);
+        jobBuffer.put(JOB_TARGET_SIZE, (byte) (target.length() / 2));
+        if (!putHex(jobBuffer, JOB_BLOB, blob) || !putHex(jobBuffer, JOB_SEED_HASH, seedHash)
+                || !putHex(jobBuffer, JOB_TARGET, target)) {
+            return false;
+        }
+        return setSlotJobBuffer(slot, jobBuffer);
+    }
+
+    private static String toHex(ByteBuffer buffer, int offset, int length) {
+        final char[] digits = new char[length * 2];
+        for (int index = 0; index < length; ++index) {
+            final int value = buffer.get(offset + index) & 0xff;
+            digits[index * 2] = HEX_DIGITS[value >>> 4];
+            digits[index * 2 + 1] = HEX_DIGITS[value & 0x0f];
+        }
+        return new String(digits);
+    }
+
+    private static boolean putHex(ByteBuffer buffer, int offset, String hex) {
+        if (hex.length() % 2 != 0) {
+            return false;
+        }
+        for (int index = 0; index < hex.length() / 2; ++index) {
+            final int high = Character.digit(hex.charAt(index * 2), 16);
+            final int low = Character.digit(hex.charAt(index * 2 + 1), 16);
+            if (high < 0 || low < 0) {
+                return false;
+            }
+            buffer.put(offset + index, (byte) (high << 4 | low));
+        }
+        return true;
+    }
+
+    // the job ran out of nonces, the slot's source is asked for a fresh one
+    public static void nonceExhausted(final int slot, final String jobId) {
+        try {
+            slotShares(slot).put(new JSONObject(new HashMap<String, Object>() {{
+                put("getjob", jobId);
+            }}));
+        } catch (InterruptedException e) {
+        }
+    }
+
+    // kept for callers from before job slots, the same as setSlotJob on slot 0
     private static native boolean miningStart(String id, byte[] blob, byte[] seedHash, long height, byte[] target);
     private static native void miningStop();
+    private static native boolean setSlotJobBuffer(int slot, ByteBuffer job);
+    // shares are written into buffer and handed over through sharesReady instead of miningCallback
+    private static native boolean setShareBuffer(ByteBuffer buffer);
+    static native boolean miningPrepare(byte[] seedHash);
 }
 
 abstract class NewJobCallback {
-    abstract boolean handler(String id, byte[] blob, byte[] seedHash, long height, byte[] target);
+    abstract boolean handler(String id, String blob, String seedHash, long height, String target);
 }
 
 abstract class ShareProducer {
@@ -191,7 +418,9 @@ class Stratum {
         try {
             String method = json.optString("method");
             if (method.isEmpty()) {
-                return json.getJSONObject("result").optJSONObject("job");
+                JSONObject result = json.getJSONObject("result");
+                // getjob answers with the job itself, login wraps it
+                return result.has("job_id") ? result : result.optJSONObject("job");
             } else if (method.equals("job")) {
                 return json.getJSONObject("params");
             }
@@ -244,18 +473,28 @@ class Stratum {
         }}));
     }
 
+    private void getJob(final String sessionId) throws IOException {
+        send(new JSONObject(new HashMap<String, Object>() {{
+            put("id", 1);
+            put("method", "getjob");
+            put("params", new HashMap<String, Object>() {{
+                put("id", sessionId);
+            }});
+            put("jsonrpc", "2.0");
+        }}));
+    }
+
     private void updateJob(JSONObject job) throws Exception {
         String id = job.getString("job_id");
         String blob = job.getString("blob");
         long height = job.getLong("height");
         String seedHash = job.getString("seed_hash");
         String target = job.getString("target");
-        onNewJob.handler(
-            id,
-            hexStringToByteArray(blob),
-            hexStringToByteArray(seedHash),
-            height,
-            hexStringToByteArray(target));
+        String nextSeedHash = job.optString("next_seed_hash");
+        if (!nextSeedHash.isEmpty() && !nextSeedHash.equals(seedHash)) {
+            Miner.miningPrepare(hexStringToByteArray(nextSeedHash));
+        }
+        onNewJob.handler(id, blob, seedHash, height, target);
     }
 
     public void run() throws Exception, IOException, JSONException {
@@ -288,6 +527,10 @@ class Stratum {
             JSONObject share;
             while (true) {
                 share = producer.take();
+                if (share.has("getjob")) {
+                    getJob(sessionId);
+                    continue;
+                }
                 share.put("id", sessionId);
                 submit(share);
             }
@@ -0,0 +1,221 @@
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstring>
+#include <vector>
+
+#include "job.h"
+#include "keccak.h"
+
+// Block template from get_block_template that rebuilds the hashing blob locally, so every extra nonce written into
+// the reserved bytes of the coinbase extra is fresh nonce space without asking the node again
+class BlockTemplate
+{
+public:
+  typedef uint32_t ExtraNonce;
+
+  // False unless the blob is a block with a RingCT coinbase and the reserved bytes lie in its extra field. The
+  // nonce must sit at Job::NonceOffset like in every block since v7.
+  bool parse(const std::vector<uint8_t> &blob, size_t reservedOffset, size_t reservedSize)
+  {
+    m_blob = blob;
+    m_reservedOffset = reservedOffset;
+    m_reservedSize = reservedSize;
+    m_txHashes.clear();
+
+    size_t position = 0;
+    uint64_t value;
+    // Major and minor version, timestamp, previous id and nonce
+    if (!varint(&position, &value) || !varint(&position, &value) || !varint(&position, &value) ||
+        position + 32 != Job::NonceOffset || position + 32 + sizeof(Job::Nonce) > m_blob.size())
+    {
+      return false;
+    }
+    m_headerSize = Job::NonceOffset + sizeof(Job::Nonce);
+    position = m_headerSize;
+
+    // Coinbase prefix: version, unlock time, one generation input, outputs and extra
+    m_minerTx = position;
+    uint64_t version;
+    uint64_t inputs;
+    uint64_t outputs;
+    if (!varint(&position, &version) || version != 2 || !varint(&position, &value) || !varint(&position, &inputs) ||
+        inputs != 1 || !skip(&position, 1) || m_blob[position - 1] != 0xff || !varint(&position, &value) ||
+        !varint(&position, &outputs))
+    {
+      return false;
+    }
+    for (uint64_t output = 0; output < outputs; ++output)
+    {
+      // Amount, then a key output or a key output with view tag
+      if (!varint(&position, &value) || !skip(&position, 1))
+      {
+        return false;
+      }
+      const uint8_t tag = m_blob[position - 1];
+      if ((tag != 0x02 && tag != 0x03) || !skip(&position, tag == 0x02 ? 32 : 33))
+      {
+        return false;
+      }
+    }
+    uint64_t extraSize;
+    if (!varint(&position, &extraSize) || reservedOffset < position || !skip(&position, extraSize) ||
+        reservedOffset + reservedSize > position || reservedSize < sizeof(ExtraNonce))
+    {
+      return false;
+    }
+    m_prefixEnd = position;
+    // RingCT type null, the coinbase has no signatures
+    if (!skip(&position, 1) || m_blob[position - 1] != 0)
+    {
+      return false;
+    }
+
+    uint64_t transactions;
+    if (!varint(&position, &transactions) || transactions > (m_blob.size() - position) / 32)
+    {
+      return false;
+    }
+    for (uint64_t index = 0; index < transactions; ++index, position += 32)
+    {
+      m_txHashes.emplace_back();
+      std::memcpy(&m_txHashes.back()[0], &m_blob[position], 32);
+    }
+    return position == m_blob.size();
+  }
+
+  std::vector<uint8_t> hashingBlob(ExtraNonce extraNonce) const
+  {
+    std::vector<uint8_t> blob = withExtraNonce(extraNonce);
+
+    // Transaction hash of a v2 coinbase over the hashes of its prefix, its RingCT base of type null and the empty
+    // prunable part
+    const uint8_t rctBase = 0;
+    const Keccak::Hash parts[] = {
+      Keccak::hash(&blob[m_minerTx], m_prefixEnd - m_minerTx),
+      Keccak::hash(&rctBase, sizeof(rctBase)),
+      Keccak::Hash{},
+    };
+    std::vector<Keccak::Hash> hashes(1, Keccak::hash(parts[0].data(), sizeof(parts)));
+    hashes.insert(hashes.end(), m_txHashes.begin(), m_txHashes.end());
+    const Keccak::Hash root = treeHash(hashes);
+
+    blob.resize(m_headerSize);
+    blob.insert(blob.end(), root.begin(), root.end());
+    uint64_t count = hashes.size();
+    while (count >= 0x80)
+    {
+      blob.push_back(static_cast<uint8_t>(count & 0x7f) | 0x80);
+      count >>= 7;
+    }
+    blob.push_back(static_cast<uint8_t>(count));
+    return blob;
+  }
+
+  std::vector<uint8_t> blockBlob(ExtraNonce extraNonce, Job::Nonce nonce) const
+  {
+    std::vector<uint8_t> blob = withExtraNonce(extraNonce);
+    std::memcpy(&blob[Job::NonceOffset], &nonce, sizeof(nonce));
+    return blob;
+  }
+
+private:
+  // Merkle root the way tree_hash in Monero computes it
+  static Keccak::Hash treeHash(std::vector<Keccak::Hash> hashes)
+  {
+    if (hashes.size() == 1)
+    {
+      return hashes[0];
+    }
+    size_t count = 1;
+    while (count * 2 < hashes.size())
+    {
+      count *= 2;
+    }
+    // The hashes past the largest power of two below the count are folded into the ones before them first
+    std::vector<Keccak::Hash> level(hashes.begin(), hashes.begin() + (2 * count - hashes.size()));
+    for (size_t index = level.size(); index < hashes.size(); index += 2)
+    {
+      level.push_back(Keccak::hash(hashes[index], hashes[index + 1]));
+    }
+    while (level.size() > 1)
+    {
+      for (size_t index = 0; index < level.size() / 2; ++index)
+      {
+        level[index] = Keccak::hash(level[index * 2], level[index * 2 + 1]);
+      }
+      level.resize(level.size() / 2);
+    }
+    return level[0];
+  }
+
+  std::vector<uint8_t> withExtraNonce(ExtraNonce extraNonce) const
+  {
+    std::vector<uint8_t> blob = m_blob;
+    std::memcpy(&blob[m_reservedOffset], &extraNonce, sizeof(extraNonce));
+    return blob;
+  }
+
+  bool varint(size_t *position, uint64_t *value) const
+  {
+    *value = 0;
+    for (unsigned shift = 0; *position < m_blob.size() && shift < 64; shift += 7)
+    {
+      const uint8_t byte = m_blob[(*position)++];
+      *value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0)
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool skip(size_t *position, uint64_t size) const
+  {
+    if (size > m_blob.size() - *position)
+    {
+      return false;
+    }
+    *position += size;
+    return true;
+  }
+
+private:
+  std::vector<uint8_t> m_blob;
+  size_t m_reservedOffset;
+  size_t m_reservedSize;
+  size_t m_headerSize;
+  size_t m_minerTx;
+  size_t m_prefixEnd;
+  std::vector<Keccak::Hash> m_txHashes;
+};
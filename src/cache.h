@@ -0,0 +1,143 @@
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <array>
+#include <memory>
+#include <stdexcept>
+
+#include <randomx.h>
+
+#include "cachestore.h"
+#include "pages.h"
+
+class Cache
+{
+public:
+  typedef std::array<uint8_t, RANDOMX_HASH_SIZE> SeedHash;
+
+  // RANDOMX_ARGON_MEMORY KiB of Argon2 memory
+  static constexpr const size_t Size = 256 * 1024 * 1024;
+
+  // With RANDOMX_FLAG_LARGE_PAGES explicit huge pages are tried first, then transparent ones. A cache found in the
+  // store is mapped from its file instead, which skips Argon2 and leaves the memory file backed.
+  Cache(randomx_flags flags, const SeedHash &seedHash, const CacheStore *store = nullptr)
+    : m_cache(nullptr)
+    , m_flags(flags)
+    , m_seedHash(seedHash)
+    , m_pages(Pages::Regular)
+  {
+    if (store != nullptr && store->contains(seedHash))
+    {
+      m_cache = randomx_alloc_cache(static_cast<randomx_flags>(flags & ~RANDOMX_FLAG_LARGE_PAGES));
+      if (m_cache != nullptr)
+      {
+        m_mapping = store->load(m_cache, seedHash);
+      }
+      if (m_mapping)
+      {
+        return;
+      }
+      if (m_cache != nullptr)
+      {
+        randomx_release_cache(m_cache);
+      }
+    }
+
+    m_cache = randomx_alloc_cache(flags);
+    if (m_cache != nullptr && (flags & RANDOMX_FLAG_LARGE_PAGES))
+    {
+      m_pages = Pages::Huge;
+    }
+    else if (flags & RANDOMX_FLAG_LARGE_PAGES)
+    {
+      m_cache = randomx_alloc_cache(static_cast<randomx_flags>(flags & ~RANDOMX_FLAG_LARGE_PAGES));
+      if (m_cache != nullptr && Pages::advise(randomx_get_cache_memory(m_cache), Size))
+      {
+        m_pages = Pages::Transparent;
+      }
+    }
+    if (m_cache == nullptr)
+    {
+      throw std::runtime_error("failed to allocate RandomX cache");
+    }
+    randomx_init_cache(m_cache, &m_seedHash[0], m_seedHash.size());
+  }
+
+  ~Cache()
+  {
+    m_mapping.reset();
+    randomx_release_cache(m_cache);
+  }
+
+  Cache(const Cache &) = delete;
+  Cache &operator=(const Cache &) = delete;
+
+  // RandomX never writes to an initialized cache while hashing, so any number of VMs may share it
+  randomx_cache *get() const
+  {
+    return m_cache;
+  }
+
+  // Flags the cache was requested with, VMs on it ask for the same pages
+  randomx_flags flags() const
+  {
+    return m_flags;
+  }
+
+  Pages::Kind pages() const
+  {
+    return m_pages;
+  }
+
+  // Mapped from the cache store rather than computed
+  bool stored() const
+  {
+    return m_mapping != nullptr;
+  }
+
+  const SeedHash &seedHash() const
+  {
+    return m_seedHash;
+  }
+
+  bool seedEqual(const SeedHash &seedHash) const
+  {
+    return m_seedHash == seedHash;
+  }
+
+private:
+  randomx_cache *m_cache;
+  const randomx_flags m_flags;
+  const SeedHash m_seedHash;
+  Pages::Kind m_pages;
+  std::unique_ptr<CacheStore::Mapping> m_mapping;
+};
@@ -0,0 +1,234 @@
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include "cachestore.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "randomxinternals.h"
+#include "utils.h"
+
+namespace
+{
+  constexpr const char Extension[] = ".rxcache";
+  constexpr const uint32_t FormatVersion = 1;
+  // Multiple of every page size in use, so the data can be mapped straight from the file
+  constexpr const off_t DataOffset = 64 * 1024;
+  constexpr const size_t CacheSize = RandomxInternals::CacheSize;
+
+  struct Header
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t argonMemory;
+    uint32_t argonIterations;
+    uint32_t argonLanes;
+    uint32_t cacheAccesses;
+    char argonSalt[32];
+    uint8_t seedHash[RANDOMX_HASH_SIZE];
+    uint64_t size;
+    uint64_t checksum;
+  };
+
+  Header makeHeader(const CacheStore::SeedHash &seedHash, uint64_t checksum)
+  {
+    Header header{};
+    std::memcpy(header.magic, "RXCACHE", 8);
+    header.version = FormatVersion;
+    header.argonMemory = RandomxInternals::ArgonMemory;
+    header.argonIterations = RandomxInternals::ArgonIterations;
+    header.argonLanes = RandomxInternals::ArgonLanes;
+    header.cacheAccesses = RandomxInternals::CacheAccesses;
+    std::strncpy(header.argonSalt, RandomxInternals::argonSalt(), sizeof(header.argonSalt) - 1);
+    std::copy(seedHash.begin(), seedHash.end(), header.seedHash);
+    header.size = CacheSize;
+    header.checksum = checksum;
+    return header;
+  }
+
+  // Fletcher style sum over 64-bit words, catches corrupted data at memory speed. Truncated files are rejected by
+  // their size before anything is mapped.
+  uint64_t checksum(const uint8_t *data, size_t size)
+  {
+    uint64_t sum = 0;
+    uint64_t mixed = 0;
+    for (size_t offset = 0; offset + sizeof(uint64_t) <= size; offset += sizeof(uint64_t))
+    {
+      uint64_t word;
+      std::memcpy(&word, data + offset, sizeof(word));
+      sum += word;
+      mixed += sum;
+    }
+    return sum ^ (mixed * 0x9e3779b97f4a7c15ull);
+  }
+} // namespace
+
+CacheStore::Mapping::Mapping(randomx_cache *cache, uint8_t *allocated, void *mapped, size_t size)
+  : m_cache(cache)
+  , m_allocated(allocated)
+  , m_mapped(mapped)
+  , m_size(size)
+{
+}
+
+CacheStore::Mapping::~Mapping()
+{
+  RandomxInternals::swapMemory(m_cache, m_allocated);
+  munmap(m_mapped, m_size);
+}
+
+CacheStore::CacheStore(const std::string &directory)
+  : m_directory(directory)
+{
+}
+
+std::unique_ptr<CacheStore::Mapping> CacheStore::load(randomx_cache *cache, const SeedHash &seedHash) const
+{
+  const std::string file = path(seedHash);
+  const int fd = open(file.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    return nullptr;
+  }
+
+  // Touching a mapped page past the end of the file raises SIGBUS, so a short file never gets mapped
+  struct stat status;
+  if (fstat(fd, &status) != 0 || static_cast<uint64_t>(status.st_size) < DataOffset + CacheSize)
+  {
+    close(fd);
+    unlink(file.c_str());
+    return nullptr;
+  }
+
+  Header header;
+  const Header expected = makeHeader(seedHash, 0);
+  void *mapped = MAP_FAILED;
+  if (pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+      std::memcmp(&header, &expected, offsetof(Header, checksum)) == 0)
+  {
+    // Private and writable like the allocation it replaces, pages are read in lazily and stay file backed
+    mapped = mmap(nullptr, CacheSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, DataOffset);
+  }
+  close(fd);
+  if (mapped == MAP_FAILED)
+  {
+    return nullptr;
+  }
+  if (checksum(static_cast<const uint8_t *>(mapped), CacheSize) != header.checksum)
+  {
+    munmap(mapped, CacheSize);
+    return nullptr;
+  }
+
+  // The JIT code and the VMs read cache->memory when they run, so the mapping is swapped in afterwards
+  RandomxInternals::initWithoutFill(cache, &seedHash[0], seedHash.size());
+  uint8_t *const allocated = RandomxInternals::swapMemory(cache, static_cast<uint8_t *>(mapped));
+  return std::unique_ptr<Mapping>(new Mapping(cache, allocated, mapped, CacheSize));
+}
+
+bool CacheStore::contains(const SeedHash &seedHash) const
+{
+  return access(path(seedHash).c_str(), R_OK) == 0;
+}
+
+bool CacheStore::save(randomx_cache *cache, const SeedHash &seedHash) const
+{
+  const uint8_t *memory = static_cast<const uint8_t *>(randomx_get_cache_memory(cache));
+  const Header header = makeHeader(seedHash, checksum(memory, CacheSize));
+
+  const std::string target = path(seedHash);
+  const std::string temporary = target + ".tmp";
+  const int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0)
+  {
+    return false;
+  }
+
+  bool written = pwrite(fd, &header, sizeof(header), 0) == sizeof(header);
+  for (size_t offset = 0; written && offset < CacheSize;)
+  {
+    const ssize_t chunk = pwrite(fd, memory + offset, CacheSize - offset, DataOffset + offset);
+    written = chunk > 0;
+    offset += written ? chunk : 0;
+  }
+  written = fsync(fd) == 0 && written;
+  close(fd);
+
+  if (!written || rename(temporary.c_str(), target.c_str()) != 0)
+  {
+    unlink(temporary.c_str());
+    return false;
+  }
+  evict();
+  return true;
+}
+
+std::string CacheStore::path(const SeedHash &seedHash) const
+{
+  return m_directory + "/" + bufferToHex(&seedHash[0], seedHash.size()) + Extension;
+}
+
+void CacheStore::evict() const
+{
+  DIR *directory = opendir(m_directory.c_str());
+  if (directory == nullptr)
+  {
+    return;
+  }
+
+  std::vector<std::pair<time_t, std::string>> entries;
+  const size_t extensionSize = sizeof(Extension) - 1;
+  while (const dirent *entry = readdir(directory))
+  {
+    const std::string name = entry->d_name;
+    struct stat status;
+    const std::string file = m_directory + "/" + name;
+    if (name.size() > extensionSize && name.compare(name.size() - extensionSize, extensionSize, Extension) == 0 &&
+        stat(file.c_str(), &status) == 0)
+    {
+      entries.emplace_back(status.st_mtime, file);
+    }
+  }
+  closedir(directory);
+
+  std::sort(entries.begin(), entries.end());
+  for (size_t index = 0; index + MaxEntries < entries.size(); ++index)
+  {
+    unlink(entries[index].second.c_str());
+  }
+}
@@ -0,0 +1,81 @@
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <randomx.h>
+
+// Initialized RandomX caches kept on disk per seed hash. Argon2 over the whole cache is what makes a cache
+// expensive, so a stored one is mapped from its file and only the cheap remainder of the initialization runs.
+// Files carry the RandomX parameters they were made with and a checksum, anything that doesn't match is ignored.
+class CacheStore
+{
+public:
+  typedef std::array<uint8_t, RANDOMX_HASH_SIZE> SeedHash;
+
+  // Files beyond this many are removed, oldest first
+  static constexpr const size_t MaxEntries = 2;
+
+  // Restores the allocated cache memory and unmaps the file, must go before the cache is released
+  class Mapping
+  {
+  public:
+    Mapping(randomx_cache *cache, uint8_t *allocated, void *mapped, size_t size);
+    ~Mapping();
+
+    Mapping(const Mapping &) = delete;
+    Mapping &operator=(const Mapping &) = delete;
+
+  private:
+    randomx_cache *const m_cache;
+    uint8_t *const m_allocated;
+    void *const m_mapped;
+    const size_t m_size;
+  };
+
+  explicit CacheStore(const std::string &directory);
+
+  // Initializes the cache from a stored file, nullptr if there is no valid one and the cache is left untouched
+  std::unique_ptr<Mapping> load(randomx_cache *cache, const SeedHash &seedHash) const;
+  bool contains(const SeedHash &seedHash) const;
+  // Writes through a temporary file so a crash never leaves a truncated entry behind
+  bool save(randomx_cache *cache, const SeedHash &seedHash) const;
+
+private:
+  std::string path(const SeedHash &seedHash) const;
+  void evict() const;
+
+private:
+  const std::string m_directory;
+};
@@ -0,0 +1,331 @@
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <randomx.h>
+
+#include "cache.h"
+#include "job.h"
+#include "vm.h"
+
+// Picks the fastest RandomX flag set the host actually allows by hashing a short trial with every combination of
+// JIT, hard AES and secure JIT that randomx_get_flags() reports as available. A JIT blocked by a W^X policy fails
+// to create its VM and is skipped. The choice is stored on disk keyed by the CPU model. Off by default, the trials
+// delay the first epoch by up to a few seconds and only pay off once their result is stored.
+class Calibration
+{
+public:
+  // Builds the cache the trials run on with the flags given, throws if it can't
+  typedef std::function<std::shared_ptr<const Cache>(randomx_flags)> CacheBuilder;
+
+  static constexpr const int64_t TrialMs = 500;
+  static constexpr const size_t TrialMinHashes = 2;
+
+  struct Trial
+  {
+    randomx_flags flags;
+    // 0 if the VM could not be created
+    double hashrate;
+  };
+
+  Calibration()
+    : m_enabled(false)
+    , m_done(false)
+    , m_loaded(false)
+    , m_flags(randomx_get_flags())
+  {
+  }
+
+  Calibration(const Calibration &) = delete;
+  Calibration &operator=(const Calibration &) = delete;
+
+  // Disabled, randomx_get_flags() is used as is. An empty file keeps the result in memory only.
+  void configure(bool enabled, const std::string &file)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_enabled = enabled;
+    m_file = file;
+  }
+
+  // Flags every flag set tried shares with the cache the trials run on, so the first epoch can keep that cache
+  static randomx_flags cacheFlags()
+  {
+    return static_cast<randomx_flags>(randomx_get_flags() & ~RANDOMX_FLAG_SECURE);
+  }
+
+  // Flags to build epochs with. Unless a result for this CPU is on disk, the first call runs the trials on a cache
+  // from buildCache, which the caller keeps for its epoch if the flags match.
+  randomx_flags flags(const CacheBuilder &buildCache)
+  {
+    std::lock_guard<std::mutex> calibrating(m_calibrating);
+
+    std::string file;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_done || !m_enabled)
+      {
+        return m_enabled ? m_flags : randomx_get_flags();
+      }
+      file = m_file;
+    }
+
+    const std::string key = cpuModel() + "|" + std::to_string(randomx_get_flags());
+    randomx_flags flags;
+    if (load(file, key, &flags))
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_flags = flags;
+      m_loaded = true;
+      m_done = true;
+      return m_flags;
+    }
+
+    std::vector<Trial> trials = run(buildCache);
+    flags = randomx_get_flags();
+    double best = 0;
+    for (const Trial &trial : trials)
+    {
+      if (trial.hashrate > best)
+      {
+        best = trial.hashrate;
+        flags = trial.flags;
+      }
+    }
+    if (best > 0)
+    {
+      save(file, key, flags);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_flags = flags;
+    m_trials = std::move(trials);
+    m_loaded = false;
+    m_done = true;
+    return m_flags;
+  }
+
+  // False until flags were chosen, loaded tells whether they came from disk without trials
+  bool result(randomx_flags *flags, bool *loaded, std::vector<Trial> *trials) const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!m_done)
+    {
+      return false;
+    }
+    *flags = m_flags;
+    *loaded = m_loaded;
+    *trials = m_trials;
+    return true;
+  }
+
+  static std::string name(randomx_flags flags)
+  {
+    std::string result = flags & RANDOMX_FLAG_JIT ? "jit" : "interpreter";
+    if (flags & RANDOMX_FLAG_SECURE)
+    {
+      result += "+secure";
+    }
+    result += flags & RANDOMX_FLAG_HARD_AES ? "+hard-aes" : "+soft-aes";
+    return result;
+  }
+
+private:
+  static std::vector<Trial> run(const CacheBuilder &buildCache)
+  {
+    const randomx_flags available = randomx_get_flags();
+    const int tuned = RANDOMX_FLAG_JIT | RANDOMX_FLAG_HARD_AES | RANDOMX_FLAG_SECURE;
+    const int common = available & ~tuned;
+
+    // A JIT cache needs executable memory as well, the VMs work on an interpreted one just the same
+    std::shared_ptr<const Cache> cache;
+    try
+    {
+      cache = buildCache(cacheFlags());
+    }
+    catch (const std::exception &)
+    {
+      try
+      {
+        cache = buildCache(static_cast<randomx_flags>(cacheFlags() & ~RANDOMX_FLAG_JIT));
+      }
+      catch (const std::exception &)
+      {
+        return {};
+      }
+    }
+
+    std::vector<Trial> trials;
+    for (const int jit : {available & RANDOMX_FLAG_JIT, 0})
+    {
+      for (const int aes : {available & RANDOMX_FLAG_HARD_AES, 0})
+      {
+        for (const int secure : {0, jit != 0 ? RANDOMX_FLAG_SECURE : 0})
+        {
+          const randomx_flags flags = static_cast<randomx_flags>(common | jit | aes | secure);
+          bool seen = false;
+          for (const Trial &trial : trials)
+          {
+            seen = seen || trial.flags == flags;
+          }
+          if (!seen)
+          {
+            trials.push_back({flags, hashrate(flags, cache)});
+          }
+        }
+      }
+    }
+    return trials;
+  }
+
+  static double hashrate(randomx_flags flags, const std::shared_ptr<const Cache> &cache)
+  {
+    std::unique_ptr<Vm> vm;
+    try
+    {
+      vm.reset(new Vm(flags, cache, nullptr));
+    }
+    catch (const std::exception &)
+    {
+      return 0;
+    }
+
+    std::array<uint8_t, 76> blob{};
+    std::array<uint8_t, RANDOMX_HASH_SIZE> result;
+    const auto started = std::chrono::steady_clock::now();
+    const auto deadline = started + std::chrono::milliseconds(static_cast<int64_t>(TrialMs));
+    size_t hashes = 0;
+    vm->hashFirst(&blob[0], blob.size());
+    do
+    {
+      ++blob[Job::NonceOffset];
+      vm->hashNext(&blob[0], blob.size(), &result);
+      ++hashes;
+    } while (hashes < TrialMinHashes || std::chrono::steady_clock::now() < deadline);
+    vm->hashLast(&result);
+    ++hashes;
+
+    return hashes / std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+  }
+
+  // Identifying /proc/cpuinfo fields, x86 reports a model name, ARM an implementer, part and often a SoC name
+  static std::string cpuModel()
+  {
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::vector<std::string> fields;
+    std::string line;
+    while (std::getline(cpuinfo, line))
+    {
+      const size_t colon = line.find(':');
+      if (colon == std::string::npos)
+      {
+        continue;
+      }
+      std::string key = line.substr(0, colon);
+      key.erase(key.find_last_not_of(" \t") + 1);
+      if (key != "model name" && key != "Hardware" && key != "CPU implementer" && key != "CPU part")
+      {
+        continue;
+      }
+      const size_t value = line.find_first_not_of(" \t", colon + 1);
+      const std::string field = key + "=" + (value != std::string::npos ? line.substr(value) : "");
+      if (std::find(fields.begin(), fields.end(), field) == fields.end())
+      {
+        fields.push_back(field);
+      }
+    }
+
+    std::string model;
+    for (const std::string &field : fields)
+    {
+      model += (model.empty() ? "" : ",") + field;
+    }
+    return model.empty() ? "unknown" : model;
+  }
+
+  // One line: key, flags and nothing else, a different key means another CPU or RandomX build
+  static bool load(const std::string &file, const std::string &key, randomx_flags *flags)
+  {
+    if (file.empty())
+    {
+      return false;
+    }
+    std::ifstream stream(file);
+    std::string storedKey;
+    std::string storedFlags;
+    if (!std::getline(stream, storedKey) || !std::getline(stream, storedFlags) || storedKey != key)
+    {
+      return false;
+    }
+    // Never trust a stored flag the host doesn't report, hard AES on a CPU without it would fault
+    char *end;
+    const long value = std::strtol(storedFlags.c_str(), &end, 10);
+    const long allowed = randomx_get_flags() | RANDOMX_FLAG_SECURE;
+    if (storedFlags.empty() || *end != '\0' || (value & ~allowed) != 0)
+    {
+      return false;
+    }
+    *flags = static_cast<randomx_flags>(value);
+    return true;
+  }
+
+  static void save(const std::string &file, const std::string &key, randomx_flags flags)
+  {
+    if (file.empty())
+    {
+      return;
+    }
+    std::ofstream stream(file, std::ios::trunc);
+    stream << key << '\n' << static_cast<int>(flags) << '\n';
+  }
+
+private:
+  // Held for the whole calibration, the state below is only locked briefly so readers never wait on trials
+  std::mutex m_calibrating;
+  mutable std::mutex m_mutex;
+  bool m_enabled;
+  std::string m_file;
+  bool m_done;
+  bool m_loaded;
+  randomx_flags m_flags;
+  std::vector<Trial> m_trials;
+};
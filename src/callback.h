@@ -30,14 +30,26 @@
 
 #pragma once
 
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
 #include <jni.h>
 
+#include "delivery.h"
+#include "marshal.h"
+#include "shares.h"
+#include "utils.h"
+
 JavaVM *javaVm = nullptr;
 jobject classLoader;
 jmethodID findClassMethod;
 
 constexpr const char className[] = "monero/android/miner/Miner";
 constexpr const char methodName[] = "miningCallback";
+constexpr const char exhaustedMethodName[] = "nonceExhausted";
+constexpr const char sharesReadyMethodName[] = "sharesReady";
 
 extern "C"
 {
@@ -83,13 +95,24 @@ extern "C"
   }
 }
 
-class CallbackVoidStringStringString
+// A Java callback that threw leaves its exception pending, and the next JNI call on the delivery thread would abort.
+// ExceptionDescribe writes it with its stack trace to the error log (logcat on Android) before it is cleared.
+void clearCallbackException(JNIEnv *env)
+{
+  if (env->ExceptionCheck())
+  {
+    env->ExceptionDescribe();
+    env->ExceptionClear();
+  }
+}
+
+class CallbackVoidIntStringStringString
 {
 public:
-  CallbackVoidStringStringString(JNIEnv *env, const char *className, const char *methodName)
+  CallbackVoidIntStringStringString(JNIEnv *env, const char *className, const char *methodName)
     : m_env(env)
   {
-    constexpr const char signature[] = "(Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;)V";
+    constexpr const char signature[] = "(ILjava/lang/String;Ljava/lang/String;Ljava/lang/String;)V";
 
     jclass classObject = findClass(className);
     if (classObject == nullptr)
@@ -100,19 +123,55 @@ public:
     m_method = env->GetStaticMethodID(m_class, methodName, signature);
   }
 
-  ~CallbackVoidStringStringString()
+  ~CallbackVoidIntStringStringString()
   {
     m_env->DeleteGlobalRef(m_class);
   }
 
-  void invoke(const std::string &jobId, const std::string &hash, const std::string &nonce) const
+  void invoke(uint32_t slot, const std::string &jobId, const std::string &hash, const std::string &nonce) const
   {
     m_env->CallStaticVoidMethod(
       m_class,
       m_method,
+      static_cast<jint>(slot),
       m_env->NewStringUTF(jobId.c_str()),
       m_env->NewStringUTF(hash.c_str()),
       m_env->NewStringUTF(nonce.c_str()));
+    clearCallbackException(m_env);
+  }
+
+private:
+  JNIEnv *m_env;
+  jclass m_class;
+  jmethodID m_method;
+};
+
+class CallbackVoidIntString
+{
+public:
+  CallbackVoidIntString(JNIEnv *env, const char *className, const char *methodName)
+    : m_env(env)
+  {
+    constexpr const char signature[] = "(ILjava/lang/String;)V";
+
+    jclass classObject = findClass(className);
+    if (classObject == nullptr)
+    {
+      throw std::runtime_error("java class not found");
+    }
+    m_class = static_cast<jclass>(m_env->NewGlobalRef(classObject));
+    m_method = env->GetStaticMethodID(m_class, methodName, signature);
+  }
+
+  ~CallbackVoidIntString()
+  {
+    m_env->DeleteGlobalRef(m_class);
+  }
+
+  void invoke(uint32_t slot, const std::string &value) const
+  {
+    m_env->CallStaticVoidMethod(m_class, m_method, static_cast<jint>(slot), m_env->NewStringUTF(value.c_str()));
+    clearCallbackException(m_env);
   }
 
 private:
@@ -120,3 +179,162 @@ private:
   jclass m_class;
   jmethodID m_method;
 };
+
+class CallbackVoidInt
+{
+public:
+  CallbackVoidInt(JNIEnv *env, const char *className, const char *methodName)
+    : m_env(env)
+  {
+    constexpr const char signature[] = "(I)V";
+
+    jclass classObject = findClass(className);
+    if (classObject == nullptr)
+    {
+      throw std::runtime_error("java class not found");
+    }
+    m_class = static_cast<jclass>(m_env->NewGlobalRef(classObject));
+    m_method = env->GetStaticMethodID(m_class, methodName, signature);
+  }
+
+  ~CallbackVoidInt()
+  {
+    m_env->DeleteGlobalRef(m_class);
+  }
+
+  void invoke(int value) const
+  {
+    m_env->CallStaticVoidMethod(m_class, m_method, static_cast<jint>(value));
+    clearCallbackException(m_env);
+  }
+
+private:
+  JNIEnv *m_env;
+  jclass m_class;
+  jmethodID m_method;
+};
+
+// Attaches the delivery thread to the JVM and forwards every batch to Miner.miningCallback, nonce space
+// exhaustion notices to Miner.nonceExhausted. With a share buffer set the shares are written into it as
+// ShareRecords instead and Miner.sharesReady is called once per batch, no strings are created for them.
+class JniShareSink : public ShareSink
+{
+public:
+  JniShareSink()
+    : m_env(nullptr)
+    , m_buffer(nullptr)
+    , m_address(nullptr)
+    , m_records(0)
+  {
+  }
+
+  // buffer is a direct ByteBuffer holding at least one ShareRecord, nullptr goes back to the string callbacks.
+  // False if buffer isn't direct or too small.
+  bool setShareBuffer(JNIEnv *env, jobject buffer)
+  {
+    uint8_t *address = nullptr;
+    size_t records = 0;
+    if (buffer != nullptr)
+    {
+      address = static_cast<uint8_t *>(env->GetDirectBufferAddress(buffer));
+      const jlong capacity = env->GetDirectBufferCapacity(buffer);
+      records = capacity > 0 ? static_cast<size_t>(capacity) / ShareRecord::Size : 0;
+      if (address == nullptr || records == 0)
+      {
+        return false;
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(m_bufferMutex);
+
+    if (m_buffer != nullptr)
+    {
+      env->DeleteGlobalRef(m_buffer);
+    }
+    m_buffer = buffer != nullptr ? env->NewGlobalRef(buffer) : nullptr;
+    m_address = address;
+    m_records = records;
+    return true;
+  }
+
+  void threadStarted() override
+  {
+    JNIEnv *env;
+    JavaVMAttachArgs lJavaVMAttachArgs;
+    lJavaVMAttachArgs.version = JNI_VERSION_1_6;
+    lJavaVMAttachArgs.name = "ShareDelivery";
+    lJavaVMAttachArgs.group = NULL;
+    if (javaVm->AttachCurrentThread(&env, &lJavaVMAttachArgs) == JNI_ERR)
+    {
+      return;
+    }
+    m_env = env;
+    m_callback.reset(new CallbackVoidIntStringStringString(env, className, methodName));
+    m_exhaustedCallback.reset(new CallbackVoidIntString(env, className, exhaustedMethodName));
+    m_sharesReadyCallback.reset(new CallbackVoidInt(env, className, sharesReadyMethodName));
+  }
+
+  void threadStopped() override
+  {
+    if (m_env != nullptr)
+    {
+      m_callback.reset();
+      m_exhaustedCallback.reset();
+      m_sharesReadyCallback.reset();
+      m_env = nullptr;
+      javaVm->DetachCurrentThread();
+    }
+  }
+
+  void deliver(const Share *shares, size_t count) override
+  {
+    if (!m_callback || m_env->PushLocalFrame(3 * count) != JNI_OK)
+    {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(m_bufferMutex);
+
+    size_t records = 0;
+    for (size_t index = 0; index < count; ++index)
+    {
+      if (shares[index].exhausted)
+      {
+        m_exhaustedCallback->invoke(shares[index].slot, shares[index].jobId());
+        continue;
+      }
+      if (m_address != nullptr)
+      {
+        ShareRecord::write(shares[index], m_address + records * ShareRecord::Size);
+        if (++records == m_records)
+        {
+          m_sharesReadyCallback->invoke(static_cast<int>(records));
+          records = 0;
+        }
+        continue;
+      }
+      Job::Nonce nonce = shares[index].nonce;
+      m_callback->invoke(
+        shares[index].slot,
+        shares[index].jobId(),
+        bufferToHex(&shares[index].hash[0], shares[index].hash.size()),
+        bufferToHex(reinterpret_cast<uint8_t *>(&nonce), sizeof(nonce)));
+    }
+    if (records != 0)
+    {
+      m_sharesReadyCallback->invoke(static_cast<int>(records));
+    }
+    m_env->PopLocalFrame(nullptr);
+  }
+
+private:
+  JNIEnv *m_env;
+  std::unique_ptr<CallbackVoidIntStringStringString> m_callback;
+  std::unique_ptr<CallbackVoidIntString> m_exhaustedCallback;
+  std::unique_ptr<CallbackVoidInt> m_sharesReadyCallback;
+
+  // Java may swap the buffer while the delivery thread writes into it
+  std::mutex m_bufferMutex;
+  jobject m_buffer;
+  uint8_t *m_address;
+  size_t m_records;
+};
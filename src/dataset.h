@@ -0,0 +1,121 @@
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <randomx.h>
+
+#include "cache.h"
+#include "pages.h"
+
+class Dataset
+{
+public:
+  static uint64_t size()
+  {
+    return static_cast<uint64_t>(randomx_dataset_item_count()) * RANDOMX_DATASET_ITEM_SIZE;
+  }
+
+  // With RANDOMX_FLAG_LARGE_PAGES explicit huge pages are tried first, then transparent ones
+  Dataset(randomx_flags flags, const Cache &cache, size_t threads)
+    : m_seedHash(cache.seedHash())
+    , m_pages(Pages::Regular)
+  {
+    m_dataset = randomx_alloc_dataset(flags);
+    if (m_dataset != nullptr && (flags & RANDOMX_FLAG_LARGE_PAGES))
+    {
+      m_pages = Pages::Huge;
+    }
+    else if (flags & RANDOMX_FLAG_LARGE_PAGES)
+    {
+      m_dataset = randomx_alloc_dataset(static_cast<randomx_flags>(flags & ~RANDOMX_FLAG_LARGE_PAGES));
+      if (m_dataset != nullptr && Pages::advise(randomx_get_dataset_memory(m_dataset), size()))
+      {
+        m_pages = Pages::Transparent;
+      }
+    }
+    if (m_dataset == nullptr)
+    {
+      throw std::runtime_error("failed to allocate RandomX dataset");
+    }
+
+    // Items are independent of each other, so disjoint ranges can be filled concurrently
+    const unsigned long itemCount = randomx_dataset_item_count();
+    threads = std::max<size_t>(1, std::min<size_t>(threads, itemCount));
+    const unsigned long perThread = itemCount / threads;
+
+    std::vector<std::thread> workers;
+    for (size_t index = 0; index < threads; ++index)
+    {
+      const unsigned long startItem = index * perThread;
+      const unsigned long count = index + 1 == threads ? itemCount - startItem : perThread;
+      workers.emplace_back([this, &cache, startItem, count]() {
+        randomx_init_dataset(m_dataset, cache.get(), startItem, count);
+      });
+    }
+    for (auto &worker : workers)
+    {
+      worker.join();
+    }
+  }
+
+  ~Dataset()
+  {
+    randomx_release_dataset(m_dataset);
+  }
+
+  Dataset(const Dataset &) = delete;
+  Dataset &operator=(const Dataset &) = delete;
+
+  randomx_dataset *get() const
+  {
+    return m_dataset;
+  }
+
+  Pages::Kind pages() const
+  {
+    return m_pages;
+  }
+
+  bool seedEqual(const Cache::SeedHash &seedHash) const
+  {
+    return m_seedHash == seedHash;
+  }
+
+private:
+  randomx_dataset *m_dataset;
+  const Cache::SeedHash m_seedHash;
+  Pages::Kind m_pages;
+};
@@ -0,0 +1,228 @@
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "shares.h"
+#include "trace.h"
+
+class ShareSink
+{
+public:
+  virtual ~ShareSink()
+  {
+  }
+
+  // Called on the delivery thread before the first and after the last batch
+  virtual void threadStarted()
+  {
+  }
+
+  virtual void threadStopped()
+  {
+  }
+
+  virtual void deliver(const Share *shares, size_t count) = 0;
+};
+
+// Hands the shares of slots with a sink of their own to it and everything else to the default sink. Only the
+// default sink sees the delivery thread start and stop.
+class SlotRouter : public ShareSink
+{
+public:
+  explicit SlotRouter(ShareSink &sink)
+    : m_sink(sink)
+  {
+  }
+
+  // nullptr routes the slot back to the default sink. Once this returns the previous sink gets no more shares.
+  void setSink(uint32_t slot, ShareSink *sink)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_sinks.size() <= slot)
+    {
+      m_sinks.resize(slot + 1, nullptr);
+    }
+    m_sinks[slot] = sink;
+  }
+
+  void threadStarted() override
+  {
+    m_sink.threadStarted();
+  }
+
+  void threadStopped() override
+  {
+    m_sink.threadStopped();
+  }
+
+  // Consecutive shares going to the same sink stay one batch
+  void deliver(const Share *shares, size_t count) override
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    size_t begin = 0;
+    while (begin < count)
+    {
+      ShareSink &sink = route(shares[begin].slot);
+      size_t end = begin + 1;
+      while (end < count && &route(shares[end].slot) == &sink)
+      {
+        ++end;
+      }
+      sink.deliver(&shares[begin], end - begin);
+      begin = end;
+    }
+  }
+
+private:
+  ShareSink &route(uint32_t slot) const
+  {
+    return slot < m_sinks.size() && m_sinks[slot] != nullptr ? *m_sinks[slot] : m_sink;
+  }
+
+private:
+  ShareSink &m_sink;
+  // Held while delivering, so a sink can't go away in the middle of a batch
+  std::mutex m_mutex;
+  std::vector<ShareSink *> m_sinks;
+};
+
+// Drains found shares on a dedicated thread and hands them to the sink in batches, so hashers never block on it
+class ShareDelivery
+{
+  static constexpr const size_t MaxBatch = 16;
+
+public:
+  ShareDelivery(ShareQueue &queue, ShareSink &sink)
+    : m_queue(queue)
+    , m_sink(sink)
+    , m_delivered(0)
+    , m_sinkReady(false)
+  {
+    m_canRun.test_and_set();
+    m_thread = std::thread([this]() {
+      Trace::attach("share delivery");
+
+      try
+      {
+        // A sink that fails to set up, say a missing Java class, gets no shares. The queue is still drained so
+        // the hashers don't fill it up.
+        m_sink.threadStarted();
+        m_sinkReady = true;
+      }
+      catch (...)
+      {
+      }
+
+      try
+      {
+        thread();
+      }
+      catch (...)
+      {
+      }
+
+      m_sink.threadStopped();
+    });
+  }
+
+  // Delivers whatever is still queued before returning
+  ~ShareDelivery()
+  {
+    m_canRun.clear();
+    m_queue.notify();
+
+    try
+    {
+      m_thread.join();
+    }
+    catch (...)
+    {
+    }
+  }
+
+  uint64_t delivered() const
+  {
+    return m_delivered;
+  }
+
+private:
+  void thread()
+  {
+    std::array<Share, MaxBatch> batch;
+    bool canRun = true;
+    while (canRun)
+    {
+      canRun = m_canRun.test_and_set();
+
+      size_t count = 0;
+      do
+      {
+        count = 0;
+        while (count < batch.size() && m_queue.pop(&batch[count]))
+        {
+          ++count;
+        }
+        if (count != 0 && m_sinkReady)
+        {
+          Trace::Scope trace(Trace::Deliver);
+          m_sink.deliver(&batch[0], count);
+          m_delivered.fetch_add(count, std::memory_order_relaxed);
+        }
+        for (size_t index = 0; index < count; ++index)
+        {
+          batch[index].cache.reset();
+        }
+      } while (count == batch.size());
+
+      if (canRun)
+      {
+        m_queue.wait(std::chrono::milliseconds(100));
+      }
+    }
+  }
+
+private:
+  ShareQueue &m_queue;
+  ShareSink &m_sink;
+  std::atomic<uint64_t> m_delivered;
+  // Delivery thread only
+  bool m_sinkReady;
+  std::atomic_flag m_canRun;
+  std::thread m_thread;
+};
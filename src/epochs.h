@@ -0,0 +1,305 @@
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <randomx.h>
+
+#include "cache.h"
+#include "cachestore.h"
+#include "calibration.h"
+#include "dataset.h"
+#include "trace.h"
+#include "utils.h"
+
+struct Epoch
+{
+  std::shared_ptr<const Cache> cache;
+  std::shared_ptr<const Dataset> dataset;
+  bool fastMode;
+};
+
+// Builds RandomX caches (and datasets in fast mode) on a background thread so hashers keep running on the
+// current seed until the next one is ready. The two most recently built epochs are kept, which lets late
+// jobs on the previous seed switch back without a rebuild, along with any older one still in use by a job slot.
+class Epochs
+{
+  static constexpr const size_t MaxEpochs = 2;
+  // Headroom left for the app and the OS on top of the dataset before fast mode is attempted
+  static constexpr const uint64_t FastModeReserve = 256 * 1024 * 1024;
+
+public:
+  typedef std::function<void()> ReadyCallback;
+
+  // Epochs are built with the flags the calibration picks
+  Epochs(Calibration &calibration, ReadyCallback onReady)
+    : m_calibration(calibration)
+    , m_onReady(std::move(onReady))
+    , m_hugePages(false)
+    , m_building(false)
+    , m_generation(0)
+    , m_stop(false)
+  {
+  }
+
+  ~Epochs()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_wakeUp.notify_all();
+
+    if (m_worker.joinable())
+    {
+      m_worker.join();
+    }
+  }
+
+  bool find(const Cache::SeedHash &seedHash, bool fastMode, Epoch *epoch)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (const auto &ready : m_ready)
+    {
+      if (ready.fastMode == fastMode && ready.cache->seedEqual(seedHash))
+      {
+        *epoch = ready;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Schedules a build unless the epoch is already available, a newer request replaces a queued one
+  void prepare(const Cache::SeedHash &seedHash, bool fastMode)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (const auto &ready : m_ready)
+    {
+      if (ready.fastMode == fastMode && ready.cache->seedEqual(seedHash))
+      {
+        return;
+      }
+    }
+    if (m_building && m_buildingFastMode == fastMode && m_buildingSeed == seedHash)
+    {
+      m_requested.reset();
+      return;
+    }
+
+    m_requested.reset(new std::pair<Cache::SeedHash, bool>(seedHash, fastMode));
+    if (!m_worker.joinable())
+    {
+      m_worker = std::thread([this]() {
+        worker();
+      });
+    }
+    m_wakeUp.notify_all();
+  }
+
+  // Applies to epochs built from now on, explicit huge pages are tried first, then transparent ones
+  void setHugePages(bool enabled)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_hugePages = enabled;
+  }
+
+  // Caches built from now on are looked up in and saved to the store, nullptr disables it
+  void setStore(std::shared_ptr<const CacheStore> store)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_store = std::move(store);
+  }
+
+  // Drops every epoch and discards the build in progress, memory is released once hashers let go of it
+  void clear()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    ++m_generation;
+    m_ready.clear();
+    m_requested.reset();
+  }
+
+private:
+  void worker()
+  {
+    Trace::attach("epochs");
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+      m_wakeUp.wait(lock, [this]() {
+        return m_stop || m_requested;
+      });
+      if (m_stop)
+      {
+        return;
+      }
+
+      m_buildingSeed = m_requested->first;
+      m_buildingFastMode = m_requested->second;
+      m_requested.reset();
+      m_building = true;
+      const size_t generation = m_generation;
+      const bool hugePages = m_hugePages;
+      const std::shared_ptr<const CacheStore> store = m_store;
+      if (m_buildingFastMode)
+      {
+        // Two datasets rarely fit in memory, keep only the newest one around while building
+        while (m_ready.size() > 1)
+        {
+          m_ready.pop_front();
+        }
+      }
+
+      lock.unlock();
+      // The first build runs the calibration trials on its own cache, or loads their result from disk
+      const randomx_flags pages = hugePages ? RANDOMX_FLAG_LARGE_PAGES : RANDOMX_FLAG_DEFAULT;
+      std::shared_ptr<const Cache> trialCache;
+      randomx_flags flags;
+      {
+        Trace::Scope trace(Trace::Calibrate);
+        flags = static_cast<randomx_flags>(m_calibration.flags([&](randomx_flags cacheFlags) {
+          Trace::Scope trace(Trace::CacheInit);
+          trialCache =
+            std::make_shared<const Cache>(static_cast<randomx_flags>(cacheFlags | pages), m_buildingSeed, store.get());
+          return trialCache;
+        }) | pages);
+      }
+      if (trialCache && trialCache->flags() != flags)
+      {
+        trialCache.reset();
+      }
+      Epoch epoch = build(flags, m_buildingSeed, m_buildingFastMode, store.get(), std::move(trialCache));
+      lock.lock();
+
+      m_building = false;
+      if (generation != m_generation || !epoch.cache)
+      {
+        continue;
+      }
+      const std::shared_ptr<const Cache> cache = epoch.cache;
+      m_ready.push_back(std::move(epoch));
+      evict();
+
+      lock.unlock();
+      m_onReady();
+      // Hashers already run on the cache, storing it only delays the next build
+      if (store && !cache->stored())
+      {
+        store->save(cache->get(), cache->seedHash());
+      }
+      lock.lock();
+    }
+  }
+
+  // Drops the oldest epochs beyond MaxEpochs, skipping the ones a job slot still hashes on. Their memory stays
+  // allocated either way, forgetting them would only force a rebuild for the next job on that seed.
+  void evict()
+  {
+    for (auto it = m_ready.begin(); m_ready.size() > MaxEpochs && it != m_ready.end();)
+    {
+      if (it->cache.use_count() > 1)
+      {
+        ++it;
+        continue;
+      }
+      it = m_ready.erase(it);
+    }
+  }
+
+  // A cache passed in is used as is, it has to be built with flags
+  static Epoch build(
+    randomx_flags flags,
+    const Cache::SeedHash &seedHash,
+    bool fastMode,
+    const CacheStore *store,
+    std::shared_ptr<const Cache> cache = nullptr)
+  {
+    Epoch epoch;
+    epoch.fastMode = fastMode;
+    epoch.cache = std::move(cache);
+    try
+    {
+      if (!epoch.cache)
+      {
+        Trace::Scope trace(Trace::CacheInit);
+        epoch.cache = std::make_shared<const Cache>(flags, seedHash, store);
+      }
+    }
+    catch (const std::exception &)
+    {
+      return epoch;
+    }
+
+    if (fastMode && availableMemory() >= Dataset::size() + FastModeReserve)
+    {
+      try
+      {
+        Trace::Scope trace(Trace::DatasetInit);
+        epoch.dataset = std::make_shared<const Dataset>(flags, *epoch.cache, std::thread::hardware_concurrency());
+      }
+      catch (const std::exception &)
+      {
+      }
+    }
+    return epoch;
+  }
+
+private:
+  Calibration &m_calibration;
+  const ReadyCallback m_onReady;
+
+  std::mutex m_mutex;
+  std::condition_variable m_wakeUp;
+  std::deque<Epoch> m_ready;
+  std::unique_ptr<std::pair<Cache::SeedHash, bool>> m_requested;
+  bool m_hugePages;
+  std::shared_ptr<const CacheStore> m_store;
+  Cache::SeedHash m_buildingSeed;
+  bool m_buildingFastMode;
+  bool m_building;
+  size_t m_generation;
+  bool m_stop;
+
+  std::thread m_worker;
+};
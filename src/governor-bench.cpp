@@ -0,0 +1,349 @@
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "governor.h"
+
+namespace
+{
+  // A phone-like SoC: static power for every busy core whatever its clock, dynamic power growing with the square
+  // of the clock, a single lumped heat capacity and a kernel that drops to the lowest clock at the trip point and
+  // only climbs back slowly once well below it
+  class Device
+  {
+  public:
+    static constexpr const double StepSeconds = 0.1;
+    static constexpr const double IdleWatts = 0.4;
+    static constexpr const double StaticWatts = 0.45;
+    static constexpr const double DynamicWatts = 0.75;
+    // Degrees per watt at steady state and seconds to get there
+    static constexpr const double Resistance = 8;
+    static constexpr const double TimeConstant = 40;
+    static constexpr const double TripTemperature = 75;
+    static constexpr const double Hysteresis = 1;
+    static constexpr const double MinFrequency = 0.3;
+    static constexpr const double ThreadHashrate = 100;
+    static constexpr const double MaxFrequencyKhz = 2000000;
+
+    Device(size_t cores, double ambient)
+      : m_cores(cores)
+      , m_ambient(ambient)
+      , m_temperature(ambient)
+      , m_frequency(1)
+      , m_power(IdleWatts)
+      , m_hashes(0)
+    {
+    }
+
+    void run(double budget, double seconds)
+    {
+      for (double elapsed = 0; elapsed < seconds; elapsed += StepSeconds)
+      {
+        m_power = IdleWatts + budget * (StaticWatts + DynamicWatts * m_frequency * m_frequency);
+        m_temperature += (m_ambient + Resistance * m_power - m_temperature) * StepSeconds / TimeConstant;
+        if (m_temperature > TripTemperature)
+        {
+          m_frequency = MinFrequency;
+        }
+        else if (m_temperature < TripTemperature - Hysteresis)
+        {
+          m_frequency = std::min(1.0, m_frequency + 0.005);
+        }
+        m_hashes += budget * m_frequency * ThreadHashrate * StepSeconds;
+      }
+    }
+
+    // Writes the state the way the kernel exposes it
+    void write(const std::string &root) const
+    {
+      put(root + "/class/thermal/thermal_zone0/temp", std::to_string(std::lround(m_temperature * 1000)));
+      for (size_t cpu = 0; cpu < m_cores; ++cpu)
+      {
+        put(
+          root + "/devices/system/cpu/cpu" + std::to_string(cpu) + "/cpufreq/scaling_cur_freq",
+          std::to_string(std::lround(m_frequency * MaxFrequencyKhz)));
+      }
+      // Discharging current is negative on most drivers
+      put(root + "/class/power_supply/battery/current_now", std::to_string(-std::lround(m_power / 3.9 * 1e6)));
+    }
+
+    void create(const std::string &root) const
+    {
+      for (const char *directory : {"/class", "/class/thermal", "/class/thermal/thermal_zone0",
+                                    "/class/thermal/thermal_zone1", "/class/power_supply",
+                                    "/class/power_supply/battery", "/devices", "/devices/system",
+                                    "/devices/system/cpu"})
+      {
+        mkdir((root + directory).c_str(), 0755);
+      }
+      put(root + "/class/thermal/thermal_zone0/type", "cpu-thermal");
+      // Cooler and slower, only read if there were no cpu zone
+      put(root + "/class/thermal/thermal_zone1/type", "battery");
+      put(root + "/class/thermal/thermal_zone1/temp", "35000");
+      put(root + "/class/power_supply/battery/type", "Battery");
+      put(root + "/class/power_supply/battery/status", "Discharging");
+      put(root + "/class/power_supply/battery/voltage_now", "3900000");
+      for (size_t cpu = 0; cpu < m_cores; ++cpu)
+      {
+        const std::string path = root + "/devices/system/cpu/cpu" + std::to_string(cpu);
+        mkdir(path.c_str(), 0755);
+        mkdir((path + "/cpufreq").c_str(), 0755);
+        put(path + "/cpufreq/cpuinfo_max_freq", std::to_string(std::lround(MaxFrequencyKhz)));
+      }
+      write(root);
+    }
+
+    double temperature() const
+    {
+      return m_temperature;
+    }
+
+    double power() const
+    {
+      return m_power;
+    }
+
+    uint64_t hashes() const
+    {
+      return static_cast<uint64_t>(m_hashes);
+    }
+
+  private:
+    static void put(const std::string &path, const std::string &value)
+    {
+      std::ofstream(path) << value << "\n";
+    }
+
+  private:
+    const size_t m_cores;
+    const double m_ambient;
+    double m_temperature;
+    double m_frequency;
+    double m_power;
+    double m_hashes;
+  };
+
+  struct Result
+  {
+    // Over the second half of the run, once the device is warm
+    double hashrate;
+    double hashesPerJoule;
+    double maxTemperature;
+    double secondsOverCeiling;
+    double budget;
+    uint64_t overheats;
+    uint64_t collapses;
+    std::vector<GovernorPoint> points;
+  };
+
+  // governed false keeps every core at full load, like the miner without a governor
+  Result simulate(
+    size_t cores,
+    double ambient,
+    double ceiling,
+    double powerLimit,
+    double minutes,
+    bool governed,
+    const std::string &root)
+  {
+    Device device(cores, ambient);
+    device.create(root);
+    const Thermal thermal(root);
+    GovernorPolicy policy(cores, ceiling, powerLimit);
+
+    Result result{0, 0, ambient, 0, 0, 0, 0, {}};
+    const int64_t endMs = static_cast<int64_t>(minutes * 60 * 1000);
+    uint64_t halfHashes = 0;
+    double joules = 0;
+    double budget = governed ? policy.budget() : cores;
+    for (int64_t nowMs = 0; nowMs < endMs; nowMs += Governor::IntervalMs)
+    {
+      device.run(budget, Governor::IntervalMs / 1000.0);
+      device.write(root);
+      if (nowMs < endMs / 2)
+      {
+        halfHashes = device.hashes();
+      }
+      else
+      {
+        joules += device.power() * Governor::IntervalMs / 1000.0;
+        result.maxTemperature = std::max(result.maxTemperature, device.temperature());
+        result.secondsOverCeiling += device.temperature() > ceiling ? Governor::IntervalMs / 1000.0 : 0;
+      }
+      if (governed)
+      {
+        budget = policy.update(nowMs, thermal.sample(), device.hashes());
+      }
+    }
+
+    result.hashrate = (device.hashes() - halfHashes) / (minutes * 30);
+    result.hashesPerJoule = joules > 0 ? (device.hashes() - halfHashes) / joules : 0;
+    result.budget = budget;
+    result.overheats = policy.overheats();
+    result.collapses = policy.collapses();
+    result.points = policy.points();
+    return result;
+  }
+
+  void print(const char *name, const Result &result, bool curve)
+  {
+    std::printf(
+      "%s: %.0f H/s, %.1f H/J, max %.1f C, %.0f s over the ceiling, budget %.1f threads, %llu overheats, "
+      "%llu collapses\n",
+      name,
+      result.hashrate,
+      result.hashesPerJoule,
+      result.maxTemperature,
+      result.secondsOverCeiling,
+      result.budget,
+      static_cast<unsigned long long>(result.overheats),
+      static_cast<unsigned long long>(result.collapses));
+    for (const GovernorPoint &point : result.points)
+    {
+      if (curve && point.samples != 0)
+      {
+        std::printf(
+          "  %4.1f threads: %6.0f H/s, %5.1f C, %5.2f W, %6.1f H/J, %llu samples\n",
+          point.budget,
+          point.hashrate,
+          point.temperature,
+          point.power,
+          point.power > 0 ? point.hashrate / point.power : 0,
+          static_cast<unsigned long long>(point.samples));
+      }
+    }
+  }
+
+  void removeTree(const std::string &root, size_t cores)
+  {
+    for (size_t cpu = 0; cpu < cores; ++cpu)
+    {
+      const std::string path = root + "/devices/system/cpu/cpu" + std::to_string(cpu);
+      unlink((path + "/cpufreq/cpuinfo_max_freq").c_str());
+      unlink((path + "/cpufreq/scaling_cur_freq").c_str());
+      rmdir((path + "/cpufreq").c_str());
+      rmdir(path.c_str());
+    }
+    for (const char *file : {"/class/thermal/thermal_zone0/type", "/class/thermal/thermal_zone0/temp",
+                             "/class/thermal/thermal_zone1/type", "/class/thermal/thermal_zone1/temp",
+                             "/class/power_supply/battery/type", "/class/power_supply/battery/status",
+                             "/class/power_supply/battery/voltage_now", "/class/power_supply/battery/current_now"})
+    {
+      unlink((root + file).c_str());
+    }
+    for (const char *directory : {"/devices/system/cpu", "/devices/system", "/devices", "/class/power_supply/battery",
+                                  "/class/power_supply", "/class/thermal/thermal_zone1",
+                                  "/class/thermal/thermal_zone0", "/class/thermal", "/class", ""})
+    {
+      rmdir((root + directory).c_str());
+    }
+  }
+
+  void usage(const char *name)
+  {
+    std::fprintf(
+      stderr,
+      "usage: %s [--cores N] [--minutes M] [--ambient C] [--ceiling C] [--power-limit W]\n",
+      name);
+  }
+} // namespace
+
+// Runs the governor policy against a simulated device through a fake sysfs tree, in simulated time, and compares
+// it with full load. The device throttles itself at 75 C, a ceiling above that leaves the governor to find the
+// level the throttling hurts least.
+int main(int argc, char *argv[])
+{
+  size_t cores = 8;
+  double minutes = 60;
+  double ambient = 25;
+  double ceiling = 65;
+  double powerLimit = 0;
+
+  for (int index = 1; index < argc; ++index)
+  {
+    const std::string arg = argv[index];
+    const bool hasValue = index + 1 < argc;
+    if (arg == "--cores" && hasValue)
+    {
+      cores = std::strtoul(argv[++index], nullptr, 10);
+    }
+    else if (arg == "--minutes" && hasValue)
+    {
+      minutes = std::strtod(argv[++index], nullptr);
+    }
+    else if (arg == "--ambient" && hasValue)
+    {
+      ambient = std::strtod(argv[++index], nullptr);
+    }
+    else if (arg == "--ceiling" && hasValue)
+    {
+      ceiling = std::strtod(argv[++index], nullptr);
+    }
+    else if (arg == "--power-limit" && hasValue)
+    {
+      powerLimit = std::strtod(argv[++index], nullptr);
+    }
+    else
+    {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (cores == 0 || minutes <= 0)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  char root[] = "/tmp/governor-bench-XXXXXX";
+  if (mkdtemp(root) == nullptr)
+  {
+    std::perror("mkdtemp");
+    return 1;
+  }
+
+  print("full load", simulate(cores, ambient, ceiling, powerLimit, minutes, false, root), false);
+  print("governed", simulate(cores, ambient, ceiling, powerLimit, minutes, true, root), true);
+  // Only the kernel's throttling in the way
+  print("governed, ceiling 90 C", simulate(cores, ambient, 90, powerLimit, minutes, true, root), true);
+  removeTree(root, cores);
+  return 0;
+}
@@ -0,0 +1,248 @@
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "governor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+
+namespace
+{
+  int64_t nowMs()
+  {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+  }
+} // namespace
+
+GovernorPolicy::GovernorPolicy(size_t maxThreads, double ceiling, double powerLimit)
+  : m_ceiling(ceiling)
+  , m_powerLimit(powerLimit)
+  , m_changedMs(0)
+  , m_lastMs(-1)
+  , m_lastHashes(0)
+  , m_hashrate(0)
+  , m_overheats(0)
+  , m_collapses(0)
+{
+  const size_t levels = std::max<size_t>(1, maxThreads) * static_cast<size_t>(1 / Step);
+  for (size_t level = 0; level < levels; ++level)
+  {
+    m_points.push_back({(level + 1) * Step, 0, 0, 0, 0});
+  }
+  m_levels.resize(levels, {0, 0});
+  m_level = levels - 1;
+}
+
+double GovernorPolicy::update(int64_t nowMs, const ThermalSample &sample, uint64_t hashes)
+{
+  if (m_lastMs < 0)
+  {
+    m_changedMs = nowMs;
+  }
+  else if (nowMs > m_lastMs && hashes >= m_lastHashes)
+  {
+    m_hashrate = (hashes - m_lastHashes) * 1000.0 / (nowMs - m_lastMs);
+  }
+  const bool settled = m_lastMs >= 0 && nowMs - m_changedMs >= SettleMs;
+  m_lastMs = nowMs;
+  m_lastHashes = hashes;
+
+  GovernorPoint &point = m_points[m_level];
+  if (settled)
+  {
+    // Stale knowledge is dropped rather than averaged in
+    if (nowMs - m_levels[m_level].updatedMs >= BanMs)
+    {
+      point.samples = 0;
+    }
+    const double weight = point.samples == 0 ? 1 : Smoothing;
+    point.hashrate += weight * (m_hashrate - point.hashrate);
+    point.temperature += weight * ((sample.temperatureKnown ? sample.temperature : 0) - point.temperature);
+    point.power += weight * (sample.power - point.power);
+    ++point.samples;
+    m_levels[m_level].updatedMs = nowMs;
+  }
+
+  const bool hot = sample.temperatureKnown && sample.temperature >= m_ceiling;
+  if (hot || (m_powerLimit > 0 && sample.power > m_powerLimit))
+  {
+    // Further over the ceiling takes bigger steps, the temperature lags the load
+    const size_t steps = hot ? 1 + static_cast<size_t>((sample.temperature - m_ceiling) / Margin) : 1;
+    ++m_overheats;
+    moveTo(m_level - std::min(m_level, steps), nowMs, true);
+    return budget();
+  }
+
+  const bool throttled = sample.frequency < Throttled;
+  if (settled && point.samples >= MinSamples)
+  {
+    size_t best = m_level;
+    for (size_t level = 0; level < m_level; ++level)
+    {
+      if (learned(level, nowMs) && m_levels[level].bannedUntilMs <= nowMs &&
+          m_points[level].hashrate > m_points[best].hashrate * (best == m_level ? 1 + Gain : 1))
+      {
+        best = level;
+      }
+    }
+    if (best != m_level)
+    {
+      ++m_collapses;
+      moveTo(best, nowMs, true);
+      return budget();
+    }
+    // The clocks came down, the level below is measured to see whether the extra load still pays
+    if (throttled && m_level > 0 && !learned(m_level - 1, nowMs))
+    {
+      moveTo(m_level - 1, nowMs, false);
+      return budget();
+    }
+  }
+
+  const size_t next = m_level + 1;
+  const bool headroom = !throttled && (!sample.temperatureKnown || sample.temperature < m_ceiling - Margin) &&
+                        (m_powerLimit <= 0 || sample.power < m_powerLimit * (1 - Gain));
+  if (headroom && nowMs - m_changedMs >= HoldMs && next < m_points.size() && m_levels[next].bannedUntilMs <= nowMs &&
+      !(learned(next, nowMs) && point.samples >= MinSamples && m_points[next].hashrate <= point.hashrate))
+  {
+    moveTo(next, nowMs, false);
+  }
+  return budget();
+}
+
+size_t GovernorPolicy::threads(double budget)
+{
+  return std::max<size_t>(1, static_cast<size_t>(std::ceil(budget - 1e-9)));
+}
+
+void GovernorPolicy::moveTo(size_t level, int64_t nowMs, bool ban)
+{
+  if (level == m_level)
+  {
+    return;
+  }
+  if (ban)
+  {
+    m_levels[m_level].bannedUntilMs = nowMs + BanMs;
+  }
+  m_level = level;
+  m_changedMs = nowMs;
+}
+
+bool GovernorPolicy::learned(size_t level, int64_t nowMs) const
+{
+  return m_points[level].samples >= MinSamples && nowMs - m_levels[level].updatedMs < BanMs;
+}
+
+Governor::Governor(Miner &miner, double ceiling, double powerLimit, const std::string &root, int64_t intervalMs)
+  : m_miner(miner)
+  , m_thermal(root)
+  , m_intervalMs(intervalMs)
+  , m_previousThreads(miner.threads())
+  , m_previousLoad(miner.cpuLoad())
+  , m_stopping(false)
+  , m_policy(m_previousThreads, ceiling, powerLimit)
+  , m_sample{false, 0, 1, 0}
+{
+  if (!m_thermal.available())
+  {
+    throw std::runtime_error("no thermal zones or cpufreq under " + root);
+  }
+  apply(m_policy.budget());
+  m_thread = std::thread([this]() {
+    thread();
+  });
+}
+
+Governor::~Governor()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_wakeUp.notify_all();
+  m_thread.join();
+  m_miner.setThreads(m_previousThreads);
+  m_miner.setCpuLoad(m_previousLoad);
+}
+
+GovernorStats Governor::stats() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  const double budget = m_policy.budget();
+  return {
+    m_sample,
+    budget,
+    GovernorPolicy::threads(budget),
+    m_policy.hashrate(),
+    m_policy.overheats(),
+    m_policy.collapses(),
+    m_policy.points(),
+  };
+}
+
+void Governor::thread()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (!m_wakeUp.wait_for(lock, std::chrono::milliseconds(m_intervalMs), [this]() {
+    return m_stopping;
+  }))
+  {
+    lock.unlock();
+    const ThermalSample sample = m_thermal.sample();
+    uint64_t hashes = 0;
+    for (const uint64_t threadHashes : m_miner.threadHashes())
+    {
+      hashes += threadHashes;
+    }
+    lock.lock();
+
+    m_sample = sample;
+    const double previous = m_policy.budget();
+    const double budget = m_policy.update(nowMs(), sample, hashes);
+    if (budget != previous)
+    {
+      lock.unlock();
+      apply(budget);
+      lock.lock();
+    }
+  }
+}
+
+void Governor::apply(double budget)
+{
+  // The budget is in threads, the load in fractions of the whole CPU like setCpuLoad expects
+  m_miner.setThreads(GovernorPolicy::threads(budget));
+  m_miner.setCpuLoad(budget / std::max(std::thread::hardware_concurrency(), 1u));
+}
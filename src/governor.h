@@ -0,0 +1,190 @@
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "miner.h"
+#include "thermal.h"
+
+// What the governor learned about one load level
+struct GovernorPoint
+{
+  // Load in whole hashing threads
+  double budget;
+  uint64_t samples;
+  double hashrate;
+  // Degrees Celsius and watts the level settled at, 0 if unknown
+  double temperature;
+  double power;
+};
+
+struct GovernorStats
+{
+  ThermalSample sample;
+  double budget;
+  size_t threads;
+  double hashrate;
+  // Levels left because they ran over the temperature ceiling or the power limit
+  uint64_t overheats;
+  // Levels left because a lower one hashed faster, the clocks were throttled
+  uint64_t collapses;
+  std::vector<GovernorPoint> points;
+};
+
+// Closed loop search for the load with the highest sustained hashrate under a temperature ceiling. Load moves in
+// half thread steps: down when the ceiling or the power limit is hit, to the best lower level when that hashed
+// faster than the current one, one step down to measure it when the clocks are throttled, and one step up after a
+// hold while there is headroom and the level above isn't known to be slower. Levels that were left are banned and
+// measurements expire after a while, as the ambient temperature and the charger come and go.
+class GovernorPolicy
+{
+public:
+  static constexpr const double Step = 0.5;
+  // Headroom below the ceiling needed to step up
+  static constexpr const double Margin = 3;
+  // Hashrate right after a change still has the previous level in it
+  static constexpr const int64_t SettleMs = 5 * 1000;
+  // Time at a level before stepping up, temperatures take this long to get near their steady state
+  static constexpr const int64_t HoldMs = 30 * 1000;
+  static constexpr const int64_t BanMs = 5 * 60 * 1000;
+  static constexpr const uint64_t MinSamples = 3;
+  // A lower level has to beat the current one by this much to count as a collapse
+  static constexpr const double Gain = 0.03;
+  // Average clock as a fraction of the maximum below which the kernel is taken to be throttling
+  static constexpr const double Throttled = 0.9;
+  static constexpr const double Smoothing = 0.25;
+
+  // powerLimit 0 leaves power unconstrained. Starts at full load.
+  GovernorPolicy(size_t maxThreads, double ceiling, double powerLimit);
+
+  // Feeds a sample taken at nowMs with the miner's total hash count, returns the budget to apply
+  double update(int64_t nowMs, const ThermalSample &sample, uint64_t hashes);
+
+  double budget() const
+  {
+    return m_points[m_level].budget;
+  }
+
+  double hashrate() const
+  {
+    return m_hashrate;
+  }
+
+  uint64_t overheats() const
+  {
+    return m_overheats;
+  }
+
+  uint64_t collapses() const
+  {
+    return m_collapses;
+  }
+
+  const std::vector<GovernorPoint> &points() const
+  {
+    return m_points;
+  }
+
+  // Fewest threads that can run a budget, each at the same duty
+  static size_t threads(double budget);
+
+private:
+  struct Level
+  {
+    int64_t bannedUntilMs;
+    int64_t updatedMs;
+  };
+
+  void moveTo(size_t level, int64_t nowMs, bool ban);
+  // Measured recently enough to still describe the device
+  bool learned(size_t level, int64_t nowMs) const;
+
+private:
+  const double m_ceiling;
+  const double m_powerLimit;
+  std::vector<GovernorPoint> m_points;
+  std::vector<Level> m_levels;
+  size_t m_level;
+  int64_t m_changedMs;
+  int64_t m_lastMs;
+  uint64_t m_lastHashes;
+  double m_hashrate;
+  uint64_t m_overheats;
+  uint64_t m_collapses;
+};
+
+// Runs the policy against the sysfs sensors, owning the miner's thread count and CPU load until destroyed
+class Governor
+{
+public:
+  static constexpr const int64_t IntervalMs = 2000;
+
+  // Throws if root has neither thermal zones nor cpufreq
+  Governor(
+    Miner &miner,
+    double ceiling,
+    double powerLimit = 0,
+    const std::string &root = "/sys",
+    int64_t intervalMs = IntervalMs);
+  // Puts back the thread count and load from before
+  ~Governor();
+
+  Governor(const Governor &) = delete;
+  Governor &operator=(const Governor &) = delete;
+
+  GovernorStats stats() const;
+
+private:
+  void thread();
+  void apply(double budget);
+
+private:
+  Miner &m_miner;
+  const Thermal m_thermal;
+  const int64_t m_intervalMs;
+  const size_t m_previousThreads;
+  const double m_previousLoad;
+
+  mutable std::mutex m_mutex;
+  std::condition_variable m_wakeUp;
+  bool m_stopping;
+  GovernorPolicy m_policy;
+  ThermalSample m_sample;
+
+  std::thread m_thread;
+};
@@ -30,32 +30,55 @@
 
 #pragma once
 
+#include <chrono>
+#include <condition_variable>
 #include <memory>
 #include <mutex>
 #include <thread>
 
-#include <jni.h>
-
-#include "callback.h"
+#include "cache.h"
+#include "dataset.h"
 #include "hashrate.h"
 #include "job.h"
+#include "jobslot.h"
+#include "pages.h"
 #include "regulator.h"
-#include "utils.h"
+#include "shares.h"
+#include "topology.h"
+#include "trace.h"
 #include "vm.h"
 
-class Hasher : public Regulator, public Hashrate
+class Hasher : public Regulator
 {
 public:
-  Hasher(size_t id, size_t concurrency, double modifier)
-    : m_id(id)
-    , m_concurrency(concurrency)
-    , Regulator(modifier)
+  // Starts out working for slot, nullptr keeps the hasher idle. cpu < 0 leaves the thread unpinned, index tags
+  // the shares it finds.
+  Hasher(size_t index, JobSlot *slot, int cpu, double duty, ShareQueue &shares, Hashrate &hashrate)
+    : Regulator(duty)
+    , m_index(index)
+    , m_pages(-1)
+    , m_cpu(cpu)
+    , m_assigned(slot)
+    , m_stopped(false)
+    , m_failed(false)
+    , m_slot(nullptr)
+    , m_shares(shares)
+    , m_hashrate(hashrate)
+    , m_created(std::chrono::steady_clock::now())
+    , m_startupMs(-1)
+    , m_resumedNs(-1)
   {
   }
 
   ~Hasher()
   {
-    m_canRun.clear();
+    {
+      std::lock_guard<std::mutex> lock(m_assignMutex);
+      m_canRun.clear();
+      m_stopped = true;
+    }
+    m_idleWakeUp.notify_all();
+    Regulator::release();
 
     try
     {
@@ -66,93 +89,286 @@ public:
     }
   }
 
-  void setJob(Job job)
+  void start()
   {
-    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_thread.joinable())
+    {
+      return;
+    }
 
-    m_job.reset(new Job(job));
     m_canRun.test_and_set();
-    m_updated.clear();
+    m_thread = std::thread([this]() {
+      try
+      {
+        thread();
+      }
+      catch (...)
+      {
+        // Typically a VM that couldn't be created, the miner moves the hasher's work to another one
+        m_failed = true;
+      }
+    });
+  }
 
-    if (!m_thread.joinable())
-    {
-      m_thread = std::thread([this, job]() {
-        JNIEnv *env;
-        JavaVMAttachArgs lJavaVMAttachArgs;
-        lJavaVMAttachArgs.version = JNI_VERSION_1_6;
-        lJavaVMAttachArgs.name = "HasherThread";
-        lJavaVMAttachArgs.group = NULL;
-        if (javaVm->AttachCurrentThread(&env, &lJavaVMAttachArgs) == JNI_ERR)
-        {
-          throw std::runtime_error("AttachCurrentThread failed");
-        }
+  // The hashing thread stopped on an error and won't hash again
+  bool failed() const
+  {
+    return m_failed;
+  }
 
-        try
-        {
-          thread(CallbackVoidStringStringString(env, className, methodName), std::move(job));
-        }
-        catch (...)
-        {
-        }
+  // Moves the hasher to another slot after the hash in flight, nullptr idles it. Nonces come from the job
+  // state's allocator, so nothing has to be laid out for the hashers staying on a slot.
+  void assign(JobSlot *slot)
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_assignMutex);
+      m_assigned.store(slot, std::memory_order_release);
+    }
+    m_idleWakeUp.notify_all();
+  }
 
-        javaVm->DetachCurrentThread();
-      });
+  // Scratchpad pages of the current VM, false until one was created
+  bool pages(Pages::Kind *pages) const
+  {
+    const int kind = m_pages.load(std::memory_order_relaxed);
+    if (kind < 0)
+    {
+      return false;
     }
+    *pages = static_cast<Pages::Kind>(kind);
+    return true;
+  }
+
+  // Milliseconds from construction until the first hash was computed, -1 if still starting up
+  int64_t startupTime() const
+  {
+    return m_startupMs;
+  }
+
+  // Parks the thread after its hash in flight, keeping the VM and its scratchpad. A hasher created paused parks
+  // before its first VM.
+  void pause()
+  {
+    Regulator::setPaused(true);
+  }
+
+  void resume()
+  {
+    m_resumedNs = -1;
+    Regulator::setPaused(false);
+  }
+
+  // Steady clock nanoseconds of the first hash since the last resume or construction, -1 if none yet
+  int64_t resumedTime() const
+  {
+    return m_resumedNs;
   }
 
 private:
-  void thread(const CallbackVoidStringStringString &callback, Job job)
+  // The VM asks for the pages its cache was built with
+  void resetVm(const JobSlot::State *state)
+  {
+    m_vm.reset(new Vm(state->cache->flags(), state->cache, state->dataset));
+    m_pages.store(m_vm->pages(), std::memory_order_relaxed);
+  }
+
+  void switchVm(const JobSlot::State *state)
+  {
+    Trace::Scope trace(Trace::VmSwitch);
+    if (!m_vm || m_vm->fullMem() != (state->dataset != nullptr))
+    {
+      resetVm(state);
+    }
+    else if (state->dataset && m_vm->dataset() != state->dataset)
+    {
+      m_vm->setDataset(state->cache, state->dataset);
+    }
+    else if (!state->dataset && m_vm->cache() != state->cache)
+    {
+      m_vm->setCache(state->cache);
+    }
+  }
+
+  void thread()
   {
+    if (m_cpu >= 0)
+    {
+      Topology::pin(m_cpu);
+    }
+    Trace::attach("hasher " + std::to_string(m_index));
+
+    // Copy of the current state's job, allocated once. Counters [counter, chunkEnd) are claimed for it.
+    std::unique_ptr<Job> job;
+    const JobSlot::State *state = nullptr;
+    uint64_t counter = 0;
+    uint64_t chunkEnd = 0;
+
     std::array<uint8_t, RANDOMX_HASH_SIZE> result;
+    // Nonce of the hash queued in the VM
+    Job::Nonce nonce = 0;
+    bool inFlight = false;
 
-    m_vm.reset(new Vm(job.seedHash()));
+    // The queued hash belongs to the current job and must complete before the VM switches seed or slot
+    auto finish = [&]() {
+      if (inFlight)
+      {
+        Trace::Scope trace(Trace::Hash);
+        m_vm->hashLast(&result);
+        inFlight = false;
+        submit(*job, nonce, result);
+        countHash();
+      }
+    };
 
-    Hashrate::reset();
+    Regulator::reset();
     while (m_canRun.test_and_set())
     {
-      if (!m_updated.test_and_set())
+      if (Regulator::waitWhilePaused())
       {
-        std::lock_guard<std::mutex> lock(m_mutex);
+        // Resumed or about to be joined
+        continue;
+      }
 
-        if (!m_job)
+      JobSlot *assigned = m_assigned.load(std::memory_order_acquire);
+      if (assigned != m_slot)
+      {
+        finish();
+        m_reader.reset();
+        m_slot = assigned;
+        state = nullptr;
+        if (m_slot != nullptr)
         {
-          continue;
+          m_reader.reset(new JobSlot::Reader(*m_slot));
         }
-        Job newJob = *m_job;
-        if (!job.seedEqual(newJob))
+      }
+
+      if (m_slot == nullptr)
+      {
+        Trace::Scope trace(Trace::Idle);
+        std::unique_lock<std::mutex> lock(m_assignMutex);
+        m_idleWakeUp.wait_for(lock, std::chrono::seconds(1), [this]() {
+          return m_assigned.load(std::memory_order_relaxed) != nullptr || m_stopped;
+        });
+        continue;
+      }
+
+      const JobSlot::State *updated = nullptr;
+      const JobSlot::Reader::Change change = m_reader->update(&updated);
+      if (change == JobSlot::Reader::Change::Cleared)
+      {
+        // The state may be freed already, the queued hash only needs the job copy and the VM
+        finish();
+        state = nullptr;
+      }
+      else if (change == JobSlot::Reader::Change::Published)
+      {
+        Trace::Scope trace(Trace::JobSwitch);
+        finish();
+        switchVm(updated);
+        state = updated;
+        if (job)
         {
-          m_vm->setCache(newJob.seedHash());
+          *job = state->job;
         }
-        job = Job(newJob);
-        job.nonceSet(m_id);
+        else
+        {
+          job.reset(new Job(state->job));
+        }
+        counter = chunkEnd = 0;
+      }
+      if (state == nullptr)
+      {
+        // The slot has no job yet or it was removed
+        Trace::Scope trace(Trace::Wait);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        continue;
       }
 
-      m_vm->hash(job.blob(), &result);
+      if (counter == chunkEnd && !state->nonces.claim(&counter, &chunkEnd))
+      {
+        finish();
+        if (state->nonces.report())
+        {
+          m_shares.push(Share::exhaustion(m_slot->id(), m_index, *job));
+        }
+        // Waits for a new job, repeating nonces would only produce duplicate shares
+        Trace::Scope trace(Trace::Wait);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        continue;
+      }
+      job->nonceSet(state->nonces.nonce(counter++));
 
-      if (job.target() > result)
+      if (!inFlight)
       {
-        Job::Nonce nonce = job.nonce();
-        callback.invoke(
-          job.id(),
-          bufferToHex(&result[0], result.size()),
-          bufferToHex(reinterpret_cast<uint8_t *>(&nonce), sizeof(nonce)));
+        Trace::Scope trace(Trace::Hash);
+        nonce = job->nonce();
+        m_vm->hashFirst(job->blob(), job->blobSize());
+        inFlight = true;
+        continue;
       }
 
-      job.nonceAdd(m_concurrency);
-      Hashrate::tick();
+      const auto hashStarted = std::chrono::steady_clock::now();
+      {
+        Trace::Scope trace(Trace::Hash);
+        m_vm->hashNext(job->blob(), job->blobSize(), &result);
+        submit(*job, nonce, result);
+        nonce = job->nonce();
+      }
+
+      countHash();
+      m_hashrate.tick(hashStarted);
       Regulator::tick();
     }
   }
 
+  void countHash()
+  {
+    if (m_startupMs < 0)
+    {
+      m_startupMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      std::chrono::steady_clock::now() - m_created)
+                      .count();
+    }
+    if (m_resumedNs.load(std::memory_order_relaxed) < 0)
+    {
+      m_resumedNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::steady_clock::now().time_since_epoch())
+                      .count();
+    }
+    m_slot->countHash();
+  }
+
+  void submit(const Job &job, Job::Nonce nonce, const std::array<uint8_t, RANDOMX_HASH_SIZE> &result)
+  {
+    if (job.target() > result)
+    {
+      m_shares.push(Share(m_slot->id(), m_index, job, nonce, result, m_vm->cache()));
+      m_slot->countShare();
+    }
+  }
+
 private:
+  const uint32_t m_index;
   std::unique_ptr<Vm> m_vm;
-  const size_t m_id;
-  const size_t m_concurrency;
+  std::atomic<int> m_pages;
+  const int m_cpu;
+
+  std::mutex m_assignMutex;
+  std::condition_variable m_idleWakeUp;
+  std::atomic<JobSlot *> m_assigned;
+  bool m_stopped;
+  std::atomic<bool> m_failed;
 
-  std::atomic_flag m_updated;
   std::atomic_flag m_canRun;
-  std::mutex m_mutex;
-  std::unique_ptr<Job> m_job;
+  // Hashing thread only
+  JobSlot *m_slot;
+  std::unique_ptr<JobSlot::Reader> m_reader;
+  ShareQueue &m_shares;
+  Hashrate &m_hashrate;
+
+  const std::chrono::steady_clock::time_point m_created;
+  std::atomic<int64_t> m_startupMs;
+  std::atomic<int64_t> m_resumedNs;
 
   std::thread m_thread;
 };
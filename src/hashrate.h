@@ -30,34 +30,275 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
 
+#include <time.h>
+
+// Per-thread hash counter and latency histogram. Only the owning hasher thread writes, so updates are plain
+// relaxed stores that never contend; readers on other threads see monotonic values.
 class Hashrate
 {
 public:
-  void tick()
+  // Latency buckets are quarter-octaves of microseconds, covering 1 us to ~16 s with under 19% error
+  static constexpr const size_t SubBuckets = 4;
+  static constexpr const size_t LatencyBuckets = 24 * SubBuckets;
+
+  Hashrate()
+    : m_hashes(0)
+  {
+    for (auto &bucket : m_latency)
+    {
+      bucket.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  Hashrate(const Hashrate &) = delete;
+  Hashrate &operator=(const Hashrate &) = delete;
+
+  // Accounts one hash that started at begin
+  void tick(std::chrono::steady_clock::time_point begin)
+  {
+    const auto elapsed = std::chrono::steady_clock::now() - begin;
+    const uint64_t elapsedUs = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+
+    auto &bucket = m_latency[bucketIndex(elapsedUs)];
+    bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    m_hashes.store(m_hashes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+
+  uint64_t hashes() const
+  {
+    return m_hashes.load(std::memory_order_relaxed);
+  }
+
+  void addLatency(std::array<uint64_t, LatencyBuckets> *histogram) const
   {
-    const auto current = std::chrono::steady_clock::now();
-    const double elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(current - m_last).count();
-    const auto hashrate = 1000.0 / std::max(1.0, elapsedMs);
-    const double prevHashrate = m_hashrate;
-    m_hashrate = prevHashrate + 0.003 * (hashrate - prevHashrate);
-    m_last = current;
+    for (size_t index = 0; index < LatencyBuckets; ++index)
+    {
+      (*histogram)[index] += m_latency[index].load(std::memory_order_relaxed);
+    }
   }
 
-  double hashrate() const
+  static size_t bucketIndex(uint64_t us)
   {
-    return m_hashrate;
+    if (us < SubBuckets)
+    {
+      return static_cast<size_t>(us);
+    }
+    const size_t octave = 63 - __builtin_clzll(us);
+    const size_t sub = (us >> (octave - 2)) & (SubBuckets - 1);
+    return std::min(octave * SubBuckets + sub, LatencyBuckets - 1);
   }
 
-  void reset()
+  // Lower bound of the bucket in microseconds
+  static uint64_t bucketValue(size_t index)
   {
-    m_hashrate = 0;
-    m_last = std::chrono::steady_clock::now();
+    if (index < SubBuckets)
+    {
+      return index;
+    }
+    const size_t octave = index / SubBuckets;
+    return static_cast<uint64_t>(SubBuckets + index % SubBuckets) << (octave - 2);
+  }
+
+  // Returns the latency in microseconds below which the given fraction of hashes completed
+  static double percentile(const std::array<uint64_t, LatencyBuckets> &histogram, double fraction)
+  {
+    uint64_t total = 0;
+    for (const uint64_t count : histogram)
+    {
+      total += count;
+    }
+    if (total == 0)
+    {
+      return 0;
+    }
+
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(fraction * total + 0.5));
+    uint64_t seen = 0;
+    for (size_t index = 0; index < LatencyBuckets; ++index)
+    {
+      seen += histogram[index];
+      if (seen >= rank)
+      {
+        // Middle of the bucket
+        const double low = bucketValue(index);
+        const double high = index + 1 < LatencyBuckets ? bucketValue(index + 1) : low * 2;
+        return (low + high) / 2;
+      }
+    }
+    return bucketValue(LatencyBuckets - 1);
   }
 
 private:
-  std::atomic<double> m_hashrate;
-  std::chrono::steady_clock::time_point m_last;
+  std::atomic<uint64_t> m_hashes;
+  std::array<std::atomic<uint64_t>, LatencyBuckets> m_latency;
+};
+
+struct HashrateStats
+{
+  enum Window
+  {
+    Window10s,
+    Window60s,
+    Window15m,
+    Windows
+  };
+
+  // H/s per window, per thread and summed over all threads
+  std::vector<std::array<double, Windows>> threads;
+  std::array<double, Windows> total;
+  // Running totals since the miner was created, combine with an energy counter for hashes per joule
+  uint64_t hashes;
+  double elapsedSeconds;
+  double cpuSeconds;
+  // Per-hash latency in milliseconds
+  double latencyP50;
+  double latencyP90;
+  double latencyP99;
+};
+
+// Samples every hasher's counter once per second into a ring covering the longest window
+class HashrateMonitor
+{
+  static constexpr const size_t SamplePeriodMs = 1000;
+
+  static size_t windowSamples(size_t window)
+  {
+    static const size_t seconds[HashrateStats::Windows] = {10, 60, 15 * 60};
+    return seconds[window] * 1000 / SamplePeriodMs;
+  }
+
+public:
+  typedef std::function<void(std::vector<uint64_t> *)> Reader;
+
+  HashrateMonitor(Reader reader)
+    : m_reader(std::move(reader))
+    , m_started(std::chrono::steady_clock::now())
+    , m_canRun(false)
+  {
+  }
+
+  ~HashrateMonitor()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_canRun = false;
+    }
+    m_wakeUp.notify_all();
+
+    if (m_thread.joinable())
+    {
+      m_thread.join();
+    }
+  }
+
+  HashrateMonitor(const HashrateMonitor &) = delete;
+  HashrateMonitor &operator=(const HashrateMonitor &) = delete;
+
+  void start()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_thread.joinable())
+    {
+      return;
+    }
+    m_canRun = true;
+    m_thread = std::thread([this]() {
+      thread();
+    });
+  }
+
+  // Fills the window rates and running totals, latency is left to the caller
+  void stats(HashrateStats *stats) const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    stats->threads.clear();
+    stats->total.fill(0);
+    stats->hashes = 0;
+    stats->elapsedSeconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - m_started).count();
+
+    timespec cpuTime;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpuTime);
+    stats->cpuSeconds = cpuTime.tv_sec + cpuTime.tv_nsec / 1e9;
+
+    if (m_samples.empty())
+    {
+      return;
+    }
+
+    const Sample &latest = m_samples.back();
+    stats->threads.resize(latest.hashes.size());
+    for (size_t window = 0; window < HashrateStats::Windows; ++window)
+    {
+      // Oldest sample inside the window, or the oldest one available while the window is still filling up
+      const size_t back = std::min(windowSamples(window), m_samples.size() - 1);
+      const Sample &first = m_samples[m_samples.size() - 1 - back];
+      const double seconds = std::chrono::duration<double>(latest.time - first.time).count();
+
+      for (size_t index = 0; index < latest.hashes.size(); ++index)
+      {
+        const uint64_t before = index < first.hashes.size() ? first.hashes[index] : 0;
+        const double rate = seconds > 0 ? (latest.hashes[index] - before) / seconds : 0;
+        stats->threads[index][window] = rate;
+        stats->total[window] += rate;
+      }
+    }
+    for (const uint64_t hashes : latest.hashes)
+    {
+      stats->hashes += hashes;
+    }
+  }
+
+private:
+  struct Sample
+  {
+    std::chrono::steady_clock::time_point time;
+    std::vector<uint64_t> hashes;
+  };
+
+  void thread()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_canRun)
+    {
+      Sample sample;
+      lock.unlock();
+      m_reader(&sample.hashes);
+      sample.time = std::chrono::steady_clock::now();
+      lock.lock();
+
+      m_samples.push_back(std::move(sample));
+      while (m_samples.size() > windowSamples(HashrateStats::Window15m) + 1)
+      {
+        m_samples.pop_front();
+      }
+
+      m_wakeUp.wait_for(lock, std::chrono::milliseconds(static_cast<int64_t>(SamplePeriodMs)), [this]() {
+        return !m_canRun;
+      });
+    }
+  }
+
+private:
+  const Reader m_reader;
+  const std::chrono::steady_clock::time_point m_started;
+
+  mutable std::mutex m_mutex;
+  std::condition_variable m_wakeUp;
+  std::deque<Sample> m_samples;
+  bool m_canRun;
+  std::thread m_thread;
 };
@@ -0,0 +1,71 @@
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <jni.h>
+
+// Copies the characters straight out of the string without a round trip through String.getBytes. The result is
+// modified UTF-8, identical to UTF-8 for the ASCII ids, hosts and addresses passed in. The buffer keeps its capacity,
+// so a buffer reused for every call stops allocating once it fits the longest string.
+void jstringTostring(JNIEnv *env, jstring jStr, std::string *result)
+{
+  result->resize(jStr != nullptr ? env->GetStringUTFLength(jStr) : 0);
+  if (!result->empty())
+  {
+    env->GetStringUTFRegion(jStr, 0, env->GetStringLength(jStr), &(*result)[0]);
+  }
+}
+
+std::string jstringTostring(JNIEnv *env, jstring jStr)
+{
+  std::string result;
+  jstringTostring(env, jStr, &result);
+  return result;
+}
+
+void jbyteArrayToVector(JNIEnv *env, jbyteArray jbIn, std::vector<uint8_t> *result)
+{
+  result->resize(jbIn != nullptr ? env->GetArrayLength(jbIn) : 0);
+  if (!result->empty())
+  {
+    env->GetByteArrayRegion(jbIn, 0, result->size(), reinterpret_cast<jbyte *>(&(*result)[0]));
+  }
+}
+
+std::vector<uint8_t> jbyteArrayToVector(JNIEnv *env, jbyteArray jbIn)
+{
+  std::vector<uint8_t> result;
+  jbyteArrayToVector(env, jbIn, &result);
+  return result;
+}
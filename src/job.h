@@ -30,8 +30,11 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <stdexcept>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 #include <randomx.h>
@@ -42,39 +45,50 @@ class Job
 {
 public:
   static constexpr const size_t NonceOffset = 39;
+  // Monero hashing blobs are 76 bytes plus the transaction count varint
+  static constexpr const size_t MaxBlobSize = 128;
+  static constexpr const size_t MaxIdSize = 64;
   typedef uint32_t Nonce;
+  typedef std::array<uint8_t, RANDOMX_HASH_SIZE> SeedHash;
 
-  Job &operator=(const Job &other)
+  Job(const std::string &id, const std::vector<uint8_t> &blob, const SeedHash &seedHash, size_t height, Target target)
+    : Job(id, blob.data(), blob.size(), seedHash, height, target)
   {
-    m_id = other.m_id;
-    m_blob = other.m_blob;
-    m_seedHash = other.m_seedHash;
-    m_height = other.m_height;
-    m_target = other.m_target;
-
-    return *this;
   }
 
-  Job(std::string id, std::vector<uint8_t> blob, std::vector<uint8_t> seedHash, size_t height, Target target)
-    : m_id(std::move(id))
-    , m_blob(std::move(blob))
-    , m_seedHash(std::move(seedHash))
+  Job(
+    const std::string &id,
+    const uint8_t *blob,
+    size_t blobSize,
+    const SeedHash &seedHash,
+    size_t height,
+    Target target)
+    : m_blobSize(blobSize)
+    , m_seedHash(seedHash)
+    , m_idSize(id.size())
     , m_height(height)
-    , m_target(std::move(target))
+    , m_target(target)
   {
-    if (!validateBlob(m_blob))
+    if (!validateBlobSize(blobSize))
     {
       throw std::runtime_error("invalid blob length");
     }
-    if (!validateSeedHash(m_seedHash))
+    if (!validateId(id))
     {
-      throw std::runtime_error("invalid seed hash length");
+      throw std::runtime_error("invalid job id length");
     }
+    std::copy(blob, blob + blobSize, m_blob.begin());
+    std::copy(id.begin(), id.end(), m_id.begin());
   }
 
   static bool validateBlob(const std::vector<uint8_t> &blob)
   {
-    return blob.size() >= NonceOffset + sizeof(Nonce);
+    return validateBlobSize(blob.size());
+  }
+
+  static bool validateBlobSize(size_t size)
+  {
+    return size >= NonceOffset + sizeof(Nonce) && size <= MaxBlobSize;
   }
 
   static bool validateSeedHash(const std::vector<uint8_t> &seedHash)
@@ -82,12 +96,22 @@ public:
     return seedHash.size() == RANDOMX_HASH_SIZE;
   }
 
-  const std::vector<uint8_t> &blob() const
+  static bool validateId(const std::string &id)
+  {
+    return id.size() <= MaxIdSize;
+  }
+
+  const uint8_t *blob() const
+  {
+    return &m_blob[0];
+  }
+
+  size_t blobSize() const
   {
-    return m_blob;
+    return m_blobSize;
   }
 
-  const std::vector<uint8_t> &seedHash() const
+  const SeedHash &seedHash() const
   {
     return m_seedHash;
   }
@@ -109,7 +133,16 @@ public:
 
   bool seedEqual(const Job &other) const
   {
-    return std::equal(m_seedHash.begin(), m_seedHash.end(), other.m_seedHash.begin(), other.m_seedHash.end());
+    return m_seedHash == other.m_seedHash;
+  }
+
+  // Same job id and blob apart from the nonce field, hashing either one covers the same work
+  bool sameWork(const Job &other) const
+  {
+    const size_t nonceEnd = NonceOffset + sizeof(Nonce);
+    return m_idSize == other.m_idSize && std::equal(m_id.begin(), m_id.begin() + m_idSize, other.m_id.begin()) &&
+           m_blobSize == other.m_blobSize && std::equal(blob(), blob() + NonceOffset, other.blob()) &&
+           std::equal(blob() + nonceEnd, blob() + m_blobSize, other.blob() + nonceEnd);
   }
 
   const Target &target() const
@@ -119,13 +152,28 @@ public:
 
   std::string id() const
   {
-    return m_id;
+    return std::string(&m_id[0], m_idSize);
+  }
+
+  const char *idData() const
+  {
+    return &m_id[0];
+  }
+
+  size_t idSize() const
+  {
+    return m_idSize;
   }
 
 private:
-  std::string m_id;
-  std::vector<uint8_t> m_blob;
-  std::vector<uint8_t> m_seedHash;
+  std::array<uint8_t, MaxBlobSize> m_blob;
+  size_t m_blobSize;
+  SeedHash m_seedHash;
+  std::array<char, MaxIdSize> m_id;
+  size_t m_idSize;
   size_t m_height;
   Target m_target;
 };
+
+// Hashers copy the job on every switch, keep that a plain memcpy
+static_assert(std::is_trivially_copyable<Job>::value, "Job must be trivially copyable");
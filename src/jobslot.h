@@ -0,0 +1,280 @@
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "cache.h"
+#include "dataset.h"
+#include "job.h"
+#include "nonces.h"
+
+// Job slot shared by the hashers working for one job source (a pool connection,
+// a solo node). Publishing swaps an immutable state in with one atomic store;
+// readers pick it up with a single atomic load per hash and protect the state
+// they use with a hazard pointer, so the hashing loop never takes a lock or
+// allocates. Retired states are freed on the publisher side once no reader
+// references them anymore.
+class JobSlot
+{
+public:
+  struct State
+  {
+    State(
+      const Job &job,
+      std::shared_ptr<const Cache> cache,
+      std::shared_ptr<const Dataset> dataset,
+      const NonceSpace &space)
+      : job(job)
+      , cache(std::move(cache))
+      , dataset(std::move(dataset))
+      , nonces(space, job.nonce())
+    {
+    }
+
+    Job job;
+    std::shared_ptr<const Cache> cache;
+    std::shared_ptr<const Dataset> dataset;
+    // The only part hashers modify
+    mutable NonceAllocator nonces;
+  };
+
+  class Reader
+  {
+  public:
+    Reader(JobSlot &slot)
+      : m_slot(slot)
+      , m_hazard(nullptr)
+    {
+      m_slot.attach(this);
+    }
+
+    ~Reader()
+    {
+      m_slot.detach(this);
+    }
+
+    Reader(const Reader &) = delete;
+    Reader &operator=(const Reader &) = delete;
+
+    enum class Change
+    {
+      None,
+      Published,
+      Cleared
+    };
+
+    // Stores the newly published state in *state. Once the slot is cleared the previous state is no longer
+    // protected and may be freed, so the caller has to drop every reference to it, *state is set to nullptr.
+    Change update(const State **state)
+    {
+      const State *current = m_slot.m_current.load(std::memory_order_acquire);
+      if (current == m_hazard.load(std::memory_order_relaxed))
+      {
+        return Change::None;
+      }
+
+      while (true)
+      {
+        m_hazard.store(current, std::memory_order_seq_cst);
+        const State *check = m_slot.m_current.load(std::memory_order_seq_cst);
+        if (check == current)
+        {
+          *state = current;
+          return current != nullptr ? Change::Published : Change::Cleared;
+        }
+        current = check;
+      }
+    }
+
+  private:
+    friend class JobSlot;
+
+    JobSlot &m_slot;
+    std::atomic<const State *> m_hazard;
+  };
+
+  explicit JobSlot(uint32_t id = 0)
+    : m_id(id)
+    , m_current(nullptr)
+    , m_hashes(0)
+    , m_shares(0)
+  {
+  }
+
+  ~JobSlot()
+  {
+    delete m_current.load();
+    for (const State *state : m_retired)
+    {
+      delete state;
+    }
+  }
+
+  JobSlot(const JobSlot &) = delete;
+  JobSlot &operator=(const JobSlot &) = delete;
+
+  // A job published again with the same work continues where the previous state's nonces stopped
+  void publish(
+    const Job &job, std::shared_ptr<const Cache> cache, std::shared_ptr<const Dataset> dataset, const NonceSpace &space)
+  {
+    std::unique_ptr<State> state(new State(job, std::move(cache), std::move(dataset), space));
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const State *current = m_current.load(std::memory_order_relaxed);
+    const State *previous = current != nullptr ? current : m_suspended.get();
+    if (previous != nullptr && previous->job.sameWork(job) && previous->nonces.sameSpace(state->nonces))
+    {
+      state->nonces.resume(previous->nonces.handOver());
+    }
+    m_suspended.reset();
+
+    retire(m_current.exchange(state.release(), std::memory_order_seq_cst));
+  }
+
+  void clear()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_suspended.reset();
+    retire(m_current.exchange(nullptr, std::memory_order_seq_cst));
+  }
+
+  // Clears the slot like clear() and returns a copy of its job, nullptr if it had none. Publishing the same work
+  // again continues where the nonces stopped. The states let go of their cache and dataset, so no reader may be
+  // attached anymore.
+  std::unique_ptr<Job> suspend()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Without readers every retired state is freed right away, and the current one belongs to the slot alone
+    m_suspended.reset(const_cast<State *>(m_current.exchange(nullptr, std::memory_order_seq_cst)));
+    retire(nullptr);
+    if (!m_suspended)
+    {
+      return nullptr;
+    }
+    m_suspended->cache.reset();
+    m_suspended->dataset.reset();
+    return std::unique_ptr<Job>(new Job(m_suspended->job));
+  }
+
+  uint32_t id() const
+  {
+    return m_id;
+  }
+
+  // Hashes computed and shares found for the jobs of this slot, counted by the hashers
+  void countHash()
+  {
+    m_hashes.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void countShare()
+  {
+    m_shares.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  uint64_t hashes() const
+  {
+    return m_hashes.load(std::memory_order_relaxed);
+  }
+
+  uint64_t shares() const
+  {
+    return m_shares.load(std::memory_order_relaxed);
+  }
+
+  // Latest published state, only meant for identity comparisons on the publisher side
+  const State *current() const
+  {
+    return m_current.load(std::memory_order_relaxed);
+  }
+
+private:
+  void retire(const State *state)
+  {
+    if (state != nullptr)
+    {
+      m_retired.push_back(state);
+    }
+
+    m_retired.erase(
+      std::remove_if(
+        m_retired.begin(),
+        m_retired.end(),
+        [this](const State *retired) {
+          for (const Reader *reader : m_readers)
+          {
+            if (reader->m_hazard.load(std::memory_order_seq_cst) == retired)
+            {
+              return false;
+            }
+          }
+          delete retired;
+          return true;
+        }),
+      m_retired.end());
+  }
+
+  void attach(const Reader *reader)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_readers.push_back(reader);
+  }
+
+  void detach(const Reader *reader)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_readers.erase(std::remove(m_readers.begin(), m_readers.end(), reader), m_readers.end());
+    retire(nullptr);
+  }
+
+private:
+  const uint32_t m_id;
+  std::atomic<const State *> m_current;
+  std::atomic<uint64_t> m_hashes;
+  std::atomic<uint64_t> m_shares;
+
+  // Publisher side only, never touched by the hashing loop
+  std::mutex m_mutex;
+  std::vector<const Reader *> m_readers;
+  std::vector<const State *> m_retired;
+  // Last state before suspend(), without its memory
+  std::unique_ptr<State> m_suspended;
+};
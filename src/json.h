@@ -0,0 +1,415 @@
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "utils.h"
+
+// Just enough JSON for stratum and daemon RPC messages. Values are immutable once parsed, lookups of missing keys
+// or indices return a null value so message handling can chain them without checks.
+class Json
+{
+public:
+  enum Type
+  {
+    Null,
+    Bool,
+    Number,
+    String,
+    Array,
+    Object,
+  };
+
+  Json()
+    : m_type(Null)
+    , m_bool(false)
+    , m_number(0)
+  {
+  }
+
+  // False if text isn't a single well formed JSON value
+  static bool parse(const std::string &text, Json *value)
+  {
+    Parser parser(text);
+    Json result;
+    if (!parser.value(&result, 0) || !parser.end())
+    {
+      return false;
+    }
+    *value = std::move(result);
+    return true;
+  }
+
+  // Quoted and escaped string literal
+  static std::string quote(const std::string &value)
+  {
+    static constexpr const char Digits[] = "0123456789abcdef";
+    std::string result = "\"";
+    for (const char c : value)
+    {
+      if (c == '"' || c == '\\')
+      {
+        result += '\\';
+        result += c;
+      }
+      else if (static_cast<unsigned char>(c) < 0x20)
+      {
+        result += "\\u00";
+        result += Digits[static_cast<unsigned char>(c) >> 4];
+        result += Digits[static_cast<unsigned char>(c) & 0xf];
+      }
+      else
+      {
+        result += c;
+      }
+    }
+    result += '"';
+    return result;
+  }
+
+  Type type() const
+  {
+    return m_type;
+  }
+
+  bool isNull() const
+  {
+    return m_type == Null;
+  }
+
+  bool boolean() const
+  {
+    return m_bool;
+  }
+
+  double number() const
+  {
+    return m_number;
+  }
+
+  const std::string &string() const
+  {
+    return m_string;
+  }
+
+  size_t size() const
+  {
+    return m_type == Array ? m_array.size() : m_object.size();
+  }
+
+  const Json &operator[](size_t index) const
+  {
+    return m_type == Array && index < m_array.size() ? m_array[index] : null();
+  }
+
+  const Json &operator[](const std::string &key) const
+  {
+    for (const auto &member : m_object)
+    {
+      if (member.first == key)
+      {
+        return member.second;
+      }
+    }
+    return null();
+  }
+
+private:
+  static const Json &null()
+  {
+    static const Json value;
+    return value;
+  }
+
+  class Parser
+  {
+    // Deeper nesting than any RPC message uses, keeps a hostile peer from exhausting the stack
+    static constexpr const size_t MaxDepth = 32;
+
+  public:
+    explicit Parser(const std::string &text)
+      : m_text(text)
+      , m_position(0)
+    {
+    }
+
+    bool end()
+    {
+      skipSpace();
+      return m_position == m_text.size();
+    }
+
+    bool value(Json *value, size_t depth)
+    {
+      skipSpace();
+      if (m_position == m_text.size() || depth > MaxDepth)
+      {
+        return false;
+      }
+
+      const char c = m_text[m_position];
+      if (c == '{')
+      {
+        value->m_type = Object;
+        return object(value, depth);
+      }
+      if (c == '[')
+      {
+        value->m_type = Array;
+        return array(value, depth);
+      }
+      if (c == '"')
+      {
+        value->m_type = String;
+        return string(&value->m_string);
+      }
+      if (literal("true"))
+      {
+        value->m_type = Bool;
+        value->m_bool = true;
+        return true;
+      }
+      if (literal("false"))
+      {
+        value->m_type = Bool;
+        value->m_bool = false;
+        return true;
+      }
+      if (literal("null"))
+      {
+        value->m_type = Null;
+        return true;
+      }
+      value->m_type = Number;
+      return number(&value->m_number);
+    }
+
+  private:
+    bool object(Json *value, size_t depth)
+    {
+      ++m_position;
+      if (consume('}'))
+      {
+        return true;
+      }
+      do
+      {
+        skipSpace();
+        std::pair<std::string, Json> member;
+        if (!string(&member.first) || !consume(':') || !this->value(&member.second, depth + 1))
+        {
+          return false;
+        }
+        value->m_object.push_back(std::move(member));
+      } while (consume(','));
+      return consume('}');
+    }
+
+    bool array(Json *value, size_t depth)
+    {
+      ++m_position;
+      if (consume(']'))
+      {
+        return true;
+      }
+      do
+      {
+        value->m_array.emplace_back();
+        if (!this->value(&value->m_array.back(), depth + 1))
+        {
+          return false;
+        }
+      } while (consume(','));
+      return consume(']');
+    }
+
+    bool string(std::string *value)
+    {
+      if (m_position == m_text.size() || m_text[m_position] != '"')
+      {
+        return false;
+      }
+      ++m_position;
+      while (m_position < m_text.size())
+      {
+        const char c = m_text[m_position++];
+        if (c == '"')
+        {
+          return true;
+        }
+        if (c != '\\')
+        {
+          *value += c;
+          continue;
+        }
+        if (m_position == m_text.size())
+        {
+          return false;
+        }
+        const char escaped = m_text[m_position++];
+        const char *const from = "\"\\/bfnrt";
+        const char *const to = "\"\\/\b\f\n\r\t";
+        const char *found = escaped != '\0' ? std::strchr(from, escaped) : nullptr;
+        if (found != nullptr)
+        {
+          *value += to[found - from];
+        }
+        else if (escaped != 'u' || !unicode(value))
+        {
+          return false;
+        }
+      }
+      return false;
+    }
+
+    // \uXXXX escape as UTF-8, surrogate pairs are combined
+    bool unicode(std::string *value)
+    {
+      uint32_t code;
+      if (!hex4(&code))
+      {
+        return false;
+      }
+      if (code >= 0xd800 && code < 0xdc00 && m_text.compare(m_position, 2, "\\u") == 0)
+      {
+        m_position += 2;
+        uint32_t low;
+        if (!hex4(&low) || low < 0xdc00 || low >= 0xe000)
+        {
+          return false;
+        }
+        code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+      }
+      if (code < 0x80)
+      {
+        *value += static_cast<char>(code);
+      }
+      else if (code < 0x800)
+      {
+        *value += static_cast<char>(0xc0 | code >> 6);
+        *value += static_cast<char>(0x80 | (code & 0x3f));
+      }
+      else if (code < 0x10000)
+      {
+        *value += static_cast<char>(0xe0 | code >> 12);
+        *value += static_cast<char>(0x80 | (code >> 6 & 0x3f));
+        *value += static_cast<char>(0x80 | (code & 0x3f));
+      }
+      else
+      {
+        *value += static_cast<char>(0xf0 | code >> 18);
+        *value += static_cast<char>(0x80 | (code >> 12 & 0x3f));
+        *value += static_cast<char>(0x80 | (code >> 6 & 0x3f));
+        *value += static_cast<char>(0x80 | (code & 0x3f));
+      }
+      return true;
+    }
+
+    bool hex4(uint32_t *code)
+    {
+      std::vector<uint8_t> bytes;
+      if (m_text.size() - m_position < 4 || !hexToBuffer(m_text.substr(m_position, 4), &bytes))
+      {
+        return false;
+      }
+      m_position += 4;
+      *code = static_cast<uint32_t>(bytes[0]) << 8 | bytes[1];
+      return true;
+    }
+
+    bool number(double *value)
+    {
+      const size_t begin = m_position;
+      while (m_position < m_text.size() && std::strchr("+-.0123456789eE", m_text[m_position]) != nullptr &&
+             m_text[m_position] != '\0')
+      {
+        ++m_position;
+      }
+      if (m_position == begin)
+      {
+        return false;
+      }
+      const std::string token = m_text.substr(begin, m_position - begin);
+      char *end;
+      *value = std::strtod(token.c_str(), &end);
+      return *end == '\0';
+    }
+
+    bool literal(const char *word)
+    {
+      const size_t length = std::strlen(word);
+      if (m_text.compare(m_position, length, word) != 0)
+      {
+        return false;
+      }
+      m_position += length;
+      return true;
+    }
+
+    bool consume(char c)
+    {
+      skipSpace();
+      if (m_position == m_text.size() || m_text[m_position] != c)
+      {
+        return false;
+      }
+      ++m_position;
+      return true;
+    }
+
+    void skipSpace()
+    {
+      while (m_position < m_text.size() && std::strchr(" \t\r\n", m_text[m_position]) != nullptr &&
+             m_text[m_position] != '\0')
+      {
+        ++m_position;
+      }
+    }
+
+  private:
+    const std::string &m_text;
+    size_t m_position;
+  };
+
+private:
+  Type m_type;
+  bool m_bool;
+  double m_number;
+  std::string m_string;
+  std::vector<Json> m_array;
+  std::vector<std::pair<std::string, Json>> m_object;
+};
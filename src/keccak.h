@@ -0,0 +1,142 @@
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+// Keccak-256 with the original padding, the cn_fast_hash Monero uses for block and transaction ids
+class Keccak
+{
+  static constexpr const size_t Rate = 136;
+  static constexpr const size_t Rounds = 24;
+
+public:
+  typedef std::array<uint8_t, 32> Hash;
+
+  static Hash hash(const uint8_t *data, size_t size)
+  {
+    uint64_t state[25] = {};
+    for (; size >= Rate; data += Rate, size -= Rate)
+    {
+      absorb(state, data, Rate);
+      permute(state);
+    }
+
+    uint8_t last[Rate] = {};
+    std::memcpy(last, data, size);
+    last[size] = 0x01;
+    last[Rate - 1] |= 0x80;
+    absorb(state, last, Rate);
+    permute(state);
+
+    Hash result;
+    std::memcpy(&result[0], state, result.size());
+    return result;
+  }
+
+  static Hash hash(const Hash &left, const Hash &right)
+  {
+    uint8_t pair[64];
+    std::memcpy(pair, &left[0], left.size());
+    std::memcpy(pair + left.size(), &right[0], right.size());
+    return hash(pair, sizeof(pair));
+  }
+
+private:
+  // Little-endian lanes, like every platform the miner runs on
+  static void absorb(uint64_t *state, const uint8_t *block, size_t size)
+  {
+    for (size_t lane = 0; lane < size / sizeof(uint64_t); ++lane)
+    {
+      uint64_t value;
+      std::memcpy(&value, block + lane * sizeof(value), sizeof(value));
+      state[lane] ^= value;
+    }
+  }
+
+  static uint64_t rotate(uint64_t value, unsigned bits)
+  {
+    return value << bits | value >> (64 - bits);
+  }
+
+  static void permute(uint64_t *state)
+  {
+    static constexpr const uint64_t RoundConstants[Rounds] = {
+      0x0000000000000001, 0x0000000000008082, 0x800000000000808a, 0x8000000080008000, 0x000000000000808b,
+      0x0000000080000001, 0x8000000080008081, 0x8000000000008009, 0x000000000000008a, 0x0000000000000088,
+      0x0000000080008009, 0x000000008000000a, 0x000000008000808b, 0x800000000000008b, 0x8000000000008089,
+      0x8000000000008003, 0x8000000000008002, 0x8000000000000080, 0x000000000000800a, 0x800000008000000a,
+      0x8000000080008081, 0x8000000000008080, 0x0000000080000001, 0x8000000080008008,
+    };
+    static constexpr const unsigned Rotations[24] = {1,  3,  6,  10, 15, 21, 28, 36, 45, 55, 2,  14,
+                                                     27, 41, 56, 8,  25, 43, 62, 18, 39, 61, 20, 44};
+    static constexpr const unsigned Lanes[24] = {10, 7,  11, 17, 18, 3, 5,  16, 8,  21, 24, 4,
+                                                 15, 23, 19, 13, 12, 2, 20, 14, 22, 9,  6,  1};
+
+    for (size_t round = 0; round < Rounds; ++round)
+    {
+      uint64_t columns[5];
+      for (size_t x = 0; x < 5; ++x)
+      {
+        columns[x] = state[x] ^ state[x + 5] ^ state[x + 10] ^ state[x + 15] ^ state[x + 20];
+      }
+      for (size_t x = 0; x < 5; ++x)
+      {
+        const uint64_t theta = columns[(x + 4) % 5] ^ rotate(columns[(x + 1) % 5], 1);
+        for (size_t y = 0; y < 25; y += 5)
+        {
+          state[y + x] ^= theta;
+        }
+      }
+
+      uint64_t carried = state[1];
+      for (size_t index = 0; index < 24; ++index)
+      {
+        const uint64_t next = state[Lanes[index]];
+        state[Lanes[index]] = rotate(carried, Rotations[index]);
+        carried = next;
+      }
+
+      for (size_t y = 0; y < 25; y += 5)
+      {
+        const uint64_t row[5] = {state[y], state[y + 1], state[y + 2], state[y + 3], state[y + 4]};
+        for (size_t x = 0; x < 5; ++x)
+        {
+          state[y + x] = row[x] ^ (~row[(x + 1) % 5] & row[(x + 2) % 5]);
+        }
+      }
+
+      state[0] ^= RoundConstants[round];
+    }
+  }
+};
@@ -0,0 +1,168 @@
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "marshal.h"
+#include "utils.h"
+
+namespace
+{
+  // What the JNI layer used before the table codec, kept as the baseline
+  std::string streamHex(const uint8_t *buffer, size_t size)
+  {
+    std::stringstream stream;
+    stream << std::hex << std::setfill('0');
+    for (size_t index = 0; index < size; ++index)
+    {
+      stream << std::setw(2) << static_cast<int>(buffer[index]);
+    }
+    return stream.str();
+  }
+
+  bool streamBuffer(const std::string &hex, std::vector<uint8_t> *buffer)
+  {
+    if (hex.size() % 2 != 0)
+    {
+      return false;
+    }
+    buffer->resize(hex.size() / 2);
+    for (size_t index = 0; index < buffer->size(); ++index)
+    {
+      std::istringstream stream(hex.substr(index * 2, 2));
+      int value;
+      if (!(stream >> std::hex >> value))
+      {
+        return false;
+      }
+      (*buffer)[index] = static_cast<uint8_t>(value);
+    }
+    return true;
+  }
+
+  void usage(const char *name)
+  {
+    std::fprintf(stderr, "usage: %s [--iterations N]\n", name);
+  }
+
+  template <typename Function>
+  double nanoseconds(size_t iterations, Function function)
+  {
+    const auto started = std::chrono::steady_clock::now();
+    for (size_t index = 0; index < iterations; ++index)
+    {
+      function(index);
+    }
+    const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - started;
+    return elapsed.count() / iterations;
+  }
+} // namespace
+
+// Times the hex codec and the share record against the stringstream marshalling the JNI layer did per job and
+// per share. The JNI calls themselves need a JVM and are not covered.
+int main(int argc, char *argv[])
+{
+  size_t iterations = 200000;
+  for (int index = 1; index < argc; ++index)
+  {
+    const std::string arg = argv[index];
+    if (arg == "--iterations" && index + 1 < argc)
+    {
+      iterations = std::strtoul(argv[++index], nullptr, 10);
+    }
+    else
+    {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (iterations == 0)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  std::mt19937 random(1);
+  std::vector<uint8_t> blob(76);
+  for (uint8_t &byte : blob)
+  {
+    byte = static_cast<uint8_t>(random());
+  }
+  Job::SeedHash seedHash = {};
+  const Job job("1234567890", blob, seedHash, 1, Target::fromDifficulty(1));
+  std::array<uint8_t, RANDOMX_HASH_SIZE> hash;
+  for (uint8_t &byte : hash)
+  {
+    byte = static_cast<uint8_t>(random());
+  }
+  const Share share(0, 0, job, 0x12345678, hash, nullptr);
+  const std::string blobHex = bufferToHex(blob);
+
+  if (streamHex(blob.data(), blob.size()) != blobHex)
+  {
+    std::fprintf(stderr, "encoders disagree\n");
+    return 1;
+  }
+
+  // Keeps the optimizer from dropping the work
+  volatile size_t sink = 0;
+  const double oldEncode = nanoseconds(iterations, [&](size_t) { sink += streamHex(blob.data(), blob.size()).size(); });
+  const double newEncode = nanoseconds(iterations, [&](size_t) { sink += bufferToHex(blob).size(); });
+
+  std::vector<uint8_t> decoded;
+  const double oldDecode = nanoseconds(iterations, [&](size_t) { sink += streamBuffer(blobHex, &decoded); });
+  const double newDecode = nanoseconds(iterations, [&](size_t) { sink += hexToBuffer(blobHex, &decoded); });
+
+  // A share used to become three strings, the id, the hex hash and the hex nonce
+  const double oldShare = nanoseconds(iterations, [&](size_t) {
+    const std::string id(share.id.begin(), share.id.begin() + share.idSize);
+    sink += id.size() + streamHex(share.hash.data(), share.hash.size()).size() +
+            streamHex(&share.blob[Job::NonceOffset], sizeof(Job::Nonce)).size();
+  });
+  std::vector<uint8_t> records(ShareRecord::Size * 16);
+  const double newShare = nanoseconds(iterations, [&](size_t index) {
+    uint8_t *record = &records[(index % 16) * ShareRecord::Size];
+    ShareRecord::write(share, record);
+    sink += record[ShareRecord::HashOffset];
+  });
+
+  std::printf("encode %zu bytes: stringstream %.1f ns, table %.1f ns\n", blob.size(), oldEncode, newEncode);
+  std::printf("decode %zu bytes: stringstream %.1f ns, table %.1f ns\n", blob.size(), oldDecode, newDecode);
+  std::printf("share: hex strings %.1f ns, record %.1f ns\n", oldShare, newShare);
+  return 0;
+}
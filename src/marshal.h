@@ -0,0 +1,107 @@
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include "job.h"
+#include "shares.h"
+#include "target.h"
+
+// Layout of a job written by Java into a direct ByteBuffer, read in place by the native side. Little-endian, the
+// offsets must match Miner.java.
+struct JobRecord
+{
+  static constexpr const size_t IdSizeOffset = 0;
+  static constexpr const size_t IdOffset = IdSizeOffset + 1;
+  static constexpr const size_t BlobSizeOffset = IdOffset + Job::MaxIdSize;
+  static constexpr const size_t BlobOffset = BlobSizeOffset + 1;
+  static constexpr const size_t SeedHashOffset = BlobOffset + Job::MaxBlobSize;
+  static constexpr const size_t HeightOffset = SeedHashOffset + RANDOMX_HASH_SIZE;
+  static constexpr const size_t TargetSizeOffset = HeightOffset + sizeof(uint64_t);
+  static constexpr const size_t TargetOffset = TargetSizeOffset + 1;
+  static constexpr const size_t Size = TargetOffset + sizeof(uint64_t);
+
+  // nullptr if the record is truncated or any field is malformed
+  static std::unique_ptr<Job> read(const uint8_t *record, size_t size)
+  {
+    if (size < Size || record[IdSizeOffset] > Job::MaxIdSize || !Job::validateBlobSize(record[BlobSizeOffset]) ||
+        !Target::validateSize(record[TargetSizeOffset]))
+    {
+      return nullptr;
+    }
+    Job::SeedHash seedHash;
+    std::memcpy(&seedHash[0], record + SeedHashOffset, seedHash.size());
+    uint64_t height;
+    std::memcpy(&height, record + HeightOffset, sizeof(height));
+
+    try
+    {
+      return std::unique_ptr<Job>(new Job(
+        std::string(reinterpret_cast<const char *>(record + IdOffset), record[IdSizeOffset]),
+        record + BlobOffset,
+        record[BlobSizeOffset],
+        seedHash,
+        static_cast<size_t>(height),
+        Target(record + TargetOffset, record[TargetSizeOffset])));
+    }
+    catch (const std::exception &)
+    {
+      return nullptr;
+    }
+  }
+};
+
+// Layout of a found share handed to Java through a direct ByteBuffer, the nonce and hash stay raw bytes
+struct ShareRecord
+{
+  static constexpr const size_t SlotOffset = 0;
+  static constexpr const size_t NonceOffset = SlotOffset + sizeof(uint32_t);
+  static constexpr const size_t IdSizeOffset = NonceOffset + sizeof(Job::Nonce);
+  static constexpr const size_t IdOffset = IdSizeOffset + sizeof(uint32_t);
+  static constexpr const size_t HashOffset = IdOffset + Job::MaxIdSize;
+  // Padded so records stay aligned
+  static constexpr const size_t Size = 128;
+
+  static void write(const Share &share, uint8_t *record)
+  {
+    const uint32_t idSize = static_cast<uint32_t>(share.idSize);
+    std::memcpy(record + SlotOffset, &share.slot, sizeof(share.slot));
+    std::memcpy(record + NonceOffset, &share.blob[Job::NonceOffset], sizeof(Job::Nonce));
+    std::memcpy(record + IdSizeOffset, &idSize, sizeof(idSize));
+    std::memcpy(record + IdOffset, &share.id[0], share.idSize);
+    std::memcpy(record + HashOffset, &share.hash[0], share.hash.size());
+  }
+};
+
+static_assert(ShareRecord::HashOffset + RANDOMX_HASH_SIZE <= ShareRecord::Size, "share record fields overflow");
@@ -0,0 +1,566 @@
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cache.h"
+#include "job.h"
+#include "miner.h"
+#include "target.h"
+#include "trace.h"
+#include "utils.h"
+#include "vm.h"
+
+namespace
+{
+  // Sample 76-byte hashing blob, the nonce at Job::NonceOffset is overwritten by the hashers
+  constexpr const char DefaultBlob[] =
+    "0707f7a4f0d605b303260816ba3f10902e1a145ac5fad3aa3af6ea44c11869dc4f853f002b2eea0000000077b206a02ca5b1d4ce6bbfdf"
+    "0acac38bded34d2dcdeef95cd20cefc12f61d56109";
+
+  class CountingSink : public ShareSink
+  {
+  public:
+    CountingSink()
+      : m_shares(0)
+      , m_exhausted(0)
+    {
+    }
+
+    void deliver(const Share *shares, size_t count) override
+    {
+      for (size_t index = 0; index < count; ++index)
+      {
+        ++(shares[index].exhausted ? m_exhausted : m_shares);
+      }
+    }
+
+    uint64_t shares() const
+    {
+      return m_shares;
+    }
+
+    uint64_t exhausted() const
+    {
+      return m_exhausted;
+    }
+
+  private:
+    std::atomic<uint64_t> m_shares;
+    std::atomic<uint64_t> m_exhausted;
+  };
+
+  enum HugePagesMode
+  {
+    HugePagesOff,
+    HugePagesOn,
+    // Runs the measurement without and then with huge pages
+    HugePagesCompare,
+  };
+
+  struct Options
+  {
+    size_t threads = 0;
+    // Thread count switched to after the warmup, 0 keeps the initial one
+    size_t resize = 0;
+    // The job is published to this many slots, slot i weighted i + 1
+    size_t slots = 1;
+    double warmupSeconds = 10;
+    double seconds = 30;
+    bool fastMode = false;
+    bool affinity = true;
+    HugePagesMode hugePages = HugePagesOff;
+    bool calibration = false;
+    std::string flagsCache;
+    std::string cacheStore;
+    double cpuLoad = 1.0;
+    NonceSpace nonceSpace;
+    // Chrome trace written after the run, needs a MINER_TRACE build
+    std::string traceFile;
+    bool verify = false;
+    Regulator::Mode throttleMode = Regulator::DutyCycle;
+    // Paused this long after the measurement, once keeping the memory and once releasing it, 0 skips it
+    double pauseSeconds = 0;
+    // One thread hashing one nonce at a time and then pipelined, instead of the miner run
+    bool pipelineCompare = false;
+    // Runs once with each throttle mode at the same --cpu-load
+    bool throttleCompare = false;
+  };
+
+  struct RunResult
+  {
+    double hashrate;
+    double hashesPerCpuSecond;
+  };
+
+  void usage(const char *name)
+  {
+    std::fprintf(
+      stderr,
+      "usage: %s [--threads N] [--seed HEX] [--blob HEX] [--difficulty D] [--warmup SECONDS] [--seconds SECONDS] "
+      "[--cpu-load FRACTION] [--throttle duty|park|compare] [--fast] [--resize N] [--no-affinity] "
+      "[--huge-pages on|off|compare] [--calibration] [--flags-cache FILE] "
+      "[--cache-store DIR] [--slots N] [--nonce-mask HEX] [--nonce-part INDEX/COUNT] "
+      "[--trace FILE] [--verify] [--pause SECONDS] [--pipeline compare]\n",
+      name);
+  }
+
+  // H/s of one VM on the job's blob for the given time, with or without keeping the next nonce queued
+  double hashLoop(Vm &vm, const Job &job, double seconds, bool pipelined)
+  {
+    Job blob(job);
+    std::array<uint8_t, RANDOMX_HASH_SIZE> result;
+    Job::Nonce nonce = 0;
+    uint64_t hashes = 0;
+    const auto started = std::chrono::steady_clock::now();
+    const auto deadline = started + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                      std::chrono::duration<double>(seconds));
+    if (pipelined)
+    {
+      blob.nonceSet(nonce++);
+      vm.hashFirst(blob.blob(), blob.blobSize());
+    }
+    while (std::chrono::steady_clock::now() < deadline)
+    {
+      blob.nonceSet(nonce++);
+      if (pipelined)
+      {
+        vm.hashNext(blob.blob(), blob.blobSize(), &result);
+      }
+      else
+      {
+        vm.hash(blob.blob(), blob.blobSize(), &result);
+      }
+      ++hashes;
+    }
+    if (pipelined)
+    {
+      vm.hashLast(&result);
+      ++hashes;
+    }
+    return hashes / std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+  }
+
+  // The gain of randomx_calculate_hash_first/next/last over one hash at a time, on the same VM and thread
+  int comparePipeline(const Options &options, const Job &job)
+  {
+    const randomx_flags flags = static_cast<randomx_flags>(
+      randomx_get_flags() | (options.hugePages == HugePagesOn ? RANDOMX_FLAG_LARGE_PAGES : RANDOMX_FLAG_DEFAULT));
+    const std::shared_ptr<const Cache> cache = std::make_shared<const Cache>(flags, job.seedHash());
+    Vm vm(flags, cache, nullptr);
+
+    hashLoop(vm, job, options.warmupSeconds, true);
+    const double sequential = hashLoop(vm, job, options.seconds, false);
+    const double pipelined = hashLoop(vm, job, options.seconds, true);
+    std::printf(
+      "pipelined: %.2f H/s, one at a time: %.2f H/s, %+.1f%%\n",
+      pipelined,
+      sequential,
+      sequential > 0 ? (pipelined / sequential - 1) * 100 : 0.0);
+    return 0;
+  }
+
+  // Prints the report for one run, returns the total H/s and H/CPU-s over the measurement
+  RunResult run(const Options &options, const Job &job)
+  {
+    CountingSink sink;
+    Miner miner(sink, options.threads);
+    miner.setFastMode(options.fastMode);
+    miner.setAffinity(options.affinity);
+    miner.setCalibration(options.calibration, options.flagsCache);
+    miner.setCacheStore(options.cacheStore);
+    miner.setHugePages(options.hugePages == HugePagesOn);
+    miner.setThrottleMode(options.throttleMode);
+    miner.setNonceSpace(options.nonceSpace);
+    miner.setVerification(options.verify);
+    const double appliedLoad = miner.setCpuLoad(options.cpuLoad);
+
+    const auto started = std::chrono::steady_clock::now();
+    for (size_t slot = 0; slot < options.slots; ++slot)
+    {
+      miner.setWeight(slot, slot + 1.0);
+      miner.setJob(slot, job);
+    }
+
+    while (miner.startupTime() < 0)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    const double startupSeconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    std::printf(
+      "threads %zu, %s mode, startup %.3f s, rss %.1f MiB\n",
+      miner.threads(),
+      miner.fastModeActive() ? "fast" : "light",
+      startupSeconds,
+      residentMemory() / (1024.0 * 1024.0));
+    randomx_flags flags;
+    bool loaded;
+    std::vector<Calibration::Trial> trials;
+    if (miner.calibration().result(&flags, &loaded, &trials))
+    {
+      std::printf("randomx flags: %s%s\n", Calibration::name(flags).c_str(), loaded ? " (cached)" : "");
+      for (const Calibration::Trial &trial : trials)
+      {
+        std::printf("  %s: %.2f H/s\n", Calibration::name(trial.flags).c_str(), trial.hashrate);
+      }
+    }
+    MemoryPages pages;
+    if (miner.pages(&pages))
+    {
+      std::printf(
+        "pages: cache %s, dataset %s, scratchpads %zu/%zu huge\n",
+        Pages::name(pages.cache),
+        miner.fastModeActive() ? Pages::name(pages.dataset) : "none",
+        pages.hugeScratchpads,
+        pages.scratchpads);
+    }
+    if (options.affinity)
+    {
+      std::printf("topology suggests %zu threads, placement", miner.topology().threads());
+      for (size_t index = 0; index < miner.threads(); ++index)
+      {
+        std::printf(" %d", miner.topology().cpu(index));
+      }
+      std::printf("\n");
+    }
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(options.warmupSeconds));
+    if (options.resize != 0)
+    {
+      std::printf("resized to %zu threads\n", miner.setThreads(options.resize));
+    }
+
+    const std::vector<uint64_t> before = miner.threadHashes();
+    const double cpuBefore = miner.stats().cpuSeconds;
+    const auto measureStarted = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::duration<double>(options.seconds));
+    const std::vector<uint64_t> after = miner.threadHashes();
+    const double cpuAfter = miner.stats().cpuSeconds;
+    const double elapsed =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - measureStarted).count();
+
+    double total = 0;
+    for (size_t index = 0; index < after.size(); ++index)
+    {
+      const double hashrate = (after[index] - (index < before.size() ? before[index] : 0)) / elapsed;
+      total += hashrate;
+      std::printf("thread %zu: %.2f H/s\n", index, hashrate);
+    }
+    const HashrateStats stats = miner.stats();
+    std::printf(
+      "total: %.2f H/s, shares %llu, nonce space exhausted %llu times\n",
+      total,
+      static_cast<unsigned long long>(sink.shares()),
+      static_cast<unsigned long long>(sink.exhausted()));
+    // Compare throttle modes by H/s per CPU-second at the same --cpu-load
+    const double cpuUsed = (cpuAfter - cpuBefore) / elapsed / std::max(std::thread::hardware_concurrency(), 1u);
+    const double perCpuSecond = cpuAfter > cpuBefore ? total * elapsed / (cpuAfter - cpuBefore) : 0.0;
+    std::printf(
+      "cpu load: requested %.2f, applied %.2f, measured %.2f, %.2f H/CPU-s\n",
+      options.cpuLoad,
+      appliedLoad,
+      cpuUsed,
+      perCpuSecond);
+    std::printf(
+      "latency p50 %.3f ms, p90 %.3f ms, p99 %.3f ms\n", stats.latencyP50, stats.latencyP90, stats.latencyP99);
+    if (options.verify)
+    {
+      const std::vector<ThreadHealth> health = miner.threadHealth();
+      for (size_t index = 0; index < health.size(); ++index)
+      {
+        std::printf(
+          "thread %zu: %llu shares verified, %llu hardware errors%s\n",
+          index,
+          static_cast<unsigned long long>(health[index].verified),
+          static_cast<unsigned long long>(health[index].errors),
+          health[index].failed ? ", failed" : health[index].quarantined ? ", quarantined" : "");
+      }
+    }
+    if (options.slots > 1)
+    {
+      const std::vector<SlotStats> slots = miner.slotStats();
+      for (size_t slot = 0; slot < slots.size(); ++slot)
+      {
+        std::printf(
+          "slot %zu: weight %.1f, %zu threads, %.2f H/s, shares %llu\n",
+          slot,
+          slots[slot].weight,
+          slots[slot].threads,
+          slots[slot].hashrate,
+          static_cast<unsigned long long>(slots[slot].shares));
+      }
+    }
+
+    for (const bool release : {false, true})
+    {
+      if (options.pauseSeconds <= 0)
+      {
+        break;
+      }
+      miner.setIdleTimeout(release ? 0 : -1);
+      miner.pause();
+      std::this_thread::sleep_for(std::chrono::duration<double>(options.pauseSeconds));
+      const size_t resident = residentMemory();
+      miner.resume();
+      while (miner.resumeLatency() < 0)
+      {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      std::printf(
+        "resumed with memory %s: first hash after %.3f ms, %.1f MiB resident while paused\n",
+        release ? "released" : "kept",
+        miner.resumeLatency(),
+        resident / (1024.0 * 1024.0));
+    }
+
+    miner.stop();
+    if (!options.traceFile.empty())
+    {
+      const bool written = Trace::write(options.traceFile);
+      std::printf("trace: %s\n", written ? options.traceFile.c_str() : "not written, build with MINER_TRACE");
+    }
+    return {total, perCpuSecond};
+  }
+} // namespace
+
+int main(int argc, char *argv[])
+{
+  Options options;
+  std::string seedHex(RANDOMX_HASH_SIZE * 2, '0');
+  std::string blobHex = DefaultBlob;
+  uint64_t difficulty = 1000000;
+
+  for (int index = 1; index < argc; ++index)
+  {
+    const std::string arg = argv[index];
+    const bool hasValue = index + 1 < argc;
+    if (arg == "--threads" && hasValue)
+    {
+      options.threads = std::strtoul(argv[++index], nullptr, 10);
+    }
+    else if (arg == "--resize" && hasValue)
+    {
+      options.resize = std::strtoul(argv[++index], nullptr, 10);
+    }
+    else if (arg == "--slots" && hasValue)
+    {
+      options.slots = std::min<size_t>(std::max<size_t>(std::strtoul(argv[++index], nullptr, 10), 1), Miner::MaxSlots);
+    }
+    else if (arg == "--verify")
+    {
+      options.verify = true;
+    }
+    else if (arg == "--pause" && hasValue)
+    {
+      options.pauseSeconds = std::strtod(argv[++index], nullptr);
+    }
+    else if (arg == "--trace" && hasValue)
+    {
+      options.traceFile = argv[++index];
+    }
+    else if (arg == "--nonce-mask" && hasValue)
+    {
+      options.nonceSpace.mask = static_cast<Job::Nonce>(std::strtoul(argv[++index], nullptr, 16));
+    }
+    else if (arg == "--nonce-part" && hasValue)
+    {
+      char *count;
+      options.nonceSpace.index = std::strtoul(argv[++index], &count, 10);
+      options.nonceSpace.count = *count == '/' ? std::strtoul(count + 1, nullptr, 10) : 0;
+    }
+    else if (arg == "--seed" && hasValue)
+    {
+      seedHex = argv[++index];
+    }
+    else if (arg == "--blob" && hasValue)
+    {
+      blobHex = argv[++index];
+    }
+    else if (arg == "--difficulty" && hasValue)
+    {
+      difficulty = std::strtoull(argv[++index], nullptr, 10);
+    }
+    else if (arg == "--warmup" && hasValue)
+    {
+      options.warmupSeconds = std::strtod(argv[++index], nullptr);
+    }
+    else if (arg == "--seconds" && hasValue)
+    {
+      options.seconds = std::strtod(argv[++index], nullptr);
+    }
+    else if (arg == "--cpu-load" && hasValue)
+    {
+      options.cpuLoad = std::strtod(argv[++index], nullptr);
+    }
+    else if (arg == "--throttle" && hasValue)
+    {
+      const std::string mode = argv[++index];
+      if (mode == "duty")
+      {
+        options.throttleMode = Regulator::DutyCycle;
+      }
+      else if (mode == "park")
+      {
+        options.throttleMode = Regulator::Park;
+      }
+      else if (mode == "compare")
+      {
+        options.throttleCompare = true;
+      }
+      else
+      {
+        usage(argv[0]);
+        return 1;
+      }
+    }
+    else if (arg == "--fast")
+    {
+      options.fastMode = true;
+    }
+    else if (arg == "--no-affinity")
+    {
+      options.affinity = false;
+    }
+    else if (arg == "--calibration")
+    {
+      options.calibration = true;
+    }
+    else if (arg == "--flags-cache" && hasValue)
+    {
+      options.flagsCache = argv[++index];
+    }
+    else if (arg == "--cache-store" && hasValue)
+    {
+      options.cacheStore = argv[++index];
+    }
+    else if (arg == "--pipeline" && hasValue && std::string(argv[index + 1]) == "compare")
+    {
+      ++index;
+      options.pipelineCompare = true;
+    }
+    else if (arg == "--huge-pages" && hasValue)
+    {
+      const std::string mode = argv[++index];
+      if (mode == "on")
+      {
+        options.hugePages = HugePagesOn;
+      }
+      else if (mode == "off")
+      {
+        options.hugePages = HugePagesOff;
+      }
+      else if (mode == "compare")
+      {
+        options.hugePages = HugePagesCompare;
+      }
+      else
+      {
+        usage(argv[0]);
+        return 1;
+      }
+    }
+    else
+    {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  std::vector<uint8_t> seedBytes;
+  std::vector<uint8_t> blobBytes;
+  if (!hexToBuffer(seedHex, &seedBytes) || !Job::validateSeedHash(seedBytes))
+  {
+    std::fprintf(stderr, "invalid seed hash\n");
+    return 1;
+  }
+  if (!hexToBuffer(blobHex, &blobBytes) || !Job::validateBlob(blobBytes))
+  {
+    std::fprintf(stderr, "invalid blob\n");
+    return 1;
+  }
+  if (difficulty == 0 || options.seconds <= 0 || !options.nonceSpace.valid())
+  {
+    usage(argv[0]);
+    return 1;
+  }
+  Job::SeedHash seedHash;
+  std::copy(seedBytes.begin(), seedBytes.end(), seedHash.begin());
+
+  const Job job("bench", blobBytes, seedHash, 0, Target::fromDifficulty(difficulty));
+
+  if (options.pipelineCompare)
+  {
+    return comparePipeline(options, job);
+  }
+
+  if (options.throttleCompare)
+  {
+    options.throttleMode = Regulator::DutyCycle;
+    const RunResult duty = run(options, job);
+    options.throttleMode = Regulator::Park;
+    const RunResult park = run(options, job);
+    std::printf(
+      "duty cycle: %.2f H/s, %.2f H/CPU-s, park: %.2f H/s, %.2f H/CPU-s, %+.1f%% H/CPU-s\n",
+      duty.hashrate,
+      duty.hashesPerCpuSecond,
+      park.hashrate,
+      park.hashesPerCpuSecond,
+      duty.hashesPerCpuSecond > 0 ? (park.hashesPerCpuSecond / duty.hashesPerCpuSecond - 1) * 100 : 0.0);
+    return 0;
+  }
+
+  if (options.hugePages != HugePagesCompare)
+  {
+    run(options, job);
+    return 0;
+  }
+
+  options.hugePages = HugePagesOff;
+  const double regular = run(options, job).hashrate;
+  options.hugePages = HugePagesOn;
+  const double huge = run(options, job).hashrate;
+  std::printf(
+    "huge pages: %.2f H/s, regular pages: %.2f H/s, %+.1f%%\n",
+    huge,
+    regular,
+    regular > 0 ? (huge / regular - 1) * 100 : 0.0);
+  return 0;
+}
@@ -0,0 +1,838 @@
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "miner.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+Miner::Miner(ShareSink &sink, size_t threads)
+  : m_sink(sink)
+  , m_threads(threads)
+  , m_router(sink)
+  , m_verifier(m_router, [this](uint32_t thread, bool valid) {
+    recordVerification(thread, valid);
+  })
+  , m_cpuLoadModifier(0.5)
+  , m_throttleMode(Regulator::DutyCycle)
+  , m_fastMode(false)
+  , m_fastModeActive(false)
+  , m_affinity(true)
+  , m_paused(false)
+  , m_memoryReleased(false)
+  , m_idleTimeoutMs(IdleTimeoutMs)
+  , m_pauses(0)
+  , m_resumedNs(-1)
+  , m_monitor([this](std::vector<uint64_t> *hashes) {
+    *hashes = threadHashes();
+    quarantineFailed();
+  })
+  , m_slotMonitor([this](std::vector<uint64_t> *hashes) {
+    *hashes = slotHashes();
+  })
+  , m_epochs(m_calibration, [this]() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    publishPendingJob();
+  })
+{
+  if (m_threads == 0)
+  {
+    m_threads = m_topology.threads();
+  }
+  if (m_threads == 0)
+  {
+    m_threads = std::max(std::thread::hardware_concurrency() / Hasher::MaxCpuCoresDivisor, 1u);
+  }
+  for (size_t index = 0; index < m_threads; ++index)
+  {
+    m_hashrates.emplace_back(new Hashrate());
+  }
+}
+
+Miner::~Miner()
+{
+  stop();
+}
+
+void Miner::setJob(const Job &job)
+{
+  setJob(0, job);
+}
+
+bool Miner::setJob(uint32_t id, const Job &job)
+{
+  if (id >= MaxSlots)
+  {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  slot(id).pendingJob.reset(new Job(job));
+  publishPendingJob();
+  return true;
+}
+
+bool Miner::setWeight(uint32_t id, double weight)
+{
+  if (id >= MaxSlots || !(weight >= 0))
+  {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  slot(id).weight = weight;
+  schedule();
+  return true;
+}
+
+void Miner::removeJob(uint32_t id)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  if (id >= m_slots.size())
+  {
+    return;
+  }
+  m_slots[id].pendingJob.reset();
+  // Its hashers drop the job on their next update, scheduling then moves them off the slot
+  m_slots[id].jobSlot->clear();
+  schedule();
+}
+
+void Miner::prepare(const Cache::SeedHash &seedHash)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  // Released memory stays released until the pause is over
+  if (!m_memoryReleased)
+  {
+    m_epochs.prepare(seedHash, m_fastMode);
+  }
+}
+
+void Miner::stop()
+{
+  std::unique_ptr<ShareDelivery> shareDelivery;
+  std::thread releaser;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_hashers.clear();
+    m_assignment.clear();
+    shareDelivery = std::move(m_shareDelivery);
+    for (Slot &slot : m_slots)
+    {
+      slot.jobSlot->clear();
+      slot.pendingJob.reset();
+    }
+    m_epochs.clear();
+    m_paused = false;
+    m_memoryReleased = false;
+    releaser = std::move(m_releaser);
+  }
+  m_pauseChanged.notify_all();
+  // Joined without the mutex, verification results lock it on the delivery thread and the releaser needs it to
+  // return
+  shareDelivery.reset();
+  if (releaser.joinable())
+  {
+    releaser.join();
+  }
+}
+
+void Miner::pause()
+{
+  std::thread releaser;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_paused)
+    {
+      return;
+    }
+    m_paused = true;
+    m_pausedAt = std::chrono::steady_clock::now();
+    const uint64_t pause = ++m_pauses;
+    for (const auto &hasher : m_hashers)
+    {
+      hasher->pause();
+    }
+    releaser = std::move(m_releaser);
+    m_releaser = std::thread([this, pause]() {
+      releaseWhenIdle(pause);
+    });
+  }
+  // The releaser of the previous pause has seen it end and only waits for the mutex
+  if (releaser.joinable())
+  {
+    releaser.join();
+  }
+}
+
+void Miner::resume()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!m_paused)
+    {
+      return;
+    }
+    m_paused = false;
+    m_resumedNs =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+    if (m_memoryReleased)
+    {
+      m_memoryReleased = false;
+      publishPendingJob();
+    }
+    else
+    {
+      for (const auto &hasher : m_hashers)
+      {
+        hasher->resume();
+      }
+    }
+  }
+  m_pauseChanged.notify_all();
+}
+
+bool Miner::paused() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  return m_paused;
+}
+
+void Miner::setIdleTimeout(int64_t milliseconds)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_idleTimeoutMs = milliseconds;
+  }
+  m_pauseChanged.notify_all();
+}
+
+double Miner::resumeLatency() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  if (m_paused || m_resumedNs < 0)
+  {
+    return -1;
+  }
+  int64_t first = -1;
+  for (size_t index : active())
+  {
+    const int64_t resumed = index < m_hashers.size() ? m_hashers[index]->resumedTime() : -1;
+    if (resumed >= 0 && (first < 0 || resumed < first))
+    {
+      first = resumed;
+    }
+  }
+  return first < 0 ? -1 : (first - m_resumedNs) / 1e6;
+}
+
+double Miner::setCpuLoad(double modifier)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  m_cpuLoadModifier = modifier;
+  return applyCpuLoad();
+}
+
+double Miner::cpuLoad() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  return m_cpuLoadModifier;
+}
+
+void Miner::setThrottleMode(Regulator::Mode mode)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  m_throttleMode = mode;
+  applyCpuLoad();
+}
+
+void Miner::setFastMode(bool enabled)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  m_fastMode = enabled;
+}
+
+void Miner::setHugePages(bool enabled)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  m_epochs.setHugePages(enabled);
+}
+
+void Miner::setCalibration(bool enabled, const std::string &file)
+{
+  m_calibration.configure(enabled, file);
+}
+
+void Miner::setCacheStore(const std::string &directory)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  m_epochs.setStore(directory.empty() ? nullptr : std::make_shared<const CacheStore>(directory));
+}
+
+void Miner::setVerification(bool enabled)
+{
+  m_verifier.setEnabled(enabled);
+}
+
+std::vector<ThreadHealth> Miner::threadHealth() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  return m_health;
+}
+
+bool Miner::setNonceSpace(const NonceSpace &space)
+{
+  if (!space.valid())
+  {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  m_nonceSpace = space;
+  return true;
+}
+
+bool Miner::setSlotSink(uint32_t slot, ShareSink *sink)
+{
+  if (slot >= MaxSlots)
+  {
+    return false;
+  }
+  m_router.setSink(slot, sink);
+  return true;
+}
+
+void Miner::setAffinity(bool enabled)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  m_affinity = enabled;
+}
+
+bool Miner::fastModeActive() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  return m_fastModeActive;
+}
+
+size_t Miner::setThreads(size_t threads)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  threads = std::max<size_t>(threads, 1);
+  while (m_hashrates.size() < threads)
+  {
+    m_hashrates.emplace_back(new Hashrate());
+  }
+  if (threads != m_threads)
+  {
+    m_threads = threads;
+    schedule();
+  }
+
+  return m_threads;
+}
+
+size_t Miner::threads() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  return m_threads;
+}
+
+double Miner::hashrate() const
+{
+  HashrateStats stats;
+  m_monitor.stats(&stats);
+  return stats.total[HashrateStats::Window10s];
+}
+
+HashrateStats Miner::stats() const
+{
+  HashrateStats stats;
+  m_monitor.stats(&stats);
+
+  std::array<uint64_t, Hashrate::LatencyBuckets> latency{};
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (const auto &hashrate : m_hashrates)
+    {
+      hashrate->addLatency(&latency);
+    }
+  }
+  stats.latencyP50 = Hashrate::percentile(latency, 0.50) / 1000;
+  stats.latencyP90 = Hashrate::percentile(latency, 0.90) / 1000;
+  stats.latencyP99 = Hashrate::percentile(latency, 0.99) / 1000;
+  return stats;
+}
+
+std::vector<uint64_t> Miner::threadHashes() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  std::vector<uint64_t> result;
+  for (const auto &hashrate : m_hashrates)
+  {
+    result.push_back(hashrate->hashes());
+  }
+  return result;
+}
+
+std::vector<SlotStats> Miner::slotStats() const
+{
+  HashrateStats stats;
+  m_slotMonitor.stats(&stats);
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  std::vector<SlotStats> result;
+  for (size_t id = 0; id < m_slots.size(); ++id)
+  {
+    const Slot &slot = m_slots[id];
+    SlotStats slotStats;
+    slotStats.active = slot.jobSlot->current() != nullptr || slot.pendingJob;
+    slotStats.weight = slot.weight;
+    slotStats.threads = std::count(m_assignment.begin(), m_assignment.end(), static_cast<int>(id));
+    slotStats.hashes = slot.jobSlot->hashes();
+    slotStats.shares = slot.jobSlot->shares();
+    slotStats.hashrate = id < stats.threads.size() ? stats.threads[id][HashrateStats::Window10s] : 0;
+    result.push_back(slotStats);
+  }
+  return result;
+}
+
+std::vector<uint64_t> Miner::slotHashes() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  std::vector<uint64_t> result;
+  for (const Slot &slot : m_slots)
+  {
+    result.push_back(slot.jobSlot->hashes());
+  }
+  return result;
+}
+
+const Topology &Miner::topology() const
+{
+  return m_topology;
+}
+
+bool Miner::pages(MemoryPages *pages) const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  // Publishing only happens under the mutex, so the current state stays alive while it is held. Slots on
+  // another seed may use other pages, the first slot with a job stands for all of them.
+  const JobSlot::State *state = nullptr;
+  for (const Slot &slot : m_slots)
+  {
+    if ((state = slot.jobSlot->current()) != nullptr)
+    {
+      break;
+    }
+  }
+  if (state == nullptr)
+  {
+    return false;
+  }
+  pages->cache = state->cache->pages();
+  pages->dataset = state->dataset ? state->dataset->pages() : Pages::Regular;
+  pages->hugeScratchpads = 0;
+  pages->scratchpads = 0;
+  for (size_t index : active())
+  {
+    Pages::Kind kind;
+    if (index < m_hashers.size() && m_hashers[index]->pages(&kind))
+    {
+      pages->hugeScratchpads += kind == Pages::Huge;
+      ++pages->scratchpads;
+    }
+  }
+  return true;
+}
+
+const Calibration &Miner::calibration() const
+{
+  return m_calibration;
+}
+
+int64_t Miner::startupTime() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  int64_t slowest = -1;
+  for (size_t index : active())
+  {
+    if (index >= m_hashers.size())
+    {
+      continue;
+    }
+    const int64_t startupTime = m_hashers[index]->startupTime();
+    if (startupTime < 0)
+    {
+      return -1;
+    }
+    slowest = std::max(slowest, startupTime);
+  }
+  return slowest;
+}
+
+uint64_t Miner::sharesFound() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  // The queue also carries exhaustion notices, the slots count shares only
+  uint64_t found = 0;
+  for (const Slot &slot : m_slots)
+  {
+    found += slot.jobSlot->shares();
+  }
+  return found;
+}
+
+uint64_t Miner::sharesDropped() const
+{
+  return m_shareQueue.dropped();
+}
+
+// Must be called with the mutex held, creates the slot and the ones before it if needed
+Miner::Slot &Miner::slot(uint32_t id)
+{
+  while (m_slots.size() <= id)
+  {
+    m_slots.push_back({std::unique_ptr<JobSlot>(new JobSlot(m_slots.size())), nullptr, 1.0});
+  }
+  return m_slots[id];
+}
+
+// Hands the pending jobs to the hashers once their epochs are ready, until then they keep hashing the previous
+// ones. Must be called with the mutex held.
+void Miner::publishPendingJob()
+{
+  if (m_memoryReleased)
+  {
+    return;
+  }
+
+  bool published = false;
+  for (Slot &slot : m_slots)
+  {
+    if (!slot.pendingJob)
+    {
+      continue;
+    }
+
+    Epoch epoch;
+    if (!m_epochs.find(slot.pendingJob->seedHash(), m_fastMode, &epoch))
+    {
+      m_epochs.prepare(slot.pendingJob->seedHash(), m_fastMode);
+      continue;
+    }
+
+    slot.jobSlot->publish(*slot.pendingJob, epoch.cache, epoch.dataset, m_nonceSpace);
+    slot.pendingJob.reset();
+    m_fastModeActive = epoch.dataset != nullptr;
+    published = true;
+  }
+  if (!published)
+  {
+    return;
+  }
+
+  if (!m_shareDelivery)
+  {
+    m_shareDelivery.reset(new ShareDelivery(m_shareQueue, m_verifier));
+  }
+  // A new job on a slot that already has threads is picked up by them, only a slot that just got its first
+  // job changes the assignment
+  schedule();
+  m_monitor.start();
+  m_slotMonitor.start();
+}
+
+// Indices of the m_threads hashers outside quarantine, including ones not created yet. Must be called with the
+// mutex held.
+std::vector<size_t> Miner::active() const
+{
+  std::vector<size_t> result;
+  for (size_t index = 0; result.size() < m_threads; ++index)
+  {
+    if (index >= m_health.size() || !m_health[index].quarantined)
+    {
+      result.push_back(index);
+    }
+  }
+  return result;
+}
+
+// Counts the verification result of a share from the given hasher and quarantines it once it computed too many
+// wrong hashes, a replacement starts on the next core in the topology order
+void Miner::recordVerification(uint32_t thread, bool valid)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  if (m_health.size() <= thread)
+  {
+    m_health.resize(thread + 1, ThreadHealth{0, 0, false, false});
+  }
+  ThreadHealth &health = m_health[thread];
+  ++health.verified;
+  health.errors += valid ? 0 : 1;
+  if (health.errors >= QuarantineErrors && !health.quarantined)
+  {
+    health.quarantined = true;
+    schedule();
+  }
+}
+
+// Quarantines the hashers whose thread stopped on an error like recordVerification does, checked once per
+// hashrate sample so their share of the threads moves on within a second
+void Miner::quarantineFailed()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  bool changed = false;
+  for (size_t index = 0; index < m_hashers.size(); ++index)
+  {
+    if (!m_hashers[index]->failed() || (index < m_health.size() && m_health[index].quarantined))
+    {
+      continue;
+    }
+    if (m_health.size() <= index)
+    {
+      m_health.resize(index + 1, ThreadHealth{0, 0, false, false});
+    }
+    m_health[index].quarantined = true;
+    m_health[index].failed = true;
+    changed = true;
+  }
+  if (changed)
+  {
+    schedule();
+  }
+}
+
+// Splits the threads across the slots with a job by weight. Hashers stay on their slot where the split allows it,
+// the rest move after their hash in flight. Must be called with the mutex held.
+void Miner::schedule()
+{
+  std::vector<size_t> ready;
+  double totalWeight = 0;
+  for (size_t id = 0; id < m_slots.size(); ++id)
+  {
+    if (m_slots[id].weight > 0 && m_slots[id].jobSlot->current() != nullptr)
+    {
+      ready.push_back(id);
+      totalWeight += m_slots[id].weight;
+    }
+  }
+
+  // Largest remainder, ties go to the lower slot id. With fewer threads than slots the lightest ones get none.
+  std::vector<size_t> counts(m_slots.size(), 0);
+  std::vector<std::pair<double, size_t>> remainders;
+  size_t assigned = 0;
+  for (size_t id : ready)
+  {
+    const double share = m_threads * m_slots[id].weight / totalWeight;
+    counts[id] = static_cast<size_t>(std::floor(share));
+    assigned += counts[id];
+    remainders.emplace_back(share - counts[id], id);
+  }
+  std::stable_sort(remainders.begin(), remainders.end(), [](const std::pair<double, size_t> &left,
+                                                            const std::pair<double, size_t> &right) {
+    return left.first > right.first;
+  });
+  for (size_t index = 0; assigned < m_threads && index < remainders.size(); ++index, ++assigned)
+  {
+    ++counts[remainders[index].second];
+  }
+
+  // Quarantined hashers stay out, the ones after them take their place
+  const std::vector<size_t> hashers = active();
+  while (m_hashrates.size() <= hashers.back())
+  {
+    m_hashrates.emplace_back(new Hashrate());
+  }
+  std::vector<int> assignment(std::max(hashers.back() + 1, m_assignment.size()), -1);
+  for (size_t index : hashers)
+  {
+    const int id = index < m_assignment.size() ? m_assignment[index] : -1;
+    if (id >= 0 && counts[id] > 0)
+    {
+      assignment[index] = id;
+      --counts[id];
+    }
+  }
+  size_t next = 0;
+  for (size_t index : hashers)
+  {
+    while (next < counts.size() && counts[next] == 0)
+    {
+      ++next;
+    }
+    if (assignment[index] < 0 && next < counts.size())
+    {
+      assignment[index] = static_cast<int>(next);
+      --counts[next];
+    }
+  }
+
+  // Idle hashers keep their VMs, so growing back is as cheap as shrinking
+  for (size_t index = 0; index < assignment.size(); ++index)
+  {
+    const int id = assignment[index];
+    JobSlot *jobSlot = id >= 0 ? m_slots[id].jobSlot.get() : nullptr;
+    if (index >= m_hashers.size())
+    {
+      if (jobSlot != nullptr)
+      {
+        addHasher(jobSlot);
+      }
+    }
+    else if (index >= m_assignment.size() || m_assignment[index] != id)
+    {
+      m_hashers[index]->assign(jobSlot);
+    }
+  }
+  m_assignment = assignment;
+  m_assignment.resize(m_hashers.size(), -1);
+  applyCpuLoad();
+}
+
+// Must be called with the mutex held, the hasher takes the next free place in the topology order
+void Miner::addHasher(JobSlot *slot)
+{
+  const size_t index = m_hashers.size();
+  m_hashers.emplace_back(
+    new Hasher(index, slot, m_affinity ? m_topology.cpu(index) : -1, 1.0, m_shareQueue, *m_hashrates[index]));
+  if (m_paused)
+  {
+    m_hashers.back()->pause();
+  }
+  m_hashers.back()->start();
+}
+
+// Waits out the idle timeout of the given pause on the releaser thread, unless the pause ends first
+void Miner::releaseWhenIdle(uint64_t pause)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  while (m_paused && m_pauses == pause)
+  {
+    if (m_idleTimeoutMs < 0)
+    {
+      m_pauseChanged.wait(lock);
+      continue;
+    }
+    const auto deadline = m_pausedAt + std::chrono::milliseconds(m_idleTimeoutMs);
+    if (std::chrono::steady_clock::now() >= deadline)
+    {
+      releaseMemory();
+      return;
+    }
+    m_pauseChanged.wait_until(lock, deadline);
+  }
+}
+
+// Drops the hashers with their VMs and scratchpads, then the states and epochs holding the caches and datasets.
+// The jobs become pending again unless a newer one is already waiting. Must be called with the mutex held.
+void Miner::releaseMemory()
+{
+  // Parked hashers are released by their destructors, the slots can only drop their states once no reader is left
+  m_hashers.clear();
+  m_assignment.clear();
+  for (Slot &slot : m_slots)
+  {
+    std::unique_ptr<Job> job = slot.jobSlot->suspend();
+    if (!slot.pendingJob)
+    {
+      slot.pendingJob = std::move(job);
+    }
+  }
+  m_epochs.clear();
+  m_memoryReleased = true;
+}
+
+// Splits the CPU budget across the hashers, must be called with the mutex held
+double Miner::applyCpuLoad()
+{
+  const size_t cpuThreads = std::max(std::thread::hardware_concurrency(), 1u);
+  const double load = std::max(0.0, std::min(m_cpuLoadModifier, static_cast<double>(m_threads) / cpuThreads));
+  // Budget in units of whole hashing threads
+  const double budget = std::max(0.01, load * cpuThreads);
+
+  // Hashers left out idle on their own, a parked one would hold on to its job state
+  for (const auto &hasher : m_hashers)
+  {
+    hasher->setParked(false);
+  }
+  const std::vector<size_t> hashers = active();
+  for (size_t rank = 0; rank < hashers.size() && hashers[rank] < m_hashers.size(); ++rank)
+  {
+    Hasher &hasher = *m_hashers[hashers[rank]];
+    if (m_throttleMode == Regulator::DutyCycle)
+    {
+      hasher.setDuty(budget / m_threads);
+    }
+    else
+    {
+      // Whole threads run unthrottled, one more takes the fractional remainder and the rest are parked
+      const double duty = std::min(1.0, budget - rank);
+      hasher.setDuty(duty);
+      hasher.setParked(duty <= 0);
+    }
+  }
+
+  return budget / cpuThreads;
+}
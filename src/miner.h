@@ -0,0 +1,236 @@
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cache.h"
+#include "calibration.h"
+#include "delivery.h"
+#include "epochs.h"
+#include "hasher.h"
+#include "hashrate.h"
+#include "job.h"
+#include "jobslot.h"
+#include "nonces.h"
+#include "pages.h"
+#include "shares.h"
+#include "topology.h"
+#include "verifier.h"
+
+// Pages backing the RandomX memory of the current epoch
+struct MemoryPages
+{
+  Pages::Kind cache;
+  // Only meaningful in fast mode
+  Pages::Kind dataset;
+  size_t hugeScratchpads;
+  size_t scratchpads;
+};
+
+// Per job slot accounting, indexed by slot id
+struct SlotStats
+{
+  bool active;
+  double weight;
+  size_t threads;
+  uint64_t hashes;
+  uint64_t shares;
+  // H/s over the 10 second window
+  double hashrate;
+};
+
+// Verification results of one hasher
+struct ThreadHealth
+{
+  uint64_t verified;
+  // Shares whose hash didn't match the recomputation
+  uint64_t errors;
+  // Left out of scheduling for good, another core takes its place
+  bool quarantined;
+  // Quarantined because its thread stopped on an error, e.g. its VM could not be created
+  bool failed;
+};
+
+// Hashing engine without any JNI dependency, shares are handed to the ShareSink on a dedicated thread
+class Miner
+{
+public:
+  // threads == 0 takes the count the CPU topology suggests, half the hardware threads if the caches are unknown
+  Miner(ShareSink &sink, size_t threads = 0);
+  ~Miner();
+
+  Miner(const Miner &) = delete;
+  Miner &operator=(const Miner &) = delete;
+
+  // Hashers keep running the previous job until the epoch for the job's seed hash is ready. Without a slot the
+  // job goes to slot 0.
+  void setJob(const Job &job);
+  // Every slot with a job and a positive weight gets a share of the threads proportional to its weight, slots on
+  // the same seed share the epoch. Returns false if the slot id is out of range.
+  bool setJob(uint32_t slot, const Job &job);
+  // New slots start with a weight of 1
+  bool setWeight(uint32_t slot, double weight);
+  // Drops the slot's job and hands its threads to the remaining slots
+  void removeJob(uint32_t slot);
+  void prepare(const Cache::SeedHash &seedHash);
+  void stop();
+  // Parks every hasher after its hash in flight. VMs, scratchpads, caches and jobs stay resident until the pause
+  // outlasts the idle timeout, then they are released and resume() rebuilds them from the last jobs, continuing
+  // their nonces. Jobs set during the pause are picked up on resume.
+  void pause();
+  void resume();
+  bool paused() const;
+  // Negative keeps the memory for the whole pause, also applies to a pause in progress
+  void setIdleTimeout(int64_t milliseconds);
+  // Milliseconds from the last resume() to the first hash after it, -1 until then
+  double resumeLatency() const;
+
+  // Fraction of the whole CPU to use, returns the load actually applied given the number of threads
+  double setCpuLoad(double modifier);
+  // The modifier last passed to setCpuLoad
+  double cpuLoad() const;
+  void setThrottleMode(Regulator::Mode mode);
+  void setFastMode(bool enabled);
+  // Tries huge pages for the cache, the dataset and the scratchpads of epochs built from now on, off by default
+  void setHugePages(bool enabled);
+  // Picks the fastest RandomX flags on the first epoch build, off by default. The trials run on the epoch's own
+  // cache. The result is stored in file and reused while the CPU model stays the same, an empty file keeps it in
+  // memory only and repeats the trials on every start.
+  void setCalibration(bool enabled, const std::string &file);
+  // Keeps initialized caches in directory so a restart on the same seed skips Argon2, an empty one disables it
+  void setCacheStore(const std::string &directory);
+  // Recomputes every share on an interpreter VM before submitting it and drops the ones that don't match, off by
+  // default. A hasher with QuarantineErrors mismatches is quarantined.
+  void setVerification(bool enabled);
+  // Restricts the nonces of jobs published from now on, false if the space is empty
+  bool setNonceSpace(const NonceSpace &space);
+  // Shares of the slot go to sink instead of the one the miner was constructed with, nullptr switches back.
+  // The sink must stay alive until it has been replaced.
+  bool setSlotSink(uint32_t slot, ShareSink *sink);
+  // Pins hashers created from now on to the cores picked by the topology, on by default
+  void setAffinity(bool enabled);
+  bool fastModeActive() const;
+
+  // Grows or shrinks the set of hashing threads in place, returns the number applied
+  size_t setThreads(size_t threads);
+  size_t threads() const;
+  // Total over the 10 second window
+  double hashrate() const;
+  HashrateStats stats() const;
+  std::vector<uint64_t> threadHashes() const;
+  std::vector<SlotStats> slotStats() const;
+  // Indexed like threadHashes(), shorter if the last hashers had nothing verified yet
+  std::vector<ThreadHealth> threadHealth() const;
+  const Topology &topology() const;
+  const Calibration &calibration() const;
+  // False until a job is being hashed
+  bool pages(MemoryPages *pages) const;
+  int64_t startupTime() const;
+  uint64_t sharesFound() const;
+  uint64_t sharesDropped() const;
+
+  static constexpr const uint32_t MaxSlots = 8;
+  static constexpr const uint64_t QuarantineErrors = 2;
+  static constexpr const int64_t IdleTimeoutMs = 5 * 60 * 1000;
+
+private:
+  struct Slot
+  {
+    std::unique_ptr<JobSlot> jobSlot;
+    std::unique_ptr<Job> pendingJob;
+    double weight;
+  };
+
+  std::vector<uint64_t> slotHashes() const;
+  std::vector<size_t> active() const;
+  void recordVerification(uint32_t thread, bool valid);
+  void quarantineFailed();
+  Slot &slot(uint32_t id);
+  void publishPendingJob();
+  void schedule();
+  void addHasher(JobSlot *slot);
+  double applyCpuLoad();
+  void releaseWhenIdle(uint64_t pause);
+  void releaseMemory();
+
+private:
+  ShareSink &m_sink;
+  const Topology m_topology;
+  size_t m_threads;
+
+  mutable std::mutex m_mutex;
+  // Only ever grows, hashers keep pointers to the job slots
+  std::vector<Slot> m_slots;
+  ShareQueue m_shareQueue;
+  // Delivery thread -> verifier -> router -> per slot sinks or the sink
+  SlotRouter m_router;
+  ShareVerifier m_verifier;
+  std::unique_ptr<ShareDelivery> m_shareDelivery;
+  std::vector<std::unique_ptr<Hasher>> m_hashers;
+  // Indexed like the hashers but outlive them, so statistics survive a restart
+  std::vector<std::unique_ptr<Hashrate>> m_hashrates;
+  // Slot each hasher works for, -1 for an idle one
+  std::vector<int> m_assignment;
+  std::vector<ThreadHealth> m_health;
+
+  double m_cpuLoadModifier;
+  Regulator::Mode m_throttleMode;
+  bool m_fastMode;
+  bool m_fastModeActive;
+  bool m_affinity;
+  NonceSpace m_nonceSpace;
+
+  bool m_paused;
+  // Hashers, epochs and published states were dropped during the pause, the jobs wait as pending ones
+  bool m_memoryReleased;
+  int64_t m_idleTimeoutMs;
+  // Tells a releaser which pause it is waiting for
+  uint64_t m_pauses;
+  std::chrono::steady_clock::time_point m_pausedAt;
+  // Nanoseconds on the steady clock, -1 before the first resume
+  int64_t m_resumedNs;
+  std::condition_variable m_pauseChanged;
+  // Releases the memory once a pause outlasts the idle timeout
+  std::thread m_releaser;
+
+  HashrateMonitor m_monitor;
+  HashrateMonitor m_slotMonitor;
+  Calibration m_calibration;
+  // Last member, its worker calls back into the miner and must be joined before anything else goes away
+  Epochs m_epochs;
+};
@@ -0,0 +1,471 @@
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <randomx.h>
+
+#include "job.h"
+#include "json.h"
+#include "keccak.h"
+#include "socket.h"
+#include "utils.h"
+
+struct MockNodeStats
+{
+  uint64_t headers;
+  uint64_t templates;
+  uint64_t accepted;
+  // Blocks on a previous tip, malformed ones and ones whose proof of work misses the difficulty
+  uint64_t rejected;
+  // Milliseconds from each tip change to the first template served on top of it
+  std::vector<double> tipToTemplate;
+};
+
+// Stand-in for monerod's JSON-RPC on the loopback interface for host tools. Serves get_last_block_header,
+// get_block_template and submit_block over any number of kept alive connections. Templates follow the real block
+// layout with a RingCT coinbase. The hashing blobs are computed here independently of BlockTemplate, a submitted
+// block is accepted only if it matches a served template outside the reserved bytes and the nonce and its
+// RandomX hash over the merkle root of its own coinbase meets the difficulty. An accepted block becomes the new tip.
+class MockNode
+{
+public:
+  explicit MockNode(uint64_t difficulty)
+    : m_difficulty(difficulty)
+    , m_listener(-1)
+    , m_port(0)
+    , m_stopping(false)
+    , m_cache(nullptr)
+    , m_vm(nullptr)
+    , m_height(1)
+    , m_stats{0, 0, 0, 0, {}}
+  {
+    // Templates are served on the all zero seed hash
+    const uint8_t seedHash[RANDOMX_HASH_SIZE] = {};
+    m_cache = randomx_alloc_cache(randomx_get_flags());
+    if (m_cache != nullptr)
+    {
+      randomx_init_cache(m_cache, seedHash, sizeof(seedHash));
+      m_vm = randomx_create_vm(randomx_get_flags(), m_cache, nullptr);
+    }
+    if (m_vm == nullptr)
+    {
+      if (m_cache != nullptr)
+      {
+        randomx_release_cache(m_cache);
+      }
+      throw std::runtime_error("failed to create RandomX vm");
+    }
+
+    m_listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t size = sizeof(address);
+    if (m_listener < 0 || bind(m_listener, reinterpret_cast<sockaddr *>(&address), size) != 0 ||
+        listen(m_listener, 4) != 0 || getsockname(m_listener, reinterpret_cast<sockaddr *>(&address), &size) != 0)
+    {
+      if (m_listener >= 0)
+      {
+        ::close(m_listener);
+      }
+      randomx_destroy_vm(m_vm);
+      randomx_release_cache(m_cache);
+      throw std::runtime_error("failed to listen");
+    }
+    m_port = ntohs(address.sin_port);
+    advance();
+
+    m_thread = std::thread([this]() {
+      thread();
+    });
+  }
+
+  ~MockNode()
+  {
+    m_stopping = true;
+    m_wakeup.notify();
+    m_thread.join();
+    for (std::thread &connection : m_connections)
+    {
+      connection.join();
+    }
+    ::close(m_listener);
+    randomx_destroy_vm(m_vm);
+    randomx_release_cache(m_cache);
+  }
+
+  MockNode(const MockNode &) = delete;
+  MockNode &operator=(const MockNode &) = delete;
+
+  uint16_t port() const
+  {
+    return m_port;
+  }
+
+  // A block found elsewhere moves the tip
+  void advance()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    advance(lock);
+  }
+
+  // A transaction enters the mempool, templates from now on include it
+  void addTransaction()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const std::string seed = "tx" + std::to_string(m_height) + "." + std::to_string(m_mempool.size());
+    m_mempool.push_back(Keccak::hash(reinterpret_cast<const uint8_t *>(seed.data()), seed.size()));
+  }
+
+  MockNodeStats stats() const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    return m_stats;
+  }
+
+  // Transaction hash of a v2 coinbase from its prefix, its RingCT base of type null and the empty prunable part
+  static Keccak::Hash coinbaseHash(const uint8_t *prefix, size_t size)
+  {
+    const uint8_t rctTypeNull = 0;
+    std::array<Keccak::Hash, 3> parts = {{Keccak::hash(prefix, size), Keccak::hash(&rctTypeNull, 1), {}}};
+    return Keccak::hash(parts[0].data(), sizeof(parts));
+  }
+
+  // tree_hash from Monero's tree-hash.c, step by step
+  static Keccak::Hash merkleRoot(const std::vector<Keccak::Hash> &hashes)
+  {
+    if (hashes.size() == 1)
+    {
+      return hashes[0];
+    }
+    if (hashes.size() == 2)
+    {
+      return Keccak::hash(hashes[0], hashes[1]);
+    }
+    size_t count = 2;
+    while (count < hashes.size())
+    {
+      count <<= 1;
+    }
+    count >>= 1;
+    std::vector<Keccak::Hash> ints(hashes.begin(), hashes.begin() + (2 * count - hashes.size()));
+    for (size_t index = 2 * count - hashes.size(); ints.size() < count; index += 2)
+    {
+      ints.push_back(Keccak::hash(hashes[index], hashes[index + 1]));
+    }
+    while (count > 2)
+    {
+      count >>= 1;
+      for (size_t index = 0; index < count; ++index)
+      {
+        ints[index] = Keccak::hash(ints[2 * index], ints[2 * index + 1]);
+      }
+    }
+    return Keccak::hash(ints[0], ints[1]);
+  }
+
+  // Block header, merkle root and transaction count including the coinbase
+  static std::vector<uint8_t>
+  hashingBlob(const uint8_t *header, size_t headerSize, const std::vector<Keccak::Hash> &hashes)
+  {
+    std::vector<uint8_t> blob(header, header + headerSize);
+    const Keccak::Hash root = merkleRoot(hashes);
+    blob.insert(blob.end(), root.begin(), root.end());
+    varint(&blob, hashes.size());
+    return blob;
+  }
+
+  // Block id, the hash of the hashing blob prefixed with its size
+  static Keccak::Hash blockId(const std::vector<uint8_t> &hashingBlob)
+  {
+    std::vector<uint8_t> data;
+    varint(&data, hashingBlob.size());
+    data.insert(data.end(), hashingBlob.begin(), hashingBlob.end());
+    return Keccak::hash(&data[0], data.size());
+  }
+
+  // check_hash from Monero, the 256-bit little-endian hash times the difficulty must not overflow
+  static bool meetsDifficulty(const uint8_t *hash, uint64_t difficulty)
+  {
+    uint64_t carry = 0;
+    for (size_t offset = 0; offset < RANDOMX_HASH_SIZE; offset += sizeof(uint64_t))
+    {
+      uint64_t word;
+      std::memcpy(&word, hash + offset, sizeof(word));
+      const uint64_t low = (word & 0xffffffff) * (difficulty & 0xffffffff);
+      const uint64_t cross1 = (word >> 32) * (difficulty & 0xffffffff);
+      const uint64_t cross2 = (word & 0xffffffff) * (difficulty >> 32);
+      const uint64_t middle = (low >> 32) + (cross1 & 0xffffffff) + (cross2 & 0xffffffff);
+      const uint64_t productLow = (middle << 32) | (low & 0xffffffff);
+      const uint64_t productHigh =
+        (word >> 32) * (difficulty >> 32) + (cross1 >> 32) + (cross2 >> 32) + (middle >> 32);
+      const uint64_t sum = productLow + carry;
+      carry = productHigh + (sum < productLow ? 1 : 0);
+    }
+    return carry == 0;
+  }
+
+private:
+  void thread()
+  {
+    while (!m_stopping)
+    {
+      pollfd fds[] = {{m_listener, POLLIN, 0}, {m_wakeup.fd(), POLLIN, 0}};
+      if (poll(fds, 2, -1) <= 0 || fds[0].revents == 0)
+      {
+        continue;
+      }
+      const int fd = accept4(m_listener, nullptr, nullptr, SOCK_CLOEXEC);
+      if (fd >= 0)
+      {
+        m_connections.emplace_back([this, fd]() {
+          serve(Socket(fd));
+        });
+      }
+    }
+  }
+
+  // HTTP/1.1 with kept alive connections, until the client closes, stays quiet for a minute or the node stops
+  void serve(Socket socket)
+  {
+    std::string line;
+    while (socket.readLine(&line, 60 * 1000, m_wakeup) == Socket::Ready)
+    {
+      size_t length = 0;
+      while (socket.readLine(&line, 1000, m_wakeup) == Socket::Ready && !line.empty())
+      {
+        if (line.compare(0, 15, "Content-Length:") == 0)
+        {
+          length = std::strtoul(line.c_str() + 15, nullptr, 10);
+        }
+      }
+
+      std::string body;
+      Json request;
+      if (!line.empty() || socket.read(&body, length, 1000, m_wakeup) != Socket::Ready || !Json::parse(body, &request))
+      {
+        return;
+      }
+      const std::string reply = "{\"jsonrpc\":\"2.0\",\"id\":" +
+                                std::to_string(static_cast<uint64_t>(request["id"].number())) + "," +
+                                handle(request["method"].string(), request["params"]) + "}";
+      socket.write(
+        "HTTP/1.1 200 Ok\r\nContent-Type: application/json\r\nContent-Length: " + std::to_string(reply.size()) +
+          "\r\n\r\n" + reply,
+        1000);
+    }
+  }
+
+  // The result or error member of the reply
+  std::string handle(const std::string &method, const Json &params)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (method == "get_last_block_header")
+    {
+      ++m_stats.headers;
+      return "\"result\":{\"block_header\":{\"hash\":\"" + bufferToHex(&m_tip[0], m_tip.size()) +
+             "\",\"height\":" + std::to_string(m_height - 1) + "},\"status\":\"OK\"}";
+    }
+    if (method == "get_block_template")
+    {
+      return blockTemplate(lock, std::min<size_t>(static_cast<size_t>(params["reserve_size"].number()), 255));
+    }
+    if (method == "submit_block")
+    {
+      std::vector<uint8_t> blob;
+      if (hexToBuffer(params[0].string(), &blob) && accept(lock, blob))
+      {
+        ++m_stats.accepted;
+        advance(lock);
+        return "\"result\":{\"status\":\"OK\"}";
+      }
+      ++m_stats.rejected;
+      return "\"error\":{\"code\":-7,\"message\":\"Block not accepted\"}";
+    }
+    return "\"error\":{\"code\":-32601,\"message\":\"Method not found\"}";
+  }
+
+  // Only blocks built from a template served on the current tip, with their proof of work checked on the hashing
+  // blob rebuilt from their own coinbase
+  bool accept(const std::lock_guard<std::mutex> &, const std::vector<uint8_t> &blob)
+  {
+    for (const Served &served : m_served)
+    {
+      const size_t nonceEnd = Job::NonceOffset + sizeof(Job::Nonce);
+      const size_t reservedEnd = served.reservedOffset + served.reserveSize;
+      if (blob.size() != served.blob.size() ||
+          !std::equal(blob.begin(), blob.begin() + Job::NonceOffset, served.blob.begin()) ||
+          !std::equal(blob.begin() + nonceEnd, blob.begin() + served.reservedOffset, served.blob.begin() + nonceEnd) ||
+          !std::equal(blob.begin() + reservedEnd, blob.end(), served.blob.begin() + reservedEnd))
+      {
+        continue;
+      }
+      std::vector<Keccak::Hash> hashes(1, coinbaseHash(&blob[nonceEnd], served.prefixEnd - nonceEnd));
+      hashes.insert(hashes.end(), served.txHashes.begin(), served.txHashes.end());
+      const std::vector<uint8_t> hashing = hashingBlob(&blob[0], nonceEnd, hashes);
+      uint8_t hash[RANDOMX_HASH_SIZE];
+      randomx_calculate_hash(m_vm, &hashing[0], hashing.size(), hash);
+      return meetsDifficulty(hash, m_difficulty);
+    }
+    return false;
+  }
+
+  std::string blockTemplate(const std::lock_guard<std::mutex> &, size_t reserveSize)
+  {
+    // The client's extra nonce has to fit, like monerod's limit on the reserved size
+    if (reserveSize < sizeof(uint32_t))
+    {
+      return "\"error\":{\"code\":-3,\"message\":\"Too big reserved size\"}";
+    }
+
+    std::vector<uint8_t> blob = {16, 16};
+    varint(&blob, 1700000000 + m_height);
+    blob.insert(blob.end(), m_tip.begin(), m_tip.end());
+    blob.resize(blob.size() + sizeof(Job::Nonce), 0);
+
+    // Coinbase with one tagged key output, the extra holds the tx public key and the reserved extra nonce
+    blob.push_back(2);
+    varint(&blob, m_height + 60);
+    blob.insert(blob.end(), {1, 0xff});
+    varint(&blob, m_height);
+    blob.push_back(1);
+    varint(&blob, 600000000000);
+    blob.push_back(3);
+    const Keccak::Hash key = Keccak::hash(m_tip, m_tip);
+    blob.insert(blob.end(), key.begin(), key.end());
+    blob.push_back(key[0]);
+    varint(&blob, 1 + key.size() + 2 + reserveSize);
+    blob.push_back(1);
+    blob.insert(blob.end(), key.begin(), key.end());
+    blob.insert(blob.end(), {2, static_cast<uint8_t>(reserveSize)});
+    const size_t reservedOffset = blob.size();
+    blob.resize(blob.size() + reserveSize, 0);
+    const size_t prefixEnd = blob.size();
+    blob.push_back(0);
+    varint(&blob, m_mempool.size());
+    for (const Keccak::Hash &hash : m_mempool)
+    {
+      blob.insert(blob.end(), hash.begin(), hash.end());
+    }
+
+    const size_t headerSize = Job::NonceOffset + sizeof(Job::Nonce);
+    std::vector<Keccak::Hash> hashes(1, coinbaseHash(&blob[headerSize], prefixEnd - headerSize));
+    hashes.insert(hashes.end(), m_mempool.begin(), m_mempool.end());
+    m_served.push_back({blob, reservedOffset, reserveSize, prefixEnd, m_mempool});
+
+    ++m_stats.templates;
+    if (!m_tipServed)
+    {
+      m_tipServed = true;
+      m_stats.tipToTemplate.push_back(
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_tipChanged).count());
+    }
+    const std::string seedHash(RANDOMX_HASH_SIZE * 2, '0');
+    const std::vector<uint8_t> hashing = hashingBlob(&blob[0], headerSize, hashes);
+    return "\"result\":{\"blocktemplate_blob\":\"" + bufferToHex(blob) + "\",\"blockhashing_blob\":\"" +
+           bufferToHex(hashing) + "\",\"difficulty\":" + std::to_string(m_difficulty) +
+           ",\"height\":" + std::to_string(m_height) + ",\"prev_hash\":\"" + bufferToHex(&m_tip[0], m_tip.size()) +
+           "\",\"reserved_offset\":" + std::to_string(reservedOffset) + ",\"seed_hash\":\"" + seedHash +
+           "\",\"next_seed_hash\":\"\",\"status\":\"OK\"}";
+  }
+
+  void advance(const std::lock_guard<std::mutex> &)
+  {
+    const std::string seed = "block" + std::to_string(m_height);
+    m_tip = Keccak::hash(reinterpret_cast<const uint8_t *>(seed.data()), seed.size());
+    ++m_height;
+    m_mempool.clear();
+    m_served.clear();
+    m_tipChanged = std::chrono::steady_clock::now();
+    m_tipServed = false;
+  }
+
+  static void varint(std::vector<uint8_t> *blob, uint64_t value)
+  {
+    for (; value >= 0x80; value >>= 7)
+    {
+      blob->push_back(static_cast<uint8_t>(value & 0x7f) | 0x80);
+    }
+    blob->push_back(static_cast<uint8_t>(value));
+  }
+
+private:
+  struct Served
+  {
+    std::vector<uint8_t> blob;
+    size_t reservedOffset;
+    size_t reserveSize;
+    // End of the coinbase prefix, the RingCT type follows
+    size_t prefixEnd;
+    std::vector<Keccak::Hash> txHashes;
+  };
+
+  const uint64_t m_difficulty;
+  int m_listener;
+  uint16_t m_port;
+
+  Wakeup m_wakeup;
+  std::atomic<bool> m_stopping;
+  // Accepting thread only
+  std::vector<std::thread> m_connections;
+
+  mutable std::mutex m_mutex;
+  // Light mode is enough to check the few blocks submitted
+  randomx_cache *m_cache;
+  randomx_vm *m_vm;
+  Keccak::Hash m_tip;
+  uint64_t m_height;
+  std::vector<Keccak::Hash> m_mempool;
+  // Templates served on the current tip
+  std::vector<Served> m_served;
+  std::chrono::steady_clock::time_point m_tipChanged;
+  bool m_tipServed;
+  MockNodeStats m_stats;
+
+  std::thread m_thread;
+};
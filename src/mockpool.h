@@ -0,0 +1,290 @@
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+
+#include "job.h"
+#include "json.h"
+#include "socket.h"
+#include "utils.h"
+
+struct MockPoolStats
+{
+  uint64_t logins;
+  uint64_t jobs;
+  uint64_t shares;
+  // Shares for job ids the pool never sent
+  uint64_t unknown;
+  // Milliseconds from sending each job to its first share, in job order. With a target every hash meets this is
+  // the job to first hash latency plus delivery and the trip back.
+  std::vector<double> firstShare;
+};
+
+// Stratum pool on the loopback interface for host tools, serves one miner at a time. Every job keeps the template
+// blob with the job number written in front of the nonce, so each one is new work.
+class MockPool
+{
+public:
+  MockPool(const std::string &blob, const std::string &seedHash, uint64_t target)
+    : m_blob(blob)
+    , m_seedHash(seedHash)
+    , m_target(bufferToHex(reinterpret_cast<const uint8_t *>(&target), sizeof(target)))
+    , m_listener(-1)
+    , m_port(0)
+    , m_stopping(false)
+    , m_pushes(0)
+    , m_drops(0)
+    , m_nextJob(0)
+    , m_stats{0, 0, 0, 0, {}}
+  {
+    m_listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t size = sizeof(address);
+    if (m_listener < 0 || bind(m_listener, reinterpret_cast<sockaddr *>(&address), size) != 0 ||
+        listen(m_listener, 4) != 0 || getsockname(m_listener, reinterpret_cast<sockaddr *>(&address), &size) != 0)
+    {
+      if (m_listener >= 0)
+      {
+        ::close(m_listener);
+      }
+      throw std::runtime_error("failed to listen");
+    }
+    m_port = ntohs(address.sin_port);
+
+    m_thread = std::thread([this]() {
+      thread();
+    });
+  }
+
+  ~MockPool()
+  {
+    m_stopping = true;
+    m_wakeup.notify();
+    m_thread.join();
+    ::close(m_listener);
+  }
+
+  MockPool(const MockPool &) = delete;
+  MockPool &operator=(const MockPool &) = delete;
+
+  uint16_t port() const
+  {
+    return m_port;
+  }
+
+  // Sends a new job to the connected miner
+  void pushJob()
+  {
+    ++m_pushes;
+    m_wakeup.notify();
+  }
+
+  // Closes the miner's connection, the next one is accepted as usual
+  void drop()
+  {
+    ++m_drops;
+    m_wakeup.notify();
+  }
+
+  MockPoolStats stats() const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    return m_stats;
+  }
+
+private:
+  void thread()
+  {
+    Socket client;
+    uint64_t pushes = 0;
+    uint64_t drops = 0;
+    std::string line;
+    while (!m_stopping)
+    {
+      if (!client.valid())
+      {
+        pollfd fds[] = {{m_listener, POLLIN, 0}, {m_wakeup.fd(), POLLIN, 0}};
+        if (poll(fds, 2, -1) > 0 && fds[0].revents != 0)
+        {
+          const int fd = accept4(m_listener, nullptr, nullptr, SOCK_CLOEXEC);
+          client = fd >= 0 ? Socket(fd) : Socket();
+        }
+        m_wakeup.reset();
+        // Anything requested without a miner connected has nothing to act on
+        pushes = m_pushes;
+        drops = m_drops;
+        continue;
+      }
+
+      const Socket::Result result = client.readLine(&line, 1000, m_wakeup);
+      if (result == Socket::Ready)
+      {
+        handle(&client, line);
+      }
+      else if (result == Socket::Interrupted)
+      {
+        m_wakeup.reset();
+        for (; pushes < m_pushes; ++pushes)
+        {
+          client.write("{\"jsonrpc\":\"2.0\",\"method\":\"job\",\"params\":" + job() + "}\n", 1000);
+        }
+        if (drops < m_drops)
+        {
+          drops = m_drops;
+          client.close();
+        }
+      }
+      else if (result == Socket::Closed)
+      {
+        client.close();
+      }
+    }
+  }
+
+  void handle(Socket *client, const std::string &line)
+  {
+    Json message;
+    if (!Json::parse(line, &message))
+    {
+      client->close();
+      return;
+    }
+
+    const std::string &method = message["method"].string();
+    std::string result = "{\"status\":\"OK\"}";
+    if (method == "login")
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+
+      ++m_stats.logins;
+      result = "{\"id\":\"mock\",\"job\":" + job(lock) + ",\"status\":\"OK\"}";
+    }
+    else if (method == "getjob")
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+
+      result = job(lock);
+    }
+    else if (method == "submit")
+    {
+      submit(message["params"]["job_id"].string());
+    }
+    else if (method == "keepalived")
+    {
+      result = "{\"status\":\"KEEPALIVED\"}";
+    }
+
+    client->write(
+      "{\"id\":" + std::to_string(static_cast<uint64_t>(message["id"].number())) +
+        ",\"jsonrpc\":\"2.0\",\"error\":null,\"result\":" + result + "}\n",
+      1000);
+  }
+
+  void submit(const std::string &jobId)
+  {
+    const auto now = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    ++m_stats.shares;
+    const auto found = m_sent.find(jobId);
+    if (found == m_sent.end())
+    {
+      ++m_stats.unknown;
+      return;
+    }
+    const size_t number = std::strtoul(jobId.c_str(), nullptr, 10);
+    if (m_stats.firstShare.size() <= number)
+    {
+      m_stats.firstShare.resize(number + 1, -1);
+    }
+    if (m_stats.firstShare[number] < 0)
+    {
+      m_stats.firstShare[number] = std::chrono::duration<double, std::milli>(now - found->second).count();
+    }
+  }
+
+  std::string job()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    return job(lock);
+  }
+
+  // Next job, must be called with the mutex held
+  std::string job(const std::lock_guard<std::mutex> &)
+  {
+    const uint64_t number = m_nextJob++;
+    const std::string id = std::to_string(number);
+    std::string blob = m_blob;
+    const std::string stamp = bufferToHex(reinterpret_cast<const uint8_t *>(&number), sizeof(uint32_t));
+    blob.replace((Job::NonceOffset - stamp.size() / 2) * 2, stamp.size(), stamp);
+    m_sent[id] = std::chrono::steady_clock::now();
+    ++m_stats.jobs;
+    return "{\"job_id\":\"" + id + "\",\"blob\":\"" + blob + "\",\"target\":\"" + m_target + "\",\"seed_hash\":\"" +
+           m_seedHash + "\",\"height\":" + std::to_string(number) + ",\"algo\":\"rx/0\"}";
+  }
+
+private:
+  const std::string m_blob;
+  const std::string m_seedHash;
+  const std::string m_target;
+  int m_listener;
+  uint16_t m_port;
+
+  Wakeup m_wakeup;
+  std::atomic<bool> m_stopping;
+  std::atomic<uint64_t> m_pushes;
+  std::atomic<uint64_t> m_drops;
+
+  mutable std::mutex m_mutex;
+  uint64_t m_nextJob;
+  std::map<std::string, std::chrono::steady_clock::time_point> m_sent;
+  MockPoolStats m_stats;
+
+  std::thread m_thread;
+};
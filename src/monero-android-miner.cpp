@@ -1,136 +1,689 @@
-// BSD 3-Clause License
-//
-// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
-// All rights reserved.
-//
-// Redistribution and use in source and binary forms, with or without
-// modification, are permitted provided that the following conditions are met:
-//
-// 1. Redistributions of source code must retain the above copyright notice, this
-//    list of conditions and the following disclaimer.
-//
-// 2. Redistributions in binary form must reproduce the above copyright notice,
-//    this list of conditions and the following disclaimer in the documentation
-//    and/or other materials provided with the distribution.
-//
-// 3. Neither the name of the copyright holder nor the names of its
-//    contributors may be used to endorse or promote products derived from
-//    this software without specific prior written permission.
-//
-// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
-// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
-// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
-// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
-// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
-// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
-// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
-// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
-// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
-// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
-
-#include <algorithm>
-#include <array>
-#include <memory>
-#include <mutex>
-#include <numeric>
-#include <vector>
-
-#include <jni.h>
-
-#include "hasher.h"
-#include "job.h"
-#include "utils.h"
-
-std::mutex mutex;
-std::vector<std::unique_ptr<Hasher>> hashers;
-double cpuLoadModifier = 0.5;
-
-extern "C"
-{
-  JNIEXPORT jboolean JNICALL Java_monero_android_miner_Miner_miningStart(
-    JNIEnv *env,
-    jobject,
-    jstring id,
-    jbyteArray blob,
-    jbyteArray seedHash,
-    jlong height,
-    jbyteArray target)
-  {
-    if (height < std::numeric_limits<size_t>::min())
-    {
-      return false;
-    }
-
-    const std::vector<uint8_t> targetBytes = jbyteArrayToVector(env, target);
-    if (targetBytes.size() != Target::Size)
-    {
-      return false;
-    }
-    std::array<uint8_t, Target::Size> targetArray;
-    std::copy(targetBytes.cbegin(), targetBytes.cbegin() + targetArray.size(), targetArray.begin());
-
-    const std::vector<uint8_t> blobBytes = jbyteArrayToVector(env, blob);
-    if (!Job::validateBlob(blobBytes))
-    {
-      return false;
-    }
-
-    const std::vector<uint8_t> seedHashBytes = jbyteArrayToVector(env, seedHash);
-    if (!Job::validateSeedHash(seedHashBytes))
-    {
-      return false;
-    }
-
-    {
-      std::lock_guard<std::mutex> lock(mutex);
-
-      if (hashers.empty())
-      {
-        const size_t cpuThreads = std::max(std::thread::hardware_concurrency() / Hasher::MaxCpuCoresDivisor, 1u);
-        for (size_t index = 0; index < cpuThreads; ++index)
-        {
-          hashers.emplace_back(new Hasher(index, cpuThreads, cpuLoadModifier));
-        }
-      }
-
-      for (auto &hasher : hashers)
-      {
-        hasher->setJob(
-          Job(jstringTostring(env, id), blobBytes, seedHashBytes, static_cast<size_t>(height), targetArray));
-      }
-    }
-
-    return true;
-  }
-
-  JNIEXPORT void JNICALL Java_monero_android_miner_Miner_miningStop(JNIEnv *, jobject)
-  {
-    std::lock_guard<std::mutex> lock(mutex);
-
-    hashers.clear();
-  }
-
-  JNIEXPORT void JNICALL Java_monero_android_miner_Miner_adjustCpuLoad(JNIEnv *, jobject, jdouble modifier)
-  {
-    std::lock_guard<std::mutex> lock(mutex);
-
-    cpuLoadModifier = modifier;
-    for (auto &hasher : hashers)
-    {
-      hasher->setModifier(cpuLoadModifier);
-    }
-  }
-
-  JNIEXPORT jdouble JNICALL Java_monero_android_miner_Miner_hashrate(JNIEnv *, jobject)
-  {
-    std::lock_guard<std::mutex> lock(mutex);
-
-    return std::accumulate(
-      hashers.begin(),
-      hashers.end(),
-      0.0,
-      [](const double total, std::unique_ptr<Hasher> &hasher) {
-        return total + hasher->hashrate();
-      });
-  }
-}
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <jni.h>
+
+#include "callback.h"
+#include "governor.h"
+#include "job.h"
+#include "jniutils.h"
+#include "marshal.h"
+#include "miner.h"
+#include "solo.h"
+#include "stratum.h"
+#include "trace.h"
+#include "utils.h"
+
+JniShareSink shareSink;
+Miner miner(shareSink);
+// Native stratum and solo connections by slot, declared after the miner so they go away first
+std::mutex stratumMutex;
+std::array<std::unique_ptr<StratumClient>, Miner::MaxSlots> stratumClients;
+std::array<std::unique_ptr<SoloClient>, Miner::MaxSlots> soloClients;
+// Owns the thread count and the CPU load while set
+std::mutex governorMutex;
+std::unique_ptr<Governor> governor;
+
+namespace
+{
+  // Job fields copied out of Java, reused for every job of a slot
+  struct JobFields
+  {
+    std::string id;
+    std::vector<uint8_t> blob;
+    std::vector<uint8_t> seedHash;
+    std::vector<uint8_t> target;
+  };
+
+  std::mutex jobFieldsMutex;
+  std::array<JobFields, Miner::MaxSlots> jobFields;
+
+  // Validates the job fields coming from Java, nullptr if any of them is malformed. Must be called with
+  // jobFieldsMutex held.
+  std::unique_ptr<Job> makeJob(
+    JNIEnv *env,
+    JobFields *fields,
+    jstring id,
+    jbyteArray blob,
+    jbyteArray seedHash,
+    jlong height,
+    jbyteArray target)
+  {
+    if (height < std::numeric_limits<size_t>::min())
+    {
+      return nullptr;
+    }
+
+    jbyteArrayToVector(env, target, &fields->target);
+    if (!Target::validateSize(fields->target.size()))
+    {
+      return nullptr;
+    }
+
+    jbyteArrayToVector(env, blob, &fields->blob);
+    if (!Job::validateBlob(fields->blob))
+    {
+      return nullptr;
+    }
+
+    jbyteArrayToVector(env, seedHash, &fields->seedHash);
+    if (!Job::validateSeedHash(fields->seedHash))
+    {
+      return nullptr;
+    }
+    Job::SeedHash seedHashArray;
+    std::copy(fields->seedHash.cbegin(), fields->seedHash.cend(), seedHashArray.begin());
+
+    jstringTostring(env, id, &fields->id);
+    if (!Job::validateId(fields->id))
+    {
+      return nullptr;
+    }
+
+    try
+    {
+      return std::unique_ptr<Job>(new Job(
+        fields->id,
+        fields->blob,
+        seedHashArray,
+        static_cast<size_t>(height),
+        Target(&fields->target[0], fields->target.size())));
+    }
+    catch (const std::exception &)
+    {
+      return nullptr;
+    }
+  }
+} // namespace
+
+extern "C"
+{
+  JNIEXPORT jboolean JNICALL Java_monero_android_miner_Miner_setSlotJob(
+    JNIEnv *env,
+    jobject,
+    jint slot,
+    jstring id,
+    jbyteArray blob,
+    jbyteArray seedHash,
+    jlong height,
+    jbyteArray target)
+  {
+    if (slot < 0 || static_cast<size_t>(slot) >= jobFields.size())
+    {
+      return false;
+    }
+    std::unique_lock<std::mutex> lock(jobFieldsMutex);
+    const std::unique_ptr<Job> job = makeJob(env, &jobFields[slot], id, blob, seedHash, height, target);
+    lock.unlock();
+    return job && miner.setJob(static_cast<uint32_t>(slot), *job);
+  }
+
+  // Kept for callers from before job slots, the same as setSlotJob on slot 0
+  JNIEXPORT jboolean JNICALL Java_monero_android_miner_Miner_miningStart(
+    JNIEnv *env,
+    jobject object,
+    jstring id,
+    jbyteArray blob,
+    jbyteArray seedHash,
+    jlong height,
+    jbyteArray target)
+  {
+    return Java_monero_android_miner_Miner_setSlotJob(env, object, 0, id, blob, seedHash, height, target);
+  }
+
+  // The job as a JobRecord in a direct ByteBuffer, read in place
+  JNIEXPORT jboolean JNICALL
+  Java_monero_android_miner_Miner_setSlotJobBuffer(JNIEnv *env, jobject, jint slot, jobject buffer)
+  {
+    const uint8_t *address = buffer != nullptr ? static_cast<uint8_t *>(env->GetDirectBufferAddress(buffer)) : nullptr;
+    const jlong capacity = address != nullptr ? env->GetDirectBufferCapacity(buffer) : 0;
+    const std::unique_ptr<Job> job = JobRecord::read(address, capacity > 0 ? static_cast<size_t>(capacity) : 0);
+    if (!job || slot < 0)
+    {
+      return false;
+    }
+    return miner.setJob(static_cast<uint32_t>(slot), *job);
+  }
+
+  JNIEXPORT jboolean JNICALL Java_monero_android_miner_Miner_setShareBuffer(JNIEnv *env, jobject, jobject buffer)
+  {
+    return shareSink.setShareBuffer(env, buffer);
+  }
+
+  JNIEXPORT jboolean JNICALL Java_monero_android_miner_Miner_setSlotWeight(JNIEnv *, jobject, jint slot, jdouble weight)
+  {
+    return slot >= 0 && miner.setWeight(static_cast<uint32_t>(slot), weight);
+  }
+
+  JNIEXPORT void JNICALL Java_monero_android_miner_Miner_removeSlot(JNIEnv *, jobject, jint slot)
+  {
+    if (slot >= 0)
+    {
+      miner.removeJob(static_cast<uint32_t>(slot));
+    }
+  }
+
+  // Connects the slot to the pools natively, replacing any native connection of the slot. Jobs and shares of the
+  // slot no longer go through Java.
+  JNIEXPORT jboolean JNICALL Java_monero_android_miner_Miner_startStratum(
+    JNIEnv *env,
+    jobject,
+    jint slot,
+    jobjectArray hosts,
+    jintArray ports,
+    jstring login,
+    jstring password,
+    jstring rigId)
+  {
+    if (slot < 0 || static_cast<uint32_t>(slot) >= Miner::MaxSlots || hosts == nullptr || ports == nullptr ||
+        env->GetArrayLength(hosts) != env->GetArrayLength(ports) || env->GetArrayLength(hosts) == 0)
+    {
+      return false;
+    }
+
+    std::vector<jint> portValues(env->GetArrayLength(ports));
+    env->GetIntArrayRegion(ports, 0, portValues.size(), &portValues[0]);
+    std::vector<Pool> pools;
+    for (size_t index = 0; index < portValues.size(); ++index)
+    {
+      if (portValues[index] <= 0 || portValues[index] > 0xffff)
+      {
+        return false;
+      }
+      jstring host = static_cast<jstring>(env->GetObjectArrayElement(hosts, index));
+      pools.push_back({
+        jstringTostring(env, host),
+        static_cast<uint16_t>(portValues[index]),
+        jstringTostring(env, login),
+        jstringTostring(env, password),
+        jstringTostring(env, rigId),
+      });
+      env->DeleteLocalRef(host);
+    }
+
+    std::lock_guard<std::mutex> lock(stratumMutex);
+
+    soloClients[slot].reset();
+    stratumClients[slot].reset();
+    stratumClients[slot].reset(new StratumClient(miner, static_cast<uint32_t>(slot), std::move(pools)));
+    return true;
+  }
+
+  JNIEXPORT void JNICALL Java_monero_android_miner_Miner_stopStratum(JNIEnv *, jobject, jint slot)
+  {
+    std::lock_guard<std::mutex> lock(stratumMutex);
+
+    if (slot >= 0 && static_cast<uint32_t>(slot) < Miner::MaxSlots)
+    {
+      stratumClients[slot].reset();
+    }
+  }
+
+  // Connected, pool index, jobs, accepted, rejected, stale, reconnects, average and maximum submit latency in
+  // microseconds, null without a native connection on the slot
+  JNIEXPORT jlongArray JNICALL Java_monero_android_miner_Miner_stratumStats(JNIEnv *env, jobject, jint slot)
+  {
+    std::lock_guard<std::mutex> lock(stratumMutex);
+
+    if (slot < 0 || static_cast<uint32_t>(slot) >= Miner::MaxSlots || !stratumClients[slot])
+    {
+      return nullptr;
+    }
+    const StratumStats stats = stratumClients[slot]->stats();
+    const jlong values[] = {
+      stats.connected ? 1 : 0,
+      static_cast<jlong>(stats.pool),
+      static_cast<jlong>(stats.jobs),
+      static_cast<jlong>(stats.accepted),
+      static_cast<jlong>(stats.rejected),
+      static_cast<jlong>(stats.stale),
+      static_cast<jlong>(stats.reconnects),
+      static_cast<jlong>(stats.submitLatency * 1000),
+      static_cast<jlong>(stats.maxSubmitLatency * 1000),
+    };
+    jlongArray result = env->NewLongArray(9);
+    if (result != nullptr)
+    {
+      env->SetLongArrayRegion(result, 0, 9, values);
+    }
+    return result;
+  }
+
+  // Solo mines the slot against monerod's RPC at host:port, replacing any native connection of the slot. Blocks go
+  // to wallet.
+  JNIEXPORT jboolean JNICALL Java_monero_android_miner_Miner_startSolo(
+    JNIEnv *env,
+    jobject,
+    jint slot,
+    jstring host,
+    jint port,
+    jstring wallet)
+  {
+    if (slot < 0 || static_cast<uint32_t>(slot) >= Miner::MaxSlots || host == nullptr || wallet == nullptr ||
+        port <= 0 || port > 0xffff)
+    {
+      return false;
+    }
+
+    std::lock_guard<std::mutex> lock(stratumMutex);
+
+    stratumClients[slot].reset();
+    soloClients[slot].reset();
+    soloClients[slot].reset(new SoloClient(
+      miner, static_cast<uint32_t>(slot), jstringTostring(env, host), static_cast<uint16_t>(port),
+      jstringTostring(env, wallet)));
+    return true;
+  }
+
+  JNIEXPORT void JNICALL Java_monero_android_miner_Miner_stopSolo(JNIEnv *, jobject, jint slot)
+  {
+    std::lock_guard<std::mutex> lock(stratumMutex);
+
+    if (slot >= 0 && static_cast<uint32_t>(slot) < Miner::MaxSlots)
+    {
+      soloClients[slot].reset();
+    }
+  }
+
+  // Connected, height, templates, extra nonces, accepted, rejected, stale blocks, average and maximum template
+  // switch latency in microseconds, null without solo mining on the slot
+  JNIEXPORT jlongArray JNICALL Java_monero_android_miner_Miner_soloStats(JNIEnv *env, jobject, jint slot)
+  {
+    std::lock_guard<std::mutex> lock(stratumMutex);
+
+    if (slot < 0 || static_cast<uint32_t>(slot) >= Miner::MaxSlots || !soloClients[slot])
+    {
+      return nullptr;
+    }
+    const SoloStats stats = soloClients[slot]->stats();
+    const jlong values[] = {
+      stats.connected ? 1 : 0,
+      static_cast<jlong>(stats.height),
+      static_cast<jlong>(stats.templates),
+      static_cast<jlong>(stats.extraNonces),
+      static_cast<jlong>(stats.accepted),
+      static_cast<jlong>(stats.rejected),
+      static_cast<jlong>(stats.stale),
+      static_cast<jlong>(stats.switchLatency),
+      static_cast<jlong>(stats.maxSwitchLatency),
+    };
+    jlongArray result = env->NewLongArray(9);
+    if (result != nullptr)
+    {
+      env->SetLongArrayRegion(result, 0, 9, values);
+    }
+    return result;
+  }
+
+  // Six values per slot: active, weight, threads, hashes, shares and the 10 second hashrate
+  JNIEXPORT jdoubleArray JNICALL Java_monero_android_miner_Miner_slotStats(JNIEnv *env, jobject)
+  {
+    std::vector<jdouble> values;
+    for (const SlotStats &stats : miner.slotStats())
+    {
+      values.insert(
+        values.end(),
+        {
+          stats.active ? 1.0 : 0.0,
+          stats.weight,
+          static_cast<jdouble>(stats.threads),
+          static_cast<jdouble>(stats.hashes),
+          static_cast<jdouble>(stats.shares),
+          stats.hashrate,
+        });
+    }
+
+    jdoubleArray result = env->NewDoubleArray(values.size());
+    if (result != nullptr && !values.empty())
+    {
+      env->SetDoubleArrayRegion(result, 0, values.size(), &values[0]);
+    }
+    return result;
+  }
+
+  JNIEXPORT void JNICALL Java_monero_android_miner_Miner_miningStop(JNIEnv *, jobject)
+  {
+    miner.stop();
+  }
+
+  JNIEXPORT void JNICALL Java_monero_android_miner_Miner_miningPause(JNIEnv *, jobject)
+  {
+    miner.pause();
+  }
+
+  JNIEXPORT void JNICALL Java_monero_android_miner_Miner_miningResume(JNIEnv *, jobject)
+  {
+    miner.resume();
+  }
+
+  JNIEXPORT void JNICALL Java_monero_android_miner_Miner_setIdleTimeout(JNIEnv *, jobject, jlong milliseconds)
+  {
+    miner.setIdleTimeout(milliseconds);
+  }
+
+  JNIEXPORT jdouble JNICALL Java_monero_android_miner_Miner_resumeLatency(JNIEnv *, jobject)
+  {
+    return miner.resumeLatency();
+  }
+
+  JNIEXPORT jdouble JNICALL Java_monero_android_miner_Miner_adjustCpuLoad(JNIEnv *, jobject, jdouble modifier)
+  {
+    return miner.setCpuLoad(modifier);
+  }
+
+  JNIEXPORT jint JNICALL Java_monero_android_miner_Miner_setThreads(JNIEnv *, jobject, jint threads)
+  {
+    return static_cast<jint>(miner.setThreads(static_cast<size_t>(std::max(threads, 1))));
+  }
+
+  JNIEXPORT jboolean JNICALL Java_monero_android_miner_Miner_startGovernor(
+    JNIEnv *env,
+    jobject,
+    jdouble ceiling,
+    jdouble powerLimit,
+    jstring root)
+  {
+    std::lock_guard<std::mutex> lock(governorMutex);
+
+    // The previous one puts back the settings from before it, so the new one starts from those
+    governor.reset();
+    try
+    {
+      governor.reset(new Governor(miner, ceiling, powerLimit, root != nullptr ? jstringTostring(env, root) : "/sys"));
+    }
+    catch (const std::exception &)
+    {
+      return false;
+    }
+    return true;
+  }
+
+  JNIEXPORT void JNICALL Java_monero_android_miner_Miner_stopGovernor(JNIEnv *, jobject)
+  {
+    std::lock_guard<std::mutex> lock(governorMutex);
+
+    governor.reset();
+  }
+
+  // Temperature (NaN if unknown), clock fraction, watts, budget in threads, threads, H/s, overheats, collapses,
+  // null without a governor
+  JNIEXPORT jdoubleArray JNICALL Java_monero_android_miner_Miner_governorStats(JNIEnv *env, jobject)
+  {
+    std::lock_guard<std::mutex> lock(governorMutex);
+
+    if (!governor)
+    {
+      return nullptr;
+    }
+    const GovernorStats stats = governor->stats();
+    const jdouble values[] = {
+      stats.sample.temperatureKnown ? stats.sample.temperature : std::numeric_limits<double>::quiet_NaN(),
+      stats.sample.frequency,
+      stats.sample.power,
+      stats.budget,
+      static_cast<jdouble>(stats.threads),
+      stats.hashrate,
+      static_cast<jdouble>(stats.overheats),
+      static_cast<jdouble>(stats.collapses),
+    };
+    jdoubleArray result = env->NewDoubleArray(8);
+    if (result != nullptr)
+    {
+      env->SetDoubleArrayRegion(result, 0, 8, values);
+    }
+    return result;
+  }
+
+  // Budget, samples, H/s, temperature and watts for every load level, null without a governor
+  JNIEXPORT jdoubleArray JNICALL Java_monero_android_miner_Miner_governorCurve(JNIEnv *env, jobject)
+  {
+    std::lock_guard<std::mutex> lock(governorMutex);
+
+    if (!governor)
+    {
+      return nullptr;
+    }
+    std::vector<jdouble> values;
+    for (const GovernorPoint &point : governor->stats().points)
+    {
+      values.insert(
+        values.end(),
+        {point.budget, static_cast<jdouble>(point.samples), point.hashrate, point.temperature, point.power});
+    }
+
+    jdoubleArray result = env->NewDoubleArray(values.size());
+    if (result != nullptr && !values.empty())
+    {
+      env->SetDoubleArrayRegion(result, 0, values.size(), &values[0]);
+    }
+    return result;
+  }
+
+  JNIEXPORT jint JNICALL Java_monero_android_miner_Miner_threads(JNIEnv *, jobject)
+  {
+    return static_cast<jint>(miner.threads());
+  }
+
+  JNIEXPORT jboolean JNICALL
+  Java_monero_android_miner_Miner_setNonceSpace(JNIEnv *, jobject, jint mask, jint index, jint count)
+  {
+    if (index < 0 || count <= 0)
+    {
+      return false;
+    }
+    NonceSpace space;
+    space.mask = static_cast<Job::Nonce>(mask);
+    space.index = static_cast<size_t>(index);
+    space.count = static_cast<size_t>(count);
+    return miner.setNonceSpace(space);
+  }
+
+  JNIEXPORT void JNICALL Java_monero_android_miner_Miner_setAffinity(JNIEnv *, jobject, jboolean enabled)
+  {
+    miner.setAffinity(enabled);
+  }
+
+  JNIEXPORT jboolean JNICALL Java_monero_android_miner_Miner_setThrottleMode(JNIEnv *, jobject, jint mode)
+  {
+    if (mode != Regulator::DutyCycle && mode != Regulator::Park)
+    {
+      return false;
+    }
+    miner.setThrottleMode(static_cast<Regulator::Mode>(mode));
+    return true;
+  }
+
+  JNIEXPORT jboolean JNICALL Java_monero_android_miner_Miner_miningPrepare(JNIEnv *env, jobject, jbyteArray seedHash)
+  {
+    const std::vector<uint8_t> seedHashBytes = jbyteArrayToVector(env, seedHash);
+    if (!Job::validateSeedHash(seedHashBytes))
+    {
+      return false;
+    }
+    Job::SeedHash seedHashArray;
+    std::copy(seedHashBytes.cbegin(), seedHashBytes.cend(), seedHashArray.begin());
+
+    miner.prepare(seedHashArray);
+    return true;
+  }
+
+  JNIEXPORT void JNICALL Java_monero_android_miner_Miner_setFastMode(JNIEnv *, jobject, jboolean enabled)
+  {
+    miner.setFastMode(enabled);
+  }
+
+  JNIEXPORT jboolean JNICALL Java_monero_android_miner_Miner_fastModeActive(JNIEnv *, jobject)
+  {
+    return miner.fastModeActive();
+  }
+
+  JNIEXPORT jdouble JNICALL Java_monero_android_miner_Miner_hashrate(JNIEnv *, jobject)
+  {
+    return miner.hashrate();
+  }
+
+  JNIEXPORT jdoubleArray JNICALL Java_monero_android_miner_Miner_hashrateStats(JNIEnv *env, jobject)
+  {
+    const HashrateStats stats = miner.stats();
+
+    std::vector<jdouble> values = {
+      stats.total[HashrateStats::Window10s],
+      stats.total[HashrateStats::Window60s],
+      stats.total[HashrateStats::Window15m],
+      static_cast<jdouble>(stats.hashes),
+      stats.elapsedSeconds,
+      stats.cpuSeconds,
+      stats.latencyP50,
+      stats.latencyP90,
+      stats.latencyP99,
+      static_cast<jdouble>(stats.threads.size()),
+    };
+    for (const auto &thread : stats.threads)
+    {
+      values.insert(values.end(), thread.begin(), thread.end());
+    }
+
+    jdoubleArray result = env->NewDoubleArray(values.size());
+    if (result != nullptr)
+    {
+      env->SetDoubleArrayRegion(result, 0, values.size(), &values[0]);
+    }
+    return result;
+  }
+
+  JNIEXPORT void JNICALL
+  Java_monero_android_miner_Miner_setCalibration(JNIEnv *env, jobject, jboolean enabled, jstring file)
+  {
+    miner.setCalibration(enabled, file != nullptr ? jstringTostring(env, file) : std::string());
+  }
+
+  JNIEXPORT void JNICALL Java_monero_android_miner_Miner_setCacheStore(JNIEnv *env, jobject, jstring directory)
+  {
+    miner.setCacheStore(directory != nullptr ? jstringTostring(env, directory) : std::string());
+  }
+
+  JNIEXPORT jstring JNICALL Java_monero_android_miner_Miner_randomxFlags(JNIEnv *env, jobject)
+  {
+    randomx_flags flags;
+    bool loaded;
+    std::vector<Calibration::Trial> trials;
+    if (!miner.calibration().result(&flags, &loaded, &trials))
+    {
+      return nullptr;
+    }
+    return env->NewStringUTF(Calibration::name(flags).c_str());
+  }
+
+  JNIEXPORT void JNICALL Java_monero_android_miner_Miner_setHugePages(JNIEnv *, jobject, jboolean enabled)
+  {
+    miner.setHugePages(enabled);
+  }
+
+  JNIEXPORT jintArray JNICALL Java_monero_android_miner_Miner_memoryPages(JNIEnv *env, jobject)
+  {
+    MemoryPages pages;
+    if (!miner.pages(&pages))
+    {
+      return nullptr;
+    }
+
+    const jint values[] = {
+      pages.cache,
+      miner.fastModeActive() ? pages.dataset : -1,
+      static_cast<jint>(pages.hugeScratchpads),
+      static_cast<jint>(pages.scratchpads),
+    };
+    jintArray result = env->NewIntArray(4);
+    if (result != nullptr)
+    {
+      env->SetIntArrayRegion(result, 0, 4, values);
+    }
+    return result;
+  }
+
+  JNIEXPORT jlong JNICALL Java_monero_android_miner_Miner_startupTime(JNIEnv *, jobject)
+  {
+    return miner.startupTime();
+  }
+
+  JNIEXPORT jlong JNICALL Java_monero_android_miner_Miner_sharesFound(JNIEnv *, jobject)
+  {
+    return static_cast<jlong>(miner.sharesFound());
+  }
+
+  JNIEXPORT jlong JNICALL Java_monero_android_miner_Miner_sharesDropped(JNIEnv *, jobject)
+  {
+    return static_cast<jlong>(miner.sharesDropped());
+  }
+
+  JNIEXPORT void JNICALL Java_monero_android_miner_Miner_setVerification(JNIEnv *, jobject, jboolean enabled)
+  {
+    miner.setVerification(enabled);
+  }
+
+  // Three values per hasher: verified shares, hardware errors and its state, 0 healthy, 1 quarantined or 2 failed
+  JNIEXPORT jlongArray JNICALL Java_monero_android_miner_Miner_threadHealth(JNIEnv *env, jobject)
+  {
+    std::vector<jlong> values;
+    for (const ThreadHealth &health : miner.threadHealth())
+    {
+      values.insert(
+        values.end(),
+        {
+          static_cast<jlong>(health.verified),
+          static_cast<jlong>(health.errors),
+          health.failed ? 2 : health.quarantined ? 1 : 0,
+        });
+    }
+
+    jlongArray result = env->NewLongArray(values.size());
+    if (result != nullptr && !values.empty())
+    {
+      env->SetLongArrayRegion(result, 0, values.size(), &values[0]);
+    }
+    return result;
+  }
+
+  JNIEXPORT jboolean JNICALL Java_monero_android_miner_Miner_writeTrace(JNIEnv *env, jobject, jstring file)
+  {
+    return file != nullptr && Trace::write(jstringTostring(env, file));
+  }
+
+  JNIEXPORT jlong JNICALL Java_monero_android_miner_Miner_residentMemory(JNIEnv *, jobject)
+  {
+    return static_cast<jlong>(residentMemory());
+  }
+}
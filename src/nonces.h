@@ -0,0 +1,157 @@
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+#include "job.h"
+
+// Part of the nonce field a miner may enumerate. Bits outside mask are reserved by the pool and keep the value
+// the job blob came with. The enumerable values are split into count equal parts, so several rigs or processes
+// mining for the same job each take their own part by index.
+struct NonceSpace
+{
+  Job::Nonce mask = ~Job::Nonce(0);
+  size_t index = 0;
+  size_t count = 1;
+
+  bool valid() const
+  {
+    return mask != 0 && count != 0 && index < count;
+  }
+};
+
+// Hands out contiguous chunks of a job's nonce space to the hashers. Every counter value is claimed exactly once,
+// whichever hasher asks for it, so threads joining or leaving the job never repeat a nonce. Counters map to
+// nonces by spreading their bits over the mask.
+class NonceAllocator
+{
+public:
+  // Large enough to keep the shared counter off the hashing path, small next to the time a job lasts
+  static constexpr const uint64_t ChunkSize = 256;
+
+  // The space is not validated here, fixed holds the reserved bits
+  NonceAllocator(const NonceSpace &space, Job::Nonce fixed)
+    : m_mask(space.mask)
+    , m_fixed(fixed & ~space.mask)
+  {
+    const uint64_t size = uint64_t(1) << bitCount(m_mask);
+    m_begin = size / space.count * space.index + std::min<uint64_t>(space.index, size % space.count);
+    m_end = m_begin + size / space.count + (space.index < size % space.count ? 1 : 0);
+    m_next.store(m_begin, std::memory_order_relaxed);
+    m_reported.clear();
+  }
+
+  NonceAllocator(const NonceAllocator &) = delete;
+  NonceAllocator &operator=(const NonceAllocator &) = delete;
+
+  // Claims counters [*begin, *end), false once the space is exhausted
+  bool claim(uint64_t *begin, uint64_t *end)
+  {
+    if (m_next.load(std::memory_order_relaxed) >= m_end)
+    {
+      return false;
+    }
+    const uint64_t claimed = m_next.fetch_add(ChunkSize, std::memory_order_relaxed);
+    if (claimed >= m_end)
+    {
+      return false;
+    }
+    *begin = claimed;
+    *end = std::min(claimed + ChunkSize, m_end);
+    return true;
+  }
+
+  Job::Nonce nonce(uint64_t counter) const
+  {
+    Job::Nonce nonce = m_fixed;
+    for (Job::Nonce bit = 1; bit != 0 && counter != 0; bit <<= 1)
+    {
+      if (m_mask & bit)
+      {
+        nonce |= (counter & 1) ? bit : 0;
+        counter >>= 1;
+      }
+    }
+    return nonce;
+  }
+
+  // First counter not claimed yet
+  uint64_t position() const
+  {
+    return std::min(m_next.load(std::memory_order_relaxed), m_end);
+  }
+
+  // Stops further claims without reporting an exhaustion and returns the first counter nobody claimed, a state
+  // replacing this one for the same work resumes from there
+  uint64_t handOver()
+  {
+    m_reported.test_and_set();
+    return std::min(m_next.exchange(m_end, std::memory_order_relaxed), m_end);
+  }
+
+  void resume(uint64_t position)
+  {
+    m_next.store(std::max(position, m_begin), std::memory_order_relaxed);
+  }
+
+  // True for the first caller after the space ran out, so the exhaustion is reported once
+  bool report()
+  {
+    return !m_reported.test_and_set();
+  }
+
+  bool sameSpace(const NonceAllocator &other) const
+  {
+    return m_mask == other.m_mask && m_fixed == other.m_fixed && m_begin == other.m_begin && m_end == other.m_end;
+  }
+
+private:
+  static size_t bitCount(Job::Nonce value)
+  {
+    size_t count = 0;
+    for (; value != 0; value &= value - 1)
+    {
+      ++count;
+    }
+    return count;
+  }
+
+private:
+  const Job::Nonce m_mask;
+  const Job::Nonce m_fixed;
+  uint64_t m_begin;
+  uint64_t m_end;
+  std::atomic<uint64_t> m_next;
+  std::atomic_flag m_reported;
+};
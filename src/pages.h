@@ -0,0 +1,67 @@
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <sys/mman.h>
+
+// How a RandomX allocation ended up backed. Explicit huge pages come from hugetlbfs through
+// RANDOMX_FLAG_LARGE_PAGES and are never swapped out, transparent ones are only advised to the kernel.
+class Pages
+{
+public:
+  enum Kind
+  {
+    Regular,
+    Transparent,
+    Huge,
+  };
+
+  static constexpr const uintptr_t HugePageSize = 2 * 1024 * 1024;
+
+  static const char *name(Kind kind)
+  {
+    return kind == Huge ? "huge" : kind == Transparent ? "transparent" : "regular";
+  }
+
+  // Advises MADV_HUGEPAGE on the huge page aligned part of the range, must come before the memory is touched
+  static bool advise(void *memory, size_t size)
+  {
+    const uintptr_t begin = (reinterpret_cast<uintptr_t>(memory) + HugePageSize - 1) & ~(HugePageSize - 1);
+    const uintptr_t end = (reinterpret_cast<uintptr_t>(memory) + size) & ~(HugePageSize - 1);
+    if (memory == nullptr || end <= begin)
+    {
+      return false;
+    }
+    return madvise(reinterpret_cast<void *>(begin), end - begin, MADV_HUGEPAGE) == 0;
+  }
+};
@@ -0,0 +1,114 @@
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include <randomx.h>
+
+// RandomX internals, everything else goes through this header
+#include "configuration.h"
+#include "dataset.hpp"
+
+// The one place that reaches into RandomX's private cache structure, to run randomx_init_cache without the Argon2
+// fill and to swap the cache memory. That relies on randomx_init_cache filling cache->memory only through
+// cache->argonImpl, and on the VMs and the dataset init reading cache->memory when they run. A RandomX bump that
+// fails the checks below has to recheck both before they are updated.
+class RandomxInternals
+{
+public:
+  static constexpr const uint32_t ArgonMemory = RANDOMX_ARGON_MEMORY;
+  static constexpr const uint32_t ArgonIterations = RANDOMX_ARGON_ITERATIONS;
+  static constexpr const uint32_t ArgonLanes = RANDOMX_ARGON_LANES;
+  static constexpr const uint32_t CacheAccesses = RANDOMX_CACHE_ACCESSES;
+  static constexpr const size_t CacheSize = static_cast<size_t>(RANDOMX_ARGON_MEMORY) * 1024;
+
+  static const char *argonSalt()
+  {
+    return RANDOMX_ARGON_SALT;
+  }
+
+  // randomx_init_cache minus Argon2, the superscalar programs, reciprocals and JIT init code still come from key.
+  // cache->memory is left as it was.
+  static void initWithoutFill(randomx_cache *cache, const void *key, size_t keySize)
+  {
+    auto *const argonImpl = cache->argonImpl;
+    cache->argonImpl = NoFill<ArgonImpl>::fill;
+    randomx_init_cache(cache, key, keySize);
+    cache->argonImpl = argonImpl;
+  }
+
+  // Returns the memory it replaced
+  static uint8_t *swapMemory(randomx_cache *cache, uint8_t *memory)
+  {
+    uint8_t *const previous = cache->memory;
+    cache->memory = memory;
+    return previous;
+  }
+
+private:
+  typedef std::remove_pointer<decltype(randomx_cache::argonImpl)>::type ArgonImpl;
+
+  // Only defined for the void(...) fill functions RandomX 1.x uses
+  template <typename Function>
+  struct NoFill;
+
+  template <typename... Arguments>
+  struct NoFill<void(Arguments...)>
+  {
+    static void fill(Arguments...)
+    {
+    }
+  };
+};
+
+namespace detail
+{
+  constexpr bool sameString(const char *left, const char *right)
+  {
+    return *left == *right && (*left == '\0' || sameString(left + 1, right + 1));
+  }
+} // namespace detail
+
+// RandomX has no version macro, the algorithm version is the last byte of the Argon2 salt
+static_assert(
+  detail::sameString(RANDOMX_ARGON_SALT, "RandomX\x03"), "untested RandomX version, recheck RandomxInternals");
+static_assert(
+  RANDOMX_ARGON_MEMORY == 262144 && RANDOMX_ARGON_ITERATIONS == 3 && RANDOMX_ARGON_LANES == 1 &&
+    RANDOMX_CACHE_ACCESSES == 8,
+  "untested RandomX configuration, recheck RandomxInternals");
+static_assert(
+  std::is_same<decltype(randomx_cache::memory), uint8_t *>::value, "randomx_cache::memory changed its type");
+static_assert(
+  std::is_function<std::remove_pointer<decltype(randomx_cache::argonImpl)>::type>::value,
+  "randomx_cache::argonImpl is no longer a function pointer");
@@ -30,51 +30,160 @@
 
 #pragma once
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
-#include <thread>
+#include <condition_variable>
+#include <mutex>
 
+#include <time.h>
+
+#include "trace.h"
+
+// Throttles a hashing thread either by spreading sleeps across hashes in proportion to the CPU time they took,
+// or by parking the thread entirely so the remaining ones keep their caches warm at full speed.
 class Regulator
 {
-  static constexpr const size_t TicksToMeasure = 5;
+  // Sleeps shorter than this cost more in wake-up overhead than they save, they are accumulated instead
+  static constexpr const int64_t MinSleepNs = 100 * 1000;
+  // Caps the debt carried over after a long hash or a duty change, so it can't turn into one long stall
+  static constexpr const int64_t MaxOwedNs = 100 * 1000 * 1000;
 
 public:
   static constexpr const unsigned MaxCpuCoresDivisor = 2;
 
-  Regulator(double modifier)
-    : m_ticks(0)
+  enum Mode
   {
-    setModifier(modifier);
+    DutyCycle,
+    Park,
+  };
+
+  Regulator(double duty)
+    : m_owedNs(0)
+    , m_lastCpuNs(0)
+    , m_parked(false)
+    , m_paused(false)
+    , m_released(false)
+  {
+    setDuty(duty);
   }
 
-  void setModifier(double modifier)
+  // Fraction of wall time the thread spends hashing, 1 runs unthrottled
+  void setDuty(double duty)
   {
-    m_modifier = std::min(1.0 / MaxCpuCoresDivisor, modifier);
+    m_duty = std::max(0.01, std::min(1.0, duty));
   }
 
-  void tick()
+  void setParked(bool parked)
   {
-    const size_t tick = m_ticks + 1;
-    m_ticks = tick % TicksToMeasure;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_parked = parked;
+    }
+    m_wakeUp.notify_all();
+  }
 
-    if (tick == 1)
+  // Independent of setParked, which the throttling owns
+  void setPaused(bool paused)
+  {
     {
-      m_first = std::chrono::steady_clock::now();
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_paused = paused;
     }
-    else if (tick == TicksToMeasure)
+    m_wakeUp.notify_all();
+  }
+
+  // Unparks for good, the thread is about to be joined
+  void release()
+  {
     {
-      const auto current = std::chrono::steady_clock::now();
-      const double elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(current - m_first).count();
-      const size_t sleepMs = static_cast<size_t>(elapsedMs - elapsedMs * m_modifier * MaxCpuCoresDivisor);
-      if (sleepMs > 0)
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_released = true;
+    }
+    m_wakeUp.notify_all();
+  }
+
+  // Called by the hashing thread before the first hash
+  void reset()
+  {
+    m_owedNs = 0;
+    m_lastCpuNs = threadCpuNs();
+  }
+
+  // Called by the hashing thread after every hash
+  void tick()
+  {
+    const double duty = m_duty;
+    if (duty < 1)
+    {
+      const int64_t busyNs = threadCpuNs() - m_lastCpuNs;
+      m_owedNs = std::min(static_cast<int64_t>(MaxOwedNs), m_owedNs + static_cast<int64_t>(busyNs * (1 - duty) / duty));
+      if (m_owedNs >= MinSleepNs)
       {
-        std::this_thread::sleep_for(std::chrono::milliseconds(sleepMs));
+        // Oversleeping is credited against the next hashes
+        Trace::Scope trace(Trace::Sleep);
+        const auto before = std::chrono::steady_clock::now();
+        const timespec request = {
+          static_cast<time_t>(m_owedNs / 1000000000),
+          static_cast<long>(m_owedNs % 1000000000),
+        };
+        nanosleep(&request, nullptr);
+        const auto slept = std::chrono::steady_clock::now() - before;
+        m_owedNs -= std::chrono::duration_cast<std::chrono::nanoseconds>(slept).count();
       }
     }
+    else
+    {
+      m_owedNs = 0;
+    }
+
+    if (m_parked.load(std::memory_order_relaxed))
+    {
+      Trace::Scope trace(Trace::Park);
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_wakeUp.wait(lock, [this]() {
+        return !m_parked || m_released;
+      });
+      m_owedNs = 0;
+    }
+
+    m_lastCpuNs = threadCpuNs();
+  }
+
+  // Called by the hashing thread between hashes, blocks while paused. Returns true if it did.
+  bool waitWhilePaused()
+  {
+    if (!m_paused.load(std::memory_order_relaxed))
+    {
+      return false;
+    }
+    {
+      Trace::Scope trace(Trace::Park);
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_wakeUp.wait(lock, [this]() {
+        return !m_paused || m_released;
+      });
+    }
+    reset();
+    return true;
   }
 
 private:
-  std::atomic<size_t> m_ticks;
-  std::atomic<double> m_modifier;
-  std::chrono::steady_clock::time_point m_first;
+  static int64_t threadCpuNs()
+  {
+    timespec time;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return static_cast<int64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+  }
+
+private:
+  std::atomic<double> m_duty;
+  int64_t m_owedNs;
+  int64_t m_lastCpuNs;
+
+  std::mutex m_mutex;
+  std::condition_variable m_wakeUp;
+  std::atomic<bool> m_parked;
+  std::atomic<bool> m_paused;
+  bool m_released;
 };
@@ -0,0 +1,146 @@
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cctype>
+#include <cstdlib>
+#include <string>
+
+#include "json.h"
+#include "socket.h"
+
+// JSON-RPC over HTTP/1.1 to monerod's /json_rpc, keeping the connection alive between calls. Not thread safe,
+// each thread talking to the node uses its own client.
+class RpcClient
+{
+  // Block templates with a full mempool stay far below this
+  static constexpr const size_t MaxResponse = 4 * 1024 * 1024;
+
+public:
+  static constexpr const int64_t TimeoutMs = 10 * 1000;
+
+  RpcClient(const std::string &host, uint16_t port)
+    : m_host(host)
+    , m_port(port)
+    , m_nextId(0)
+  {
+  }
+
+  // The whole reply including error, false if the node couldn't be reached or the reply is no JSON-RPC
+  bool call(const std::string &method, const std::string &params, Json *reply, const Wakeup &wakeup)
+  {
+    const std::string body = "{\"jsonrpc\":\"2.0\",\"id\":" + std::to_string(m_nextId++) +
+                             ",\"method\":" + Json::quote(method) + ",\"params\":" + params + "}";
+    const std::string request = "POST /json_rpc HTTP/1.1\r\nHost: " + m_host + ":" + std::to_string(m_port) +
+                                "\r\nContent-Type: application/json\r\nContent-Length: " +
+                                std::to_string(body.size()) + "\r\n\r\n" + body;
+
+    // A kept alive connection the node closed meanwhile fails on first use, one retry on a fresh one covers it
+    for (int attempt = 0; attempt < 2; ++attempt)
+    {
+      const bool reused = m_socket.valid();
+      if (!reused && m_socket.connect(m_host, m_port, TimeoutMs, wakeup) != Socket::Ready)
+      {
+        return false;
+      }
+
+      std::string response;
+      Socket::Result result = Socket::Closed;
+      if (m_socket.write(request, TimeoutMs) && (result = receive(&response, wakeup)) == Socket::Ready)
+      {
+        return Json::parse(response, reply) && (!(*reply)["result"].isNull() || !(*reply)["error"].isNull());
+      }
+      m_socket.close();
+      if (!reused || result == Socket::Interrupted || result == Socket::Timeout)
+      {
+        return false;
+      }
+    }
+    return false;
+  }
+
+private:
+  Socket::Result receive(std::string *body, const Wakeup &wakeup)
+  {
+    std::string line;
+    Socket::Result result = m_socket.readLine(&line, TimeoutMs, wakeup);
+    if (result != Socket::Ready)
+    {
+      return result;
+    }
+    if (line.compare(0, 9, "HTTP/1.1 ") != 0 || line.compare(9, 3, "200") != 0)
+    {
+      return Socket::Closed;
+    }
+
+    size_t length = 0;
+    bool lengthKnown = false;
+    bool close = false;
+    while ((result = m_socket.readLine(&line, TimeoutMs, wakeup)) == Socket::Ready && !line.empty())
+    {
+      const size_t colon = line.find(':');
+      std::string name = line.substr(0, colon);
+      for (char &c : name)
+      {
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+      }
+      const size_t valueBegin = colon != std::string::npos ? line.find_first_not_of(' ', colon + 1) : colon;
+      const std::string value = valueBegin != std::string::npos ? line.substr(valueBegin) : "";
+      if (name == "content-length")
+      {
+        length = std::strtoul(value.c_str(), nullptr, 10);
+        lengthKnown = true;
+      }
+      else if (name == "connection")
+      {
+        close = value == "close";
+      }
+    }
+    // monerod always sends the length, chunked replies aren't supported
+    if (result != Socket::Ready || !lengthKnown || length > MaxResponse)
+    {
+      return result != Socket::Ready ? result : Socket::Closed;
+    }
+
+    result = m_socket.read(body, length, TimeoutMs, wakeup);
+    if (close)
+    {
+      m_socket.close();
+    }
+    return result;
+  }
+
+private:
+  const std::string m_host;
+  const uint16_t m_port;
+  Socket m_socket;
+  uint64_t m_nextId;
+};
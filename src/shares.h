@@ -0,0 +1,217 @@
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <randomx.h>
+
+#include "cache.h"
+#include "job.h"
+
+struct Share
+{
+  Share() = default;
+
+  // job may already hold the next nonce, the blob is stored with this share's one. The cache it was hashed with
+  // is kept for verification.
+  Share(
+    uint32_t slot,
+    uint32_t thread,
+    const Job &job,
+    Job::Nonce nonce,
+    const std::array<uint8_t, RANDOMX_HASH_SIZE> &hash,
+    std::shared_ptr<const Cache> cache)
+    : slot(slot)
+    , thread(thread)
+    , idSize(job.idSize())
+    , nonce(nonce)
+    , hash(hash)
+    , blobSize(job.blobSize())
+    , cache(std::move(cache))
+    , exhausted(false)
+  {
+    std::copy(job.idData(), job.idData() + job.idSize(), id.begin());
+    std::copy(job.blob(), job.blob() + job.blobSize(), blob.begin());
+    std::copy(
+      reinterpret_cast<const uint8_t *>(&nonce),
+      reinterpret_cast<const uint8_t *>(&nonce) + sizeof(nonce),
+      blob.begin() + Job::NonceOffset);
+  }
+
+  // Not a share but the notice that the job's nonce space ran out, the source should send a fresh job
+  static Share exhaustion(uint32_t slot, uint32_t thread, const Job &job)
+  {
+    Share share(slot, thread, job, 0, {}, nullptr);
+    share.exhausted = true;
+    return share;
+  }
+
+  std::string jobId() const
+  {
+    return std::string(&id[0], idSize);
+  }
+
+  // Job slot the share was found for, tells the sink which source to submit it to
+  uint32_t slot;
+  // Index of the hasher that found it
+  uint32_t thread;
+  std::array<char, Job::MaxIdSize> id;
+  size_t idSize;
+  Job::Nonce nonce;
+  std::array<uint8_t, RANDOMX_HASH_SIZE> hash;
+  std::array<uint8_t, Job::MaxBlobSize> blob;
+  size_t blobSize;
+  std::shared_ptr<const Cache> cache;
+  bool exhausted;
+};
+
+// Bounded multi-producer single-consumer queue of found shares (Dmitry Vyukov's bounded MPMC queue with a
+// single consumer). Hashers push without locking and never block, a share that doesn't fit is counted and dropped.
+class ShareQueue
+{
+  static constexpr const size_t Capacity = 256;
+  static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+public:
+  ShareQueue()
+    : m_enqueue(0)
+    , m_dequeue(0)
+    , m_pushed(0)
+    , m_dropped(0)
+  {
+    for (size_t index = 0; index < Capacity; ++index)
+    {
+      m_cells[index].sequence.store(index, std::memory_order_relaxed);
+    }
+  }
+
+  ShareQueue(const ShareQueue &) = delete;
+  ShareQueue &operator=(const ShareQueue &) = delete;
+
+  bool push(const Share &share)
+  {
+    size_t position = m_enqueue.load(std::memory_order_relaxed);
+    Cell *cell;
+    while (true)
+    {
+      cell = &m_cells[position & (Capacity - 1)];
+      const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      const intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+      if (difference == 0)
+      {
+        if (m_enqueue.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+        {
+          break;
+        }
+      }
+      else if (difference < 0)
+      {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      else
+      {
+        position = m_enqueue.load(std::memory_order_relaxed);
+      }
+    }
+
+    cell->share = share;
+    cell->sequence.store(position + 1, std::memory_order_release);
+    m_pushed.fetch_add(1, std::memory_order_relaxed);
+
+    // Notifying without the mutex may lose a wake-up, the consumer polls with a timeout to cover that
+    m_wakeUp.notify_one();
+    return true;
+  }
+
+  // Single consumer only
+  bool pop(Share *share)
+  {
+    const size_t position = m_dequeue.load(std::memory_order_relaxed);
+    Cell &cell = m_cells[position & (Capacity - 1)];
+    if (cell.sequence.load(std::memory_order_acquire) != position + 1)
+    {
+      return false;
+    }
+
+    // Moved out so the cell doesn't keep the share's cache alive
+    *share = std::move(cell.share);
+    cell.sequence.store(position + Capacity, std::memory_order_release);
+    m_dequeue.store(position + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  template <typename Rep, typename Period>
+  void wait(const std::chrono::duration<Rep, Period> &timeout)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_wakeUp.wait_for(lock, timeout);
+  }
+
+  void notify()
+  {
+    m_wakeUp.notify_all();
+  }
+
+  uint64_t pushed() const
+  {
+    return m_pushed;
+  }
+
+  uint64_t dropped() const
+  {
+    return m_dropped;
+  }
+
+private:
+  struct Cell
+  {
+    std::atomic<size_t> sequence;
+    Share share;
+  };
+
+  std::array<Cell, Capacity> m_cells;
+  std::atomic<size_t> m_enqueue;
+  std::atomic<size_t> m_dequeue;
+  std::atomic<uint64_t> m_pushed;
+  std::atomic<uint64_t> m_dropped;
+
+  std::mutex m_mutex;
+  std::condition_variable m_wakeUp;
+};
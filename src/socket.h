@@ -0,0 +1,368 @@
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Self-pipe that interrupts socket waits from another thread, stays signalled until reset
+class Wakeup
+{
+public:
+  Wakeup()
+  {
+    if (pipe2(m_fds, O_CLOEXEC | O_NONBLOCK) != 0)
+    {
+      throw std::runtime_error("failed to create wakeup pipe");
+    }
+  }
+
+  ~Wakeup()
+  {
+    ::close(m_fds[0]);
+    ::close(m_fds[1]);
+  }
+
+  Wakeup(const Wakeup &) = delete;
+  Wakeup &operator=(const Wakeup &) = delete;
+
+  void notify()
+  {
+    const char byte = 0;
+    while (::write(m_fds[1], &byte, sizeof(byte)) < 0 && errno == EINTR)
+    {
+    }
+  }
+
+  void reset()
+  {
+    char buffer[64];
+    while (::read(m_fds[0], buffer, sizeof(buffer)) > 0)
+    {
+    }
+  }
+
+  // Sleeps for the timeout, false if woken up before
+  bool sleep(int64_t timeoutMs) const
+  {
+    pollfd fd = {m_fds[0], POLLIN, 0};
+    return poll(&fd, 1, static_cast<int>(timeoutMs)) == 0;
+  }
+
+  int fd() const
+  {
+    return m_fds[0];
+  }
+
+private:
+  int m_fds[2];
+};
+
+// Line oriented TCP connection with timeouts, every wait can be interrupted through a Wakeup. Reads and writes
+// may run on different threads, closing must not race either of them.
+class Socket
+{
+  // Longer lines are a broken or hostile peer
+  static constexpr const size_t MaxLine = 64 * 1024;
+
+public:
+  enum Result
+  {
+    Ready,
+    Timeout,
+    Interrupted,
+    Closed,
+  };
+
+  Socket()
+    : m_fd(-1)
+  {
+  }
+
+  explicit Socket(int fd)
+    : m_fd(fd)
+  {
+    configure();
+  }
+
+  ~Socket()
+  {
+    close();
+  }
+
+  Socket(const Socket &) = delete;
+  Socket &operator=(const Socket &) = delete;
+
+  Socket(Socket &&other)
+    : m_fd(other.m_fd)
+    , m_buffer(std::move(other.m_buffer))
+  {
+    other.m_fd = -1;
+  }
+
+  Socket &operator=(Socket &&other)
+  {
+    if (this != &other)
+    {
+      close();
+      m_fd = other.m_fd;
+      m_buffer = std::move(other.m_buffer);
+      other.m_fd = -1;
+    }
+    return *this;
+  }
+
+  // Tries every address the host resolves to, the timeout applies to each of them. Name resolution itself can't
+  // be interrupted.
+  Result connect(const std::string &host, uint16_t port, int64_t timeoutMs, const Wakeup &wakeup)
+  {
+    close();
+
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *addresses = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0)
+    {
+      return Closed;
+    }
+
+    Result result = Closed;
+    for (const addrinfo *address = addresses; address != nullptr && result != Ready; address = address->ai_next)
+    {
+      m_fd = socket(address->ai_family, address->ai_socktype | SOCK_CLOEXEC | SOCK_NONBLOCK, address->ai_protocol);
+      if (m_fd < 0)
+      {
+        continue;
+      }
+      if (::connect(m_fd, address->ai_addr, address->ai_addrlen) != 0 && errno != EINPROGRESS)
+      {
+        close();
+        continue;
+      }
+      result = wait(POLLOUT, timeoutMs, wakeup);
+      int error = 0;
+      socklen_t size = sizeof(error);
+      if (result == Ready && (getsockopt(m_fd, SOL_SOCKET, SO_ERROR, &error, &size) != 0 || error != 0))
+      {
+        result = Closed;
+      }
+      if (result != Ready)
+      {
+        close();
+      }
+      if (result == Interrupted)
+      {
+        break;
+      }
+    }
+    freeaddrinfo(addresses);
+
+    if (result == Ready)
+    {
+      configure();
+    }
+    return result;
+  }
+
+  // Line without the terminating newline or carriage return
+  Result readLine(std::string *line, int64_t timeoutMs, const Wakeup &wakeup)
+  {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    size_t end;
+    while ((end = m_buffer.find('\n')) == std::string::npos)
+    {
+      if (m_fd < 0 || m_buffer.size() > MaxLine)
+      {
+        return Closed;
+      }
+      const int64_t left =
+        std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+      const Result result = fill(std::max<int64_t>(left, 0), wakeup);
+      if (result != Ready)
+      {
+        return result;
+      }
+    }
+
+    line->assign(m_buffer, 0, end > 0 && m_buffer[end - 1] == '\r' ? end - 1 : end);
+    m_buffer.erase(0, end + 1);
+    return Ready;
+  }
+
+  // Exactly size bytes, lines read before may have buffered the start of them
+  Result read(std::string *data, size_t size, int64_t timeoutMs, const Wakeup &wakeup)
+  {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (m_buffer.size() < size)
+    {
+      const int64_t left =
+        std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+      const Result result = fill(std::max<int64_t>(left, 0), wakeup);
+      if (result != Ready)
+      {
+        return result;
+      }
+    }
+
+    data->assign(m_buffer, 0, size);
+    m_buffer.erase(0, size);
+    return Ready;
+  }
+
+  // Writes all of data unless the peer stops reading for the timeout
+  bool write(const std::string &data, int64_t timeoutMs)
+  {
+    size_t written = 0;
+    while (m_fd >= 0 && written < data.size())
+    {
+      const ssize_t sent = send(m_fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+      if (sent > 0)
+      {
+        written += sent;
+        continue;
+      }
+      if (errno != EAGAIN && errno != EINTR)
+      {
+        return false;
+      }
+      pollfd fd = {m_fd, POLLOUT, 0};
+      if (poll(&fd, 1, static_cast<int>(timeoutMs)) <= 0)
+      {
+        return false;
+      }
+    }
+    return written == data.size();
+  }
+
+  bool valid() const
+  {
+    return m_fd >= 0;
+  }
+
+  int fd() const
+  {
+    return m_fd;
+  }
+
+  // Makes pending and future reads on other threads fail without closing the descriptor under them
+  void shutdown()
+  {
+    if (m_fd >= 0)
+    {
+      ::shutdown(m_fd, SHUT_RDWR);
+    }
+  }
+
+  void close()
+  {
+    if (m_fd >= 0)
+    {
+      ::close(m_fd);
+      m_fd = -1;
+    }
+    m_buffer.clear();
+  }
+
+private:
+  // Appends whatever arrives next to the buffer
+  Result fill(int64_t timeoutMs, const Wakeup &wakeup)
+  {
+    if (m_fd < 0)
+    {
+      return Closed;
+    }
+    const Result result = wait(POLLIN, timeoutMs, wakeup);
+    if (result != Ready)
+    {
+      return result;
+    }
+
+    char buffer[4096];
+    const ssize_t received = recv(m_fd, buffer, sizeof(buffer), 0);
+    if (received == 0 || (received < 0 && errno != EAGAIN && errno != EINTR))
+    {
+      return Closed;
+    }
+    if (received > 0)
+    {
+      m_buffer.append(buffer, received);
+    }
+    return Ready;
+  }
+
+  Result wait(short events, int64_t timeoutMs, const Wakeup &wakeup)
+  {
+    pollfd fds[] = {{m_fd, events, 0}, {wakeup.fd(), POLLIN, 0}};
+    int ready;
+    while ((ready = poll(fds, 2, static_cast<int>(timeoutMs))) < 0 && errno == EINTR)
+    {
+    }
+    if (ready < 0)
+    {
+      return Closed;
+    }
+    if (fds[1].revents != 0)
+    {
+      return Interrupted;
+    }
+    return ready == 0 ? Timeout : Ready;
+  }
+
+  // Non-blocking without Nagle, stratum lines are small and latency bound
+  void configure()
+  {
+    if (m_fd < 0)
+    {
+      return;
+    }
+    fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL) | O_NONBLOCK);
+    const int enabled = 1;
+    setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, &enabled, sizeof(enabled));
+  }
+
+private:
+  int m_fd;
+  std::string m_buffer;
+};
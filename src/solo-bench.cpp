@@ -0,0 +1,298 @@
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "blocktemplate.h"
+#include "json.h"
+#include "miner.h"
+#include "mocknode.h"
+#include "solo.h"
+#include "utils.h"
+
+namespace
+{
+  // Shares of the other slots, the client's slot never reaches it
+  class NullSink : public ShareSink
+  {
+  public:
+    void deliver(const Share *, size_t) override
+    {
+    }
+  };
+
+  void usage(const char *name)
+  {
+    std::fprintf(
+      stderr,
+      "usage: %s [--threads N] [--seconds SECONDS] [--difficulty D] [--block-interval SECONDS] "
+      "[--tx-interval SECONDS] [--poll MS] [--vectors]\n",
+      name);
+  }
+
+  // Mainnet genesis block: its coinbase, header and block id
+  const char *const GenesisCoinbase =
+    "013c01ff0001ffffffffffff03029b2e4c0281c0b02e7c53291a94d1d0cbff8883f8024f5142ee494ffbbd08807121017767"
+    "aafcde9be00dcfd098715ebcf7f410daebc582fda69d24a28e9d0bc890d1";
+  const char *const GenesisCoinbaseHash = "c88ce9783b4f11190d7b9c17a69c1c52200f9faaee8e98dd07e6811175177139";
+  const char *const GenesisHeader = "010000000000000000000000000000000000000000000000000000000000000000000010270000";
+  const char *const GenesisId = "418015bb9ae982a1975da7d79277c2705727a56894ba0fb246adaabb1f4632e3";
+
+  // get_block_template reply for a v16 block with a view tagged coinbase output and four transactions, reserve
+  // size 8. The expected blobs were computed with an independent Keccak implementation.
+  const char *const TemplateReply =
+    "{\"id\":0,\"jsonrpc\":\"2.0\",\"result\":{\"blockhashing_blob\":\"101080e2cfaa06ff5602743b5e72cdd9ff"
+    "af04dfb885ac264e7b5a65837f7fd47630a54439e45500000000178123bc7a5b53f13736bcb6f981a93d7d1a515129445669"
+    "ef27cdceeea055f005\",\"blocktemplate_blob\":\"101080e2cfaa06ff5602743b5e72cdd9ffaf04dfb885ac264e7b5a"
+    "65837f7fd47630a54439e4550000000002fc8db70101ffc08db7010180e0a596bb11039ea6070005f499f4549385ea261d01"
+    "9ef91291c9b04f7ea35d0713ba4f5168ed5a2b01e4cc0bc153fa34818ed5b9c054afd33d0e9c09c86b031ccfca6245bef545"
+    "b3ec0208000000000000000000043687312a5ec1ed4bb8c298a9e6046ae240c1f31351799782899075a8713f1a99395fcbda"
+    "215cb6b0010b6923c57f6b2b4099324b3a8f876f0e01a31c4d720291d1d9fcddec139aa420bf112e9a265c82ca36227cbbce"
+    "d21bfaf1d39b30db2c8d2d195d0e890798c836341fcbd89ee0543c39ca172404153e50f1f5edd98e2568\",\"difficulty"
+    "\":360000000000,\"height\":3000000,\"prev_hash\":\"ff5602743b5e72cdd9ffaf04dfb885ac264e7b5a65837f7fd"
+    "47630a54439e455\",\"reserved_offset\":131,\"seed_hash\":\"000000000000000000000000000000000000000000"
+    "0000000000000000000000\",\"status\":\"OK\"}}";
+  const BlockTemplate::ExtraNonce TemplateExtraNonce = 0x0badc0de;
+  const Job::Nonce TemplateNonce = 0x12345678;
+  const char *const TemplateHashingBlob =
+    "101080e2cfaa06ff5602743b5e72cdd9ffaf04dfb885ac264e7b5a65837f7fd47630a54439e45500000000dae955eb2260c4"
+    "6194cd2ecf76579f1b2e8184b1957fa3a37c3d6b43ce96285c05";
+  const char *const TemplateBlockBlob =
+    "101080e2cfaa06ff5602743b5e72cdd9ffaf04dfb885ac264e7b5a65837f7fd47630a54439e4557856341202fc8db70101ff"
+    "c08db7010180e0a596bb11039ea6070005f499f4549385ea261d019ef91291c9b04f7ea35d0713ba4f5168ed5a2b01e4cc0b"
+    "c153fa34818ed5b9c054afd33d0e9c09c86b031ccfca6245bef545b3ec0208dec0ad0b0000000000043687312a5ec1ed4bb8"
+    "c298a9e6046ae240c1f31351799782899075a8713f1a99395fcbda215cb6b0010b6923c57f6b2b4099324b3a8f876f0e01a3"
+    "1c4d720291d1d9fcddec139aa420bf112e9a265c82ca36227cbbced21bfaf1d39b30db2c8d2d195d0e890798c836341fcbd8"
+    "9ee0543c39ca172404153e50f1f5edd98e2568";
+
+  bool check(const char *name, bool passed)
+  {
+    std::printf("%s: %s\n", name, passed ? "ok" : "MISMATCH");
+    return passed;
+  }
+
+  std::vector<uint8_t> fromHex(const char *hex)
+  {
+    std::vector<uint8_t> buffer;
+    hexToBuffer(hex, &buffer);
+    return buffer;
+  }
+
+  // The mock node's hashing against a real block, and BlockTemplate against the mock node and fixed vectors
+  bool checkVectors()
+  {
+    bool passed = true;
+
+    const std::vector<uint8_t> genesisCoinbase = fromHex(GenesisCoinbase);
+    const std::vector<uint8_t> genesisHeader = fromHex(GenesisHeader);
+    // A v1 transaction hashes as a whole
+    const Keccak::Hash genesisCoinbaseHash = Keccak::hash(&genesisCoinbase[0], genesisCoinbase.size());
+    passed &= check(
+      "genesis coinbase hash", bufferToHex(&genesisCoinbaseHash[0], genesisCoinbaseHash.size()) == GenesisCoinbaseHash);
+    const std::vector<Keccak::Hash> genesisHashes(1, genesisCoinbaseHash);
+    const Keccak::Hash genesisId =
+      MockNode::blockId(MockNode::hashingBlob(&genesisHeader[0], genesisHeader.size(), genesisHashes));
+    passed &= check("genesis block id", bufferToHex(&genesisId[0], genesisId.size()) == GenesisId);
+
+    Json reply;
+    BlockTemplate layout;
+    const std::vector<uint8_t> hashingBlob = fromHex(TemplateHashingBlob);
+    const std::vector<uint8_t> blockBlob = fromHex(TemplateBlockBlob);
+    if (!check("template reply", Json::parse(TemplateReply, &reply)) ||
+        !check(
+          "template parse",
+          layout.parse(
+            fromHex(reply["result"]["blocktemplate_blob"].string().c_str()),
+            static_cast<size_t>(reply["result"]["reserved_offset"].number()),
+            SoloClient::ReserveSize)))
+    {
+      return false;
+    }
+    passed &= check(
+      "template hashing blob",
+      layout.hashingBlob(0) == fromHex(reply["result"]["blockhashing_blob"].string().c_str()));
+    passed &= check("extra nonce hashing blob", layout.hashingBlob(TemplateExtraNonce) == hashingBlob);
+    passed &= check("block blob", layout.blockBlob(TemplateExtraNonce, TemplateNonce) == blockBlob);
+
+    // The mock node rebuilds the hashing blob from the submitted block itself: header, the coinbase prefix up to
+    // the RingCT type and the transaction hashes at the end
+    const size_t headerSize = Job::NonceOffset + sizeof(Job::Nonce);
+    const size_t prefixEnd = static_cast<size_t>(reply["result"]["reserved_offset"].number()) + SoloClient::ReserveSize;
+    std::vector<Keccak::Hash> hashes(1, MockNode::coinbaseHash(&blockBlob[headerSize], prefixEnd - headerSize));
+    for (size_t offset = prefixEnd + 2; offset < blockBlob.size(); offset += 32)
+    {
+      hashes.emplace_back();
+      std::copy(&blockBlob[offset], &blockBlob[offset] + 32, hashes.back().begin());
+    }
+    std::vector<uint8_t> rebuilt = MockNode::hashingBlob(&blockBlob[0], headerSize, hashes);
+    std::fill(rebuilt.begin() + Job::NonceOffset, rebuilt.begin() + headerSize, 0);
+    passed &= check("mock node hashing blob", rebuilt == hashingBlob);
+
+    std::array<uint8_t, RANDOMX_HASH_SIZE> hash;
+    hash.fill(0xff);
+    passed &= check("difficulty 1", MockNode::meetsDifficulty(&hash[0], 1) && !MockNode::meetsDifficulty(&hash[0], 2));
+    hash.fill(0);
+    hash[RANDOMX_HASH_SIZE - 1] = 0x01;
+    passed &= check(
+      "difficulty 2^248",
+      MockNode::meetsDifficulty(&hash[0], 255) && !MockNode::meetsDifficulty(&hash[0], 256));
+    return passed;
+  }
+
+  double percentile(std::vector<double> values, double fraction)
+  {
+    if (values.empty())
+    {
+      return 0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, static_cast<size_t>(fraction * values.size()))];
+  }
+
+  std::chrono::steady_clock::duration seconds(double value)
+  {
+    return std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(value));
+  }
+} // namespace
+
+// Solo mines against a stand-in node on the loopback interface whose tip moves on its own and with every block
+// found, and reports how quickly new templates reach the hashers
+int main(int argc, char *argv[])
+{
+  size_t threads = 0;
+  double duration = 20;
+  uint64_t difficulty = 5000;
+  double blockInterval = 5;
+  double txInterval = 1;
+  int64_t pollMs = SoloClient::PollMs;
+
+  for (int index = 1; index < argc; ++index)
+  {
+    const std::string arg = argv[index];
+    const bool hasValue = index + 1 < argc;
+    if (arg == "--threads" && hasValue)
+    {
+      threads = std::strtoul(argv[++index], nullptr, 10);
+    }
+    else if (arg == "--seconds" && hasValue)
+    {
+      duration = std::strtod(argv[++index], nullptr);
+    }
+    else if (arg == "--difficulty" && hasValue)
+    {
+      difficulty = std::strtoull(argv[++index], nullptr, 10);
+    }
+    else if (arg == "--block-interval" && hasValue)
+    {
+      blockInterval = std::strtod(argv[++index], nullptr);
+    }
+    else if (arg == "--tx-interval" && hasValue)
+    {
+      txInterval = std::strtod(argv[++index], nullptr);
+    }
+    else if (arg == "--poll" && hasValue)
+    {
+      pollMs = std::strtoll(argv[++index], nullptr, 10);
+    }
+    else if (arg == "--vectors")
+    {
+      return checkVectors() ? 0 : 1;
+    }
+    else
+    {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (difficulty == 0 || duration <= 0 || blockInterval <= 0 || txInterval <= 0 || pollMs <= 0)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  MockNode node(difficulty);
+  NullSink sink;
+  Miner miner(sink, threads);
+  miner.setCpuLoad(1.0);
+  std::unique_ptr<SoloClient> client(new SoloClient(miner, 0, "127.0.0.1", node.port(), "wallet", pollMs));
+
+  const auto started = std::chrono::steady_clock::now();
+  auto nextBlock = started + seconds(blockInterval);
+  auto nextTx = started + seconds(txInterval);
+  while (std::chrono::steady_clock::now() - started < seconds(duration))
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    const auto now = std::chrono::steady_clock::now();
+    if (now >= nextBlock)
+    {
+      node.advance();
+      nextBlock += seconds(blockInterval);
+    }
+    if (now >= nextTx)
+    {
+      node.addTransaction();
+      nextTx += seconds(txInterval);
+    }
+  }
+
+  const SoloStats stats = client->stats();
+  client.reset();
+  miner.stop();
+  const MockNodeStats nodeStats = node.stats();
+
+  std::printf(
+    "node: %llu header polls, %llu templates, %llu blocks accepted, %llu rejected\n",
+    static_cast<unsigned long long>(nodeStats.headers),
+    static_cast<unsigned long long>(nodeStats.templates),
+    static_cast<unsigned long long>(nodeStats.accepted),
+    static_cast<unsigned long long>(nodeStats.rejected));
+  std::printf(
+    "tip to template: %zu tips, p50 %.3f ms, max %.3f ms\n",
+    nodeStats.tipToTemplate.size(),
+    percentile(nodeStats.tipToTemplate, 0.50),
+    percentile(nodeStats.tipToTemplate, 1.0));
+  std::printf(
+    "client: height %llu, %llu templates, %llu extra nonces, %llu accepted, %llu rejected, %llu stale\n",
+    static_cast<unsigned long long>(stats.height),
+    static_cast<unsigned long long>(stats.templates),
+    static_cast<unsigned long long>(stats.extraNonces),
+    static_cast<unsigned long long>(stats.accepted),
+    static_cast<unsigned long long>(stats.rejected),
+    static_cast<unsigned long long>(stats.stale));
+  std::printf("template switch: avg %.1f us, max %.1f us\n", stats.switchLatency, stats.maxSwitchLatency);
+  return 0;
+}
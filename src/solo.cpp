@@ -0,0 +1,323 @@
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "solo.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <random>
+
+#include "utils.h"
+
+SoloClient::SoloClient(
+  Miner &miner,
+  uint32_t slot,
+  const std::string &host,
+  uint16_t port,
+  const std::string &wallet,
+  int64_t pollMs)
+  : m_miner(miner)
+  , m_slot(slot)
+  , m_wallet(wallet)
+  , m_pollMs(pollMs)
+  , m_stopping(false)
+  , m_refreshRequested(false)
+  , m_rpc(host, port)
+  , m_submitRpc(host, port)
+  , m_nextSequence(0)
+  // Random start, other rigs on the same wallet and node get the same templates
+  , m_extraNonceBase(std::random_device()())
+  , m_stats{false, 0, 0, 0, 0, 0, 0, 0, 0}
+  , m_switchLatencySum(0)
+{
+  if (!m_miner.setSlotSink(m_slot, this))
+  {
+    throw std::runtime_error("invalid slot");
+  }
+  m_thread = std::thread([this]() {
+    thread();
+  });
+  m_submitThread = std::thread([this]() {
+    submitThread();
+  });
+}
+
+SoloClient::~SoloClient()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_stopping = true;
+  }
+  m_wakeup.notify();
+  m_foundChanged.notify_all();
+  m_refreshChanged.notify_all();
+  m_thread.join();
+  m_submitThread.join();
+  // Waits for a batch being delivered to the client to finish
+  m_miner.setSlotSink(m_slot, nullptr);
+  m_miner.removeJob(m_slot);
+}
+
+SoloStats SoloClient::stats() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  SoloStats stats = m_stats;
+  stats.switchLatency = m_stats.templates != 0 ? m_switchLatencySum / m_stats.templates : 0;
+  return stats;
+}
+
+void SoloClient::deliver(const Share *shares, size_t count)
+{
+  for (size_t index = 0; index < count; ++index)
+  {
+    const Share &share = shares[index];
+    BlockTemplate::ExtraNonce extraNonce;
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    const std::shared_ptr<Template> block = find(std::string(&share.id[0], share.idSize), &extraNonce);
+    if (!block || m_templates.back()->prevHash != block->prevHash)
+    {
+      m_stats.stale += share.exhausted ? 0 : 1;
+      continue;
+    }
+
+    if (share.exhausted)
+    {
+      // Only the current template is worth continuing, the hashers already left older ones
+      if (block != m_templates.back() || block->extraNonce != extraNonce)
+      {
+        continue;
+      }
+      if (!block->rebuild)
+      {
+        m_refreshRequested = true;
+        m_refreshChanged.notify_one();
+        continue;
+      }
+      ++block->extraNonce;
+      ++m_stats.extraNonces;
+      publish(*block);
+      continue;
+    }
+
+    std::vector<uint8_t> blob;
+    if (block->rebuild)
+    {
+      blob = block->layout.blockBlob(extraNonce, share.nonce);
+    }
+    else
+    {
+      blob = block->blob;
+      const uint8_t *nonce = &share.blob[Job::NonceOffset];
+      std::copy(nonce, nonce + sizeof(Job::Nonce), blob.begin() + Job::NonceOffset);
+    }
+    m_found.push_back(std::move(blob));
+    m_foundChanged.notify_one();
+  }
+}
+
+void SoloClient::submitThread()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true)
+  {
+    m_foundChanged.wait(lock, [this]() {
+      return m_stopping || !m_found.empty();
+    });
+    if (m_stopping)
+    {
+      break;
+    }
+    const std::vector<uint8_t> blob = std::move(m_found.front());
+    m_found.pop_front();
+    lock.unlock();
+
+    Json reply;
+    const bool sent = m_submitRpc.call("submit_block", "[\"" + bufferToHex(blob) + "\"]", &reply, m_wakeup);
+    const bool accepted = sent && reply["error"].isNull() && reply["result"]["status"].string() == "OK";
+
+    lock.lock();
+    ++(accepted ? m_stats.accepted : m_stats.rejected);
+    // The tip moved on to this block, the client thread fetches the next template right away
+    if (accepted)
+    {
+      m_refreshRequested = true;
+      m_refreshChanged.notify_one();
+    }
+  }
+}
+
+void SoloClient::thread()
+{
+  std::string tip;
+  auto refreshed = std::chrono::steady_clock::now();
+  int64_t backoffMs = m_pollMs;
+  while (!m_stopping)
+  {
+    Json reply;
+    bool connected = m_rpc.call("get_last_block_header", "{}", &reply, m_wakeup) && reply["error"].isNull();
+    const std::string &hash = reply["result"]["block_header"]["hash"].string();
+    const auto now = std::chrono::steady_clock::now();
+    // Taken even without a connection, the next template after reconnecting is fresh anyway
+    const bool requested = m_refreshRequested.exchange(false);
+    if (connected && (hash != tip || requested || now - refreshed > std::chrono::milliseconds(RefreshMs)))
+    {
+      connected = refresh();
+      tip = connected ? hash : std::string();
+      refreshed = now;
+    }
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+
+      m_stats.connected = connected;
+    }
+
+    int64_t delayMs = m_pollMs;
+    if (connected)
+    {
+      backoffMs = m_pollMs;
+    }
+    else
+    {
+      // Blocks found meanwhile couldn't be submitted, the threads go to the other slots
+      m_miner.removeJob(m_slot);
+      tip.clear();
+      delayMs = backoffMs;
+      backoffMs = std::min(backoffMs * 2, BackoffMaxMs);
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    m_refreshChanged.wait_for(lock, std::chrono::milliseconds(delayMs), [this]() {
+      return m_stopping || m_refreshRequested;
+    });
+  }
+}
+
+// Fetches the block template and publishes it unless it is the one being hashed, false if the node failed
+bool SoloClient::refresh()
+{
+  Json reply;
+  const std::string params =
+    "{\"wallet_address\":" + Json::quote(m_wallet) + ",\"reserve_size\":" + std::to_string(ReserveSize) + "}";
+  if (!m_rpc.call("get_block_template", params, &reply, m_wakeup) || !reply["error"].isNull())
+  {
+    return false;
+  }
+  const auto received = std::chrono::steady_clock::now();
+
+  const Json &result = reply["result"];
+  std::shared_ptr<Template> block = std::make_shared<Template>();
+  std::vector<uint8_t> seedHash;
+  if (!hexToBuffer(result["blocktemplate_blob"].string(), &block->blob) ||
+      !hexToBuffer(result["blockhashing_blob"].string(), &block->hashingBlob) ||
+      !Job::validateBlob(block->hashingBlob) ||
+      !hexToBuffer(result["seed_hash"].string(), &seedHash) || !Job::validateSeedHash(seedHash) ||
+      !(result["difficulty"].number() >= 1) || !(result["height"].number() >= 0) ||
+      !(result["reserved_offset"].number() >= 0))
+  {
+    return false;
+  }
+  block->prevHash = result["prev_hash"].string();
+  block->height = static_cast<uint64_t>(result["height"].number());
+  block->difficulty = static_cast<uint64_t>(result["difficulty"].number());
+  std::copy(seedHash.begin(), seedHash.end(), block->seedHash.begin());
+  // The node leaves the reserved bytes zeroed, a rebuild with extra nonce 0 must come out as its own hashing blob
+  const size_t reservedOffset = static_cast<size_t>(result["reserved_offset"].number());
+  block->rebuild = block->layout.parse(block->blob, reservedOffset, ReserveSize) &&
+                   block->layout.hashingBlob(0) == block->hashingBlob;
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Same transactions on the same tip, the hashers keep their nonces
+    if (!m_templates.empty() && m_templates.back()->blob == block->blob)
+    {
+      return true;
+    }
+    block->sequence = m_nextSequence++;
+    block->extraNonce = block->rebuild ? m_extraNonceBase : 0;
+    m_templates.push_back(block);
+    if (m_templates.size() > RecentTemplates)
+    {
+      m_templates.pop_front();
+    }
+    publish(*block);
+
+    const double latency =
+      std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - received).count();
+    ++m_stats.templates;
+    m_stats.height = block->height;
+    m_switchLatencySum += latency;
+    m_stats.maxSwitchLatency = std::max(m_stats.maxSwitchLatency, latency);
+  }
+
+  std::vector<uint8_t> nextSeedHash;
+  if (hexToBuffer(result["next_seed_hash"].string(), &nextSeedHash) && Job::validateSeedHash(nextSeedHash) &&
+      nextSeedHash != seedHash)
+  {
+    Job::SeedHash next;
+    std::copy(nextSeedHash.begin(), nextSeedHash.end(), next.begin());
+    m_miner.prepare(next);
+  }
+  return true;
+}
+
+// Hands the template with its current extra nonce to the hashers, must be called with the mutex held
+void SoloClient::publish(const Template &block)
+{
+  const std::string id = std::to_string(block.sequence) + "." + std::to_string(block.extraNonce);
+  const std::vector<uint8_t> blob = block.rebuild ? block.layout.hashingBlob(block.extraNonce) : block.hashingBlob;
+  m_miner.setJob(m_slot, Job(id, blob, block.seedHash, block.height, Target::fromDifficulty(block.difficulty)));
+}
+
+// Template and extra nonce a job id was published with, nullptr once the template was dropped. Must be called with
+// the mutex held.
+std::shared_ptr<SoloClient::Template>
+SoloClient::find(const std::string &jobId, BlockTemplate::ExtraNonce *extraNonce) const
+{
+  char *end;
+  const uint64_t sequence = std::strtoull(jobId.c_str(), &end, 10);
+  if (*end != '.')
+  {
+    return nullptr;
+  }
+  *extraNonce = static_cast<BlockTemplate::ExtraNonce>(std::strtoul(end + 1, nullptr, 10));
+  for (const std::shared_ptr<Template> &block : m_templates)
+  {
+    if (block->sequence == sequence)
+    {
+      return block;
+    }
+  }
+  return nullptr;
+}
@@ -0,0 +1,152 @@
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "blocktemplate.h"
+#include "delivery.h"
+#include "miner.h"
+#include "rpc.h"
+#include "shares.h"
+#include "socket.h"
+
+struct SoloStats
+{
+  // The last call to the node succeeded
+  bool connected;
+  uint64_t height;
+  uint64_t templates;
+  // Fresh nonce space made locally when a job ran out
+  uint64_t extraNonces;
+  uint64_t accepted;
+  uint64_t rejected;
+  // Found on a template whose previous block is no longer the tip, never submitted
+  uint64_t stale;
+  // Microseconds from a template reply to its job being published, including the blob rebuild
+  double switchLatency;
+  double maxSwitchLatency;
+};
+
+// Solo mining for one job slot against monerod's RPC. The tip is polled with a cheap header request, the block
+// template is only fetched again when the tip moves or the template got old. Found blocks are queued by the
+// delivery thread and go out through submit_block from a thread of the client, so a slow node never holds up the
+// shares of other slots. The hashing blob is rebuilt locally with an extra nonce in the reserved
+// bytes of the coinbase, so a job running out of nonces continues on fresh work without a round trip and rigs
+// mining to the same wallet don't repeat each other's work.
+class SoloClient : public ShareSink
+{
+public:
+  static constexpr const int64_t PollMs = 1000;
+  // Picks up transactions that entered the mempool since the last template
+  static constexpr const int64_t RefreshMs = 30 * 1000;
+  static constexpr const int64_t BackoffMaxMs = 60 * 1000;
+  static constexpr const size_t ReserveSize = 8;
+  // Blocks on templates replaced since are still submitted as long as the tip didn't move
+  static constexpr const size_t RecentTemplates = 4;
+
+  SoloClient(
+    Miner &miner,
+    uint32_t slot,
+    const std::string &host,
+    uint16_t port,
+    const std::string &wallet,
+    int64_t pollMs = PollMs);
+  // Removes the slot's job and routes its shares back to the miner's sink
+  ~SoloClient();
+
+  SoloClient(const SoloClient &) = delete;
+  SoloClient &operator=(const SoloClient &) = delete;
+
+  SoloStats stats() const;
+
+  void deliver(const Share *shares, size_t count) override;
+
+private:
+  struct Template
+  {
+    uint64_t sequence;
+    std::string prevHash;
+    uint64_t height;
+    uint64_t difficulty;
+    Job::SeedHash seedHash;
+    std::vector<uint8_t> blob;
+    // The node's hashing blob, used as is if the template can't be rebuilt locally
+    std::vector<uint8_t> hashingBlob;
+    bool rebuild;
+    BlockTemplate layout;
+    // Last one published, guarded by the mutex
+    BlockTemplate::ExtraNonce extraNonce;
+  };
+
+  void thread();
+  void submitThread();
+  bool refresh();
+  void publish(const Template &block);
+  std::shared_ptr<Template> find(const std::string &jobId, BlockTemplate::ExtraNonce *extraNonce) const;
+
+private:
+  Miner &m_miner;
+  const uint32_t m_slot;
+  const std::string m_wallet;
+  const int64_t m_pollMs;
+
+  Wakeup m_wakeup;
+  std::atomic<bool> m_stopping;
+  std::atomic<bool> m_refreshRequested;
+  // Client thread only
+  RpcClient m_rpc;
+  // Submit thread only
+  RpcClient m_submitRpc;
+
+  mutable std::mutex m_mutex;
+  // Newest last
+  std::deque<std::shared_ptr<Template>> m_templates;
+  uint64_t m_nextSequence;
+  BlockTemplate::ExtraNonce m_extraNonceBase;
+  SoloStats m_stats;
+  double m_switchLatencySum;
+  // Block blobs waiting for submit_block, oldest first
+  std::deque<std::vector<uint8_t>> m_found;
+  std::condition_variable m_foundChanged;
+  // Wakes the client thread between polls when a refresh is requested or the client stops
+  std::condition_variable m_refreshChanged;
+
+  std::thread m_thread;
+  std::thread m_submitThread;
+};
@@ -0,0 +1,203 @@
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "miner.h"
+#include "mockpool.h"
+#include "stratum.h"
+
+namespace
+{
+  constexpr const char DefaultBlob[] =
+    "0707f7a4f0d605b303260816ba3f10902e1a145ac5fad3aa3af6ea44c11869dc4f853f002b2eea0000000077b206a02ca5b1d4ce6bbfdf"
+    "0acac38bded34d2dcdeef95cd20cefc12f61d56109";
+
+  // Shares of the other slots, the client's slot never reaches it
+  class NullSink : public ShareSink
+  {
+  public:
+    void deliver(const Share *, size_t) override
+    {
+    }
+  };
+
+  void usage(const char *name)
+  {
+    std::fprintf(
+      stderr,
+      "usage: %s [--threads N] [--seconds SECONDS] [--job-interval SECONDS] [--difficulty D] [--drop SECONDS] "
+      "[--failover]\n",
+      name);
+  }
+
+  double percentile(std::vector<double> values, double fraction)
+  {
+    if (values.empty())
+    {
+      return 0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, static_cast<size_t>(fraction * values.size()))];
+  }
+} // namespace
+
+// Runs the native stratum client against a mock pool on the loopback interface and reports how fast jobs reach
+// the hashers and shares reach the pool
+int main(int argc, char *argv[])
+{
+  size_t threads = 0;
+  double seconds = 20;
+  double jobInterval = 2;
+  // Every hash is a share, so the first share of a job also marks its first hash
+  uint64_t difficulty = 1;
+  double dropAt = -1;
+  bool failover = false;
+
+  for (int index = 1; index < argc; ++index)
+  {
+    const std::string arg = argv[index];
+    const bool hasValue = index + 1 < argc;
+    if (arg == "--threads" && hasValue)
+    {
+      threads = std::strtoul(argv[++index], nullptr, 10);
+    }
+    else if (arg == "--seconds" && hasValue)
+    {
+      seconds = std::strtod(argv[++index], nullptr);
+    }
+    else if (arg == "--job-interval" && hasValue)
+    {
+      jobInterval = std::strtod(argv[++index], nullptr);
+    }
+    else if (arg == "--difficulty" && hasValue)
+    {
+      difficulty = std::strtoull(argv[++index], nullptr, 10);
+    }
+    else if (arg == "--drop" && hasValue)
+    {
+      dropAt = std::strtod(argv[++index], nullptr);
+    }
+    else if (arg == "--failover")
+    {
+      failover = true;
+    }
+    else
+    {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (difficulty == 0 || seconds <= 0 || jobInterval <= 0)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  const std::string seedHash(RANDOMX_HASH_SIZE * 2, '0');
+  MockPool pool(DefaultBlob, seedHash, std::numeric_limits<uint64_t>::max() / difficulty);
+  std::vector<Pool> pools;
+  if (failover)
+  {
+    // Nothing listens on the first one, the client has to move on to the mock pool
+    pools.push_back({"127.0.0.1", 1, "bench", "x", ""});
+  }
+  pools.push_back({"127.0.0.1", pool.port(), "bench", "x", ""});
+
+  NullSink sink;
+  Miner miner(sink, threads);
+  miner.setCpuLoad(1.0);
+  std::unique_ptr<StratumClient> client(new StratumClient(miner, 0, pools));
+
+  const auto started = std::chrono::steady_clock::now();
+  auto nextJob = started + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                             std::chrono::duration<double>(jobInterval));
+  bool dropped = dropAt < 0;
+  while (std::chrono::steady_clock::now() - started < std::chrono::duration<double>(seconds))
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    const auto now = std::chrono::steady_clock::now();
+    if (!dropped && now - started >= std::chrono::duration<double>(dropAt))
+    {
+      pool.drop();
+      dropped = true;
+    }
+    if (now >= nextJob)
+    {
+      pool.pushJob();
+      nextJob += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(jobInterval));
+    }
+  }
+
+  const StratumStats stats = client->stats();
+  client.reset();
+  miner.stop();
+  const MockPoolStats poolStats = pool.stats();
+
+  std::vector<double> firstShare;
+  for (double latency : poolStats.firstShare)
+  {
+    if (latency >= 0)
+    {
+      firstShare.push_back(latency);
+    }
+  }
+  std::printf(
+    "pool: %llu logins, %llu jobs, %llu shares, %llu for unknown jobs\n",
+    static_cast<unsigned long long>(poolStats.logins),
+    static_cast<unsigned long long>(poolStats.jobs),
+    static_cast<unsigned long long>(poolStats.shares),
+    static_cast<unsigned long long>(poolStats.unknown));
+  std::printf(
+    "job to first share: %zu jobs, p50 %.3f ms, p90 %.3f ms, max %.3f ms\n",
+    firstShare.size(),
+    percentile(firstShare, 0.50),
+    percentile(firstShare, 0.90),
+    percentile(firstShare, 1.0));
+  std::printf(
+    "client: %llu jobs, %llu accepted, %llu rejected, %llu stale, %llu reconnects\n",
+    static_cast<unsigned long long>(stats.jobs),
+    static_cast<unsigned long long>(stats.accepted),
+    static_cast<unsigned long long>(stats.rejected),
+    static_cast<unsigned long long>(stats.stale),
+    static_cast<unsigned long long>(stats.reconnects));
+  std::printf("submit latency: avg %.3f ms, max %.3f ms\n", stats.submitLatency, stats.maxSubmitLatency);
+  std::printf("shares dropped by the queue: %llu\n", static_cast<unsigned long long>(miner.sharesDropped()));
+  return 0;
+}
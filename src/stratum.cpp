@@ -0,0 +1,409 @@
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "stratum.h"
+
+#include <algorithm>
+
+#include "utils.h"
+
+StratumClient::StratumClient(Miner &miner, uint32_t slot, std::vector<Pool> pools)
+  : m_miner(miner)
+  , m_slot(slot)
+  , m_pools(std::move(pools))
+  , m_stopping(false)
+  , m_nextId(1)
+  , m_stats{false, 0, 0, 0, 0, 0, 0, 0, 0}
+  , m_submitLatencySum(0)
+{
+  if (m_pools.empty())
+  {
+    throw std::runtime_error("no pools");
+  }
+  if (!m_miner.setSlotSink(m_slot, this))
+  {
+    throw std::runtime_error("invalid slot");
+  }
+  m_thread = std::thread([this]() {
+    thread();
+  });
+}
+
+StratumClient::~StratumClient()
+{
+  m_stopping = true;
+  m_wakeup.notify();
+  m_thread.join();
+  // Waits for a batch being delivered to the client to finish
+  m_miner.setSlotSink(m_slot, nullptr);
+  m_miner.removeJob(m_slot);
+}
+
+StratumStats StratumClient::stats() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  StratumStats stats = m_stats;
+  const uint64_t replies = m_stats.accepted + m_stats.rejected;
+  stats.submitLatency = replies != 0 ? m_submitLatencySum / replies : 0;
+  return stats;
+}
+
+void StratumClient::deliver(const Share *shares, size_t count)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  const size_t queued = m_outbox.size();
+  for (size_t index = 0; index < count; ++index)
+  {
+    const Share &share = shares[index];
+    const std::string jobId(&share.id[0], share.idSize);
+    if (m_sessionId.empty())
+    {
+      m_stats.stale += share.exhausted ? 0 : 1;
+      continue;
+    }
+
+    if (m_outbox.size() >= MaxPending)
+    {
+      m_stats.stale += share.exhausted ? 0 : 1;
+      continue;
+    }
+
+    if (share.exhausted)
+    {
+      request(GetJob, "getjob", "{\"id\":" + Json::quote(m_sessionId) + "}");
+      continue;
+    }
+    if (std::find(m_jobIds.begin(), m_jobIds.end(), jobId) == m_jobIds.end())
+    {
+      ++m_stats.stale;
+      continue;
+    }
+    request(
+      Submit,
+      "submit",
+      "{\"id\":" + Json::quote(m_sessionId) + ",\"job_id\":" + Json::quote(jobId) + ",\"nonce\":\"" +
+        bufferToHex(&share.blob[Job::NonceOffset], sizeof(Job::Nonce)) + "\",\"result\":\"" +
+        bufferToHex(&share.hash[0], share.hash.size()) + "\"}");
+  }
+  const bool wake = m_outbox.size() != queued;
+  lock.unlock();
+
+  if (wake)
+  {
+    m_wakeup.notify();
+  }
+}
+
+void StratumClient::thread()
+{
+  size_t pool = 0;
+  size_t failures = 0;
+  int64_t backoffMs = BackoffMinMs;
+  while (!m_stopping)
+  {
+    const bool gotJob = session(pool);
+    // Nothing found from here on could be submitted, the threads go to the other slots
+    m_miner.removeJob(m_slot);
+    if (m_stopping)
+    {
+      break;
+    }
+
+    int64_t delayMs = 0;
+    if (gotJob)
+    {
+      // Worked before, try the same pool again
+      failures = 0;
+      backoffMs = BackoffMinMs;
+      delayMs = BackoffMinMs;
+    }
+    else
+    {
+      pool = (pool + 1) % m_pools.size();
+      if (++failures % m_pools.size() == 0)
+      {
+        delayMs = backoffMs;
+        backoffMs = std::min(backoffMs * 2, BackoffMaxMs);
+      }
+    }
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+
+      ++m_stats.reconnects;
+    }
+    if (delayMs > 0 && !m_wakeup.sleep(delayMs))
+    {
+      break;
+    }
+  }
+}
+
+// Connects, logs in and handles the pool's messages until the connection fails, returns whether any job came in
+bool StratumClient::session(size_t pool)
+{
+  const Pool &config = m_pools[pool];
+  Socket socket;
+  if (socket.connect(config.host, config.port, ConnectTimeoutMs, m_wakeup) != Socket::Ready)
+  {
+    return false;
+  }
+
+  m_socket = std::move(socket);
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_stats.pool = pool;
+    std::string params = "{\"login\":" + Json::quote(config.login) + ",\"pass\":" + Json::quote(config.password) +
+                         ",\"agent\":\"monero-android-miner\",\"algo\":[\"rx/0\"]";
+    if (!config.rigId.empty())
+    {
+      params += ",\"rigid\":" + Json::quote(config.rigId);
+    }
+    request(Login, "login", params + "}");
+  }
+  flush();
+
+  bool gotJob = false;
+  auto lastReceived = std::chrono::steady_clock::now();
+  std::string line;
+  while (!m_stopping)
+  {
+    const Socket::Result result = m_socket.readLine(&line, KeepaliveMs / 4, m_wakeup);
+    if (result == Socket::Interrupted)
+    {
+      // Lines were queued or the client is stopping, the loop condition tells them apart. m_stopping is set before
+      // the notification, so a reset can't lose it.
+      m_wakeup.reset();
+      flush();
+      continue;
+    }
+    const auto now = std::chrono::steady_clock::now();
+    if (result == Socket::Ready)
+    {
+      lastReceived = now;
+      if (!handle(line, &gotJob))
+      {
+        break;
+      }
+      flush();
+      continue;
+    }
+    if (result != Socket::Timeout || now - lastReceived > std::chrono::milliseconds(IdleTimeoutMs))
+    {
+      break;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+
+      if (!m_sessionId.empty() && now - m_lastSent > std::chrono::milliseconds(KeepaliveMs))
+      {
+        request(Keepalive, "keepalived", "{\"id\":" + Json::quote(m_sessionId) + "}");
+      }
+    }
+    flush();
+  }
+
+  disconnect();
+  return gotJob;
+}
+
+// False if the message means the connection is of no use
+bool StratumClient::handle(const std::string &line, bool *gotJob)
+{
+  Json message;
+  if (!Json::parse(line, &message))
+  {
+    return false;
+  }
+
+  if (message["method"].string() == "job")
+  {
+    if (!setJob(message["params"]))
+    {
+      return false;
+    }
+    *gotJob = true;
+    return true;
+  }
+  if (message["id"].type() != Json::Number)
+  {
+    return true;
+  }
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  const uint64_t id = static_cast<uint64_t>(message["id"].number());
+  const auto found = std::find_if(m_pending.begin(), m_pending.end(), [id](const Request &request) {
+    return request.id == id;
+  });
+  if (found == m_pending.end())
+  {
+    return true;
+  }
+  const Request request = *found;
+  m_pending.erase(found);
+
+  const Json &error = message["error"];
+  const Json &result = message["result"];
+  if (request.kind == Login)
+  {
+    if (!error.isNull() || result["id"].string().empty())
+    {
+      return false;
+    }
+    m_sessionId = result["id"].string();
+    m_stats.connected = true;
+    lock.unlock();
+    if (!setJob(result["job"]))
+    {
+      return false;
+    }
+    *gotJob = true;
+    return true;
+  }
+  if (request.kind == Submit)
+  {
+    const double latency =
+      std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - request.sent).count();
+    m_submitLatencySum += latency;
+    m_stats.maxSubmitLatency = std::max(m_stats.maxSubmitLatency, latency);
+    ++(error.isNull() && result["status"].string() == "OK" ? m_stats.accepted : m_stats.rejected);
+    return true;
+  }
+  if (request.kind == GetJob && error.isNull())
+  {
+    lock.unlock();
+    *gotJob |= setJob(result);
+  }
+  return true;
+}
+
+// Publishes the job to the miner, false if any field is malformed
+bool StratumClient::setJob(const Json &job)
+{
+  std::vector<uint8_t> blob;
+  std::vector<uint8_t> target;
+  std::vector<uint8_t> seedHash;
+  const std::string &id = job["job_id"].string();
+  if (!hexToBuffer(job["blob"].string(), &blob) || !Job::validateBlob(blob) ||
+      !hexToBuffer(job["target"].string(), &target) || !Target::validateSize(target.size()) ||
+      !hexToBuffer(job["seed_hash"].string(), &seedHash) || !Job::validateSeedHash(seedHash) || id.empty() ||
+      !Job::validateId(id) || job["height"].number() < 0)
+  {
+    return false;
+  }
+  Job::SeedHash seed;
+  std::copy(seedHash.begin(), seedHash.end(), seed.begin());
+
+  try
+  {
+    const size_t height = static_cast<size_t>(job["height"].number());
+    m_miner.setJob(m_slot, Job(id, blob, seed, height, Target(&target[0], target.size())));
+  }
+  catch (const std::exception &)
+  {
+    return false;
+  }
+
+  std::vector<uint8_t> nextSeedHash;
+  if (hexToBuffer(job["next_seed_hash"].string(), &nextSeedHash) && Job::validateSeedHash(nextSeedHash) &&
+      nextSeedHash != seedHash)
+  {
+    Job::SeedHash next;
+    std::copy(nextSeedHash.begin(), nextSeedHash.end(), next.begin());
+    m_miner.prepare(next);
+  }
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  m_jobIds.push_back(id);
+  if (m_jobIds.size() > RecentJobs)
+  {
+    m_jobIds.pop_front();
+  }
+  ++m_stats.jobs;
+  return true;
+}
+
+// Must be called with the mutex held. Registers the request and queues its line, flush() writes it.
+void StratumClient::request(Kind kind, const std::string &method, const std::string &params)
+{
+  const uint64_t id = m_nextId++;
+  const auto now = std::chrono::steady_clock::now();
+  m_pending.push_back({id, kind, now});
+  if (m_pending.size() > MaxPending)
+  {
+    m_pending.pop_front();
+  }
+  m_lastSent = now;
+
+  m_outbox.push_back(
+    "{\"id\":" + std::to_string(id) + ",\"jsonrpc\":\"2.0\",\"method\":" + Json::quote(method) + ",\"params\":" +
+    params + "}\n");
+}
+
+// Client thread only. Writes the queued lines in one go without the mutex, so deliver() never waits on the pool. A
+// failed write shuts the socket down, the next read fails and the client reconnects.
+void StratumClient::flush()
+{
+  std::string lines;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (const std::string &line : m_outbox)
+    {
+      lines += line;
+    }
+    m_outbox.clear();
+  }
+
+  if (!lines.empty() && !m_socket.write(lines, WriteTimeoutMs))
+  {
+    m_socket.shutdown();
+  }
+}
+
+void StratumClient::disconnect()
+{
+  m_socket.close();
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  // Nothing gets queued without a session, a notification left from this one would cut the reconnect short
+  m_wakeup.reset();
+  m_outbox.clear();
+  m_sessionId.clear();
+  m_jobIds.clear();
+  m_pending.clear();
+  m_stats.connected = false;
+}
@@ -0,0 +1,153 @@
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "delivery.h"
+#include "json.h"
+#include "miner.h"
+#include "shares.h"
+#include "socket.h"
+
+struct Pool
+{
+  std::string host;
+  uint16_t port;
+  std::string login;
+  std::string password;
+  std::string rigId;
+};
+
+struct StratumStats
+{
+  bool connected;
+  // Index into the pool list of the current or last pool
+  size_t pool;
+  uint64_t jobs;
+  uint64_t accepted;
+  uint64_t rejected;
+  // Found while disconnected or for a job of an earlier connection, never submitted
+  uint64_t stale;
+  // Connection attempts after the first one
+  uint64_t reconnects;
+  // Milliseconds from writing a submit to the pool's reply
+  double submitLatency;
+  double maxSubmitLatency;
+};
+
+// Native stratum client for one job slot. Jobs go straight into the miner and shares of the slot are queued by the
+// delivery thread for the client thread to submit, neither crosses JNI. A dropped connection is retried on the next
+// pool of the list, once every pool failed in a row the client backs off exponentially. Without a connection the slot
+// has no job.
+class StratumClient : public ShareSink
+{
+public:
+  static constexpr const int64_t ConnectTimeoutMs = 10 * 1000;
+  static constexpr const int64_t WriteTimeoutMs = 5 * 1000;
+  // Quiet connections send a keepalive, one without any line from the pool for IdleTimeoutMs is dropped
+  static constexpr const int64_t KeepaliveMs = 60 * 1000;
+  static constexpr const int64_t IdleTimeoutMs = 3 * KeepaliveMs;
+  static constexpr const int64_t BackoffMinMs = 1000;
+  static constexpr const int64_t BackoffMaxMs = 60 * 1000;
+  // Shares for older jobs of the connection are still submitted, pools accept them for a while after a new one
+  static constexpr const size_t RecentJobs = 4;
+  // Requests the pool never answered are forgotten beyond this, and shares found while as many lines wait to be
+  // written count as stale
+  static constexpr const size_t MaxPending = 64;
+
+  // Routes the slot's shares to the client and connects right away, pools must not be empty
+  StratumClient(Miner &miner, uint32_t slot, std::vector<Pool> pools);
+  // Removes the slot's job and routes its shares back to the miner's sink
+  ~StratumClient();
+
+  StratumClient(const StratumClient &) = delete;
+  StratumClient &operator=(const StratumClient &) = delete;
+
+  StratumStats stats() const;
+
+  void deliver(const Share *shares, size_t count) override;
+
+private:
+  enum Kind
+  {
+    Login,
+    Submit,
+    GetJob,
+    Keepalive,
+  };
+
+  struct Request
+  {
+    uint64_t id;
+    Kind kind;
+    std::chrono::steady_clock::time_point sent;
+  };
+
+  void thread();
+  bool session(size_t pool);
+  bool handle(const std::string &line, bool *gotJob);
+  bool setJob(const Json &job);
+  void request(Kind kind, const std::string &method, const std::string &params);
+  void flush();
+  void disconnect();
+
+private:
+  Miner &m_miner;
+  const uint32_t m_slot;
+  const std::vector<Pool> m_pools;
+
+  // Signalled when the client stops or a line is queued
+  Wakeup m_wakeup;
+  std::atomic<bool> m_stopping;
+  // Client thread only, a stalled pool never holds up the delivery thread
+  Socket m_socket;
+
+  // Guards everything below
+  mutable std::mutex m_mutex;
+  std::string m_sessionId;
+  // Lines waiting for the client thread to write them, oldest first
+  std::deque<std::string> m_outbox;
+  std::deque<std::string> m_jobIds;
+  std::deque<Request> m_pending;
+  uint64_t m_nextId;
+  std::chrono::steady_clock::time_point m_lastSent;
+  StratumStats m_stats;
+  double m_submitLatencySum;
+
+  std::thread m_thread;
+};
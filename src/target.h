@@ -31,28 +31,80 @@
 #pragma once
 
 #include <array>
-#include <vector>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
 
 #include <randomx.h>
 
+// Share target as the 64-bit upper bound for the most significant word of a little-endian hash
 class Target
 {
 public:
-  static constexpr const size_t Size = sizeof(uint32_t);
+  Target(const uint8_t *target, size_t size)
+  {
+    if (size == sizeof(uint32_t))
+    {
+      uint32_t target32;
+      std::memcpy(&target32, target, sizeof(target32));
+      if (target32 == 0)
+      {
+        throw std::runtime_error("invalid target");
+      }
+      // Compact stratum target, scale the difficulty it encodes up to 64 bits
+      m_target = std::numeric_limits<uint64_t>::max() / (std::numeric_limits<uint32_t>::max() / target32);
+    }
+    else if (size == sizeof(uint64_t))
+    {
+      std::memcpy(&m_target, target, sizeof(m_target));
+      if (m_target == 0)
+      {
+        throw std::runtime_error("invalid target");
+      }
+    }
+    else
+    {
+      throw std::runtime_error("invalid target length");
+    }
+  }
 
-  template <typename = std::enable_if_t<(Size <= RANDOMX_HASH_SIZE)>>
-  Target(const std::array<uint8_t, Size> target)
-    : m_target(target)
+  static bool validateSize(size_t size)
   {
+    return size == sizeof(uint32_t) || size == sizeof(uint64_t);
+  }
+
+  static Target fromDifficulty(uint64_t difficulty)
+  {
+    if (difficulty == 0)
+    {
+      throw std::runtime_error("invalid difficulty");
+    }
+    return Target(std::numeric_limits<uint64_t>::max() / difficulty);
   }
 
   bool operator>(const std::array<uint8_t, RANDOMX_HASH_SIZE> &hash) const
   {
-    return std::equal(m_target.rbegin(), m_target.rend(), hash.rbegin(), [](const uint8_t &a, const uint8_t &b) {
-      return a >= b;
-    });
+    uint64_t high;
+    std::memcpy(&high, &hash[RANDOMX_HASH_SIZE - sizeof(high)], sizeof(high));
+    return high < m_target;
+  }
+
+  uint64_t value() const
+  {
+    return m_target;
+  }
+
+  uint64_t difficulty() const
+  {
+    return m_target == 0 ? std::numeric_limits<uint64_t>::max() : std::numeric_limits<uint64_t>::max() / m_target;
+  }
+
+private:
+  explicit Target(uint64_t target)
+    : m_target(target)
+  {
   }
 
 private:
-  std::array<uint8_t, Size> m_target;
+  uint64_t m_target;
 };
@@ -0,0 +1,220 @@
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+
+struct ThermalSample
+{
+  // Hottest CPU zone in degrees Celsius, false if no zone could be read
+  bool temperatureKnown;
+  double temperature;
+  // scaling_cur_freq over cpuinfo_max_freq averaged across the cpus, 1 if unknown
+  double frequency;
+  // Battery drain in watts while discharging, 0 if unknown
+  double power;
+};
+
+// Temperature, clock and power readings from sysfs. The files are found once on construction, root can point at a
+// fake tree for testing.
+class Thermal
+{
+public:
+  explicit Thermal(const std::string &root = "/sys")
+  {
+    // Zones of these types cover the cores, the others (battery, modem, skin) only count if there are none of them
+    static const char *const cpuZoneTypes[] = {"cpu", "soc", "pkg", "tsens", "cluster", "apc"};
+    std::vector<std::string> otherZones;
+    for (const std::string &name : list(root + "/class/thermal", "thermal_zone"))
+    {
+      const std::string path = root + "/class/thermal/" + name;
+      std::string type;
+      read(path + "/type", &type);
+      std::transform(type.begin(), type.end(), type.begin(), [](char c) {
+        return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+      });
+      const bool cpu = std::any_of(std::begin(cpuZoneTypes), std::end(cpuZoneTypes), [&type](const char *prefix) {
+        return type.find(prefix) != std::string::npos;
+      });
+      (cpu ? m_zones : otherZones).push_back(path + "/temp");
+    }
+    if (m_zones.empty())
+    {
+      m_zones = otherZones;
+    }
+
+    for (const std::string &name : list(root + "/devices/system/cpu", "cpu"))
+    {
+      const std::string path = root + "/devices/system/cpu/" + name + "/cpufreq";
+      std::string value;
+      if (name.size() > 3 && std::isdigit(static_cast<unsigned char>(name[3])) &&
+          read(path + "/cpuinfo_max_freq", &value) && std::strtod(value.c_str(), nullptr) > 0)
+      {
+        m_cpus.push_back({path + "/scaling_cur_freq", std::strtod(value.c_str(), nullptr)});
+      }
+    }
+
+    for (const std::string &name : list(root + "/class/power_supply", ""))
+    {
+      const std::string path = root + "/class/power_supply/" + name;
+      std::string type;
+      if (read(path + "/type", &type) && type == "Battery")
+      {
+        m_batteries.push_back(path);
+      }
+    }
+  }
+
+  // False if there is nothing to read at all
+  bool available() const
+  {
+    return !m_zones.empty() || !m_cpus.empty();
+  }
+
+  ThermalSample sample() const
+  {
+    ThermalSample sample{false, 0, 1, 0};
+
+    for (const std::string &zone : m_zones)
+    {
+      std::string value;
+      if (!read(zone, &value))
+      {
+        continue;
+      }
+      // Millidegrees, a few vendors report whole degrees
+      double temperature = std::strtod(value.c_str(), nullptr);
+      temperature = std::abs(temperature) >= 1000 ? temperature / 1000 : temperature;
+      // Disabled sensors read as 0 or absurd values
+      if (temperature > MinTemperature && temperature < MaxTemperature &&
+          (!sample.temperatureKnown || temperature > sample.temperature))
+      {
+        sample.temperatureKnown = true;
+        sample.temperature = temperature;
+      }
+    }
+
+    double frequencies = 0;
+    size_t cpus = 0;
+    for (const Cpu &cpu : m_cpus)
+    {
+      std::string value;
+      // Offline cpus have no current frequency
+      if (read(cpu.current, &value))
+      {
+        frequencies += std::min(1.0, std::strtod(value.c_str(), nullptr) / cpu.maxFrequency);
+        ++cpus;
+      }
+    }
+    if (cpus != 0)
+    {
+      sample.frequency = frequencies / cpus;
+    }
+
+    for (const std::string &battery : m_batteries)
+    {
+      std::string status;
+      std::string value;
+      if (!read(battery + "/status", &status) || status != "Discharging")
+      {
+        continue;
+      }
+      // Microwatts, or microamps times microvolts, the sign of the current differs between drivers
+      if (read(battery + "/power_now", &value))
+      {
+        sample.power += std::abs(std::strtod(value.c_str(), nullptr)) / 1e6;
+      }
+      else if (read(battery + "/current_now", &value))
+      {
+        const double current = std::abs(std::strtod(value.c_str(), nullptr)) / 1e6;
+        if (read(battery + "/voltage_now", &value))
+        {
+          sample.power += current * std::strtod(value.c_str(), nullptr) / 1e6;
+        }
+      }
+    }
+
+    return sample;
+  }
+
+private:
+  static constexpr const double MinTemperature = -40;
+  static constexpr const double MaxTemperature = 150;
+
+  struct Cpu
+  {
+    std::string current;
+    double maxFrequency;
+  };
+
+  // Names in directory starting with prefix, sorted
+  static std::vector<std::string> list(const std::string &directory, const std::string &prefix)
+  {
+    std::vector<std::string> names;
+    DIR *handle = opendir(directory.c_str());
+    if (handle == nullptr)
+    {
+      return names;
+    }
+    while (const dirent *entry = readdir(handle))
+    {
+      const std::string name = entry->d_name;
+      if (name != "." && name != ".." && name.compare(0, prefix.size(), prefix) == 0)
+      {
+        names.push_back(name);
+      }
+    }
+    closedir(handle);
+    std::sort(names.begin(), names.end());
+    return names;
+  }
+
+  static bool read(const std::string &path, std::string *value)
+  {
+    std::ifstream file(path);
+    return static_cast<bool>(file >> *value);
+  }
+
+private:
+  std::vector<std::string> m_zones;
+  std::vector<Cpu> m_cpus;
+  std::vector<std::string> m_batteries;
+};
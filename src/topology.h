@@ -0,0 +1,252 @@
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sched.h>
+
+// CPU layout read from /sys/devices/system/cpu, used to place one hasher per physical core with the fastest cores
+// first and no more threads on a shared cache than RandomX scratchpads fit into
+class Topology
+{
+public:
+  // Per thread RandomX working set, the L2 part and the whole scratchpad that should stay in L3
+  static constexpr const uint64_t ScratchpadL2 = 256 * 1024;
+  static constexpr const uint64_t ScratchpadL3 = 2 * 1024 * 1024;
+
+  struct Cpu
+  {
+    int index;
+    // cpu_capacity, cpuinfo_max_freq as a fallback, 0 if unknown
+    uint64_t capacity;
+    // Lowest cpu of the physical core, the L2 and the L3, -1 if unknown
+    int core;
+    int l2;
+    int l3;
+    uint64_t l2Size;
+    uint64_t l3Size;
+  };
+
+  explicit Topology(const std::string &root = "/sys/devices/system/cpu")
+    : m_threads(0)
+  {
+    std::string online;
+    if (!read(root + "/online", &online))
+    {
+      return;
+    }
+
+    for (const int index : parseCpuList(online))
+    {
+      const std::string path = root + "/cpu" + std::to_string(index);
+      Cpu cpu{index, 0, index, -1, -1, 0, 0};
+
+      std::string value;
+      if (read(path + "/cpu_capacity", &value) || read(path + "/cpufreq/cpuinfo_max_freq", &value))
+      {
+        cpu.capacity = std::strtoull(value.c_str(), nullptr, 10);
+      }
+      if (read(path + "/topology/thread_siblings_list", &value))
+      {
+        const std::vector<int> siblings = parseCpuList(value);
+        if (!siblings.empty())
+        {
+          cpu.core = siblings.front();
+        }
+      }
+      for (size_t cache = 0;; ++cache)
+      {
+        const std::string cachePath = path + "/cache/index" + std::to_string(cache);
+        std::string level;
+        if (!read(cachePath + "/level", &level))
+        {
+          break;
+        }
+        std::string type;
+        std::string size;
+        std::string shared;
+        if (!read(cachePath + "/type", &type) || type == "Instruction" || !read(cachePath + "/size", &size) ||
+            !read(cachePath + "/shared_cpu_list", &shared))
+        {
+          continue;
+        }
+        const std::vector<int> sharedCpus = parseCpuList(shared);
+        const int first = sharedCpus.empty() ? index : sharedCpus.front();
+        if (level == "2")
+        {
+          cpu.l2 = first;
+          cpu.l2Size = parseSize(size);
+        }
+        else if (level == "3")
+        {
+          cpu.l3 = first;
+          cpu.l3Size = parseSize(size);
+        }
+      }
+
+      m_cpus.push_back(cpu);
+    }
+
+    plan();
+  }
+
+  const std::vector<Cpu> &cpus() const
+  {
+    return m_cpus;
+  }
+
+  // Hashers beyond the recommended count keep going down the placement order, then run unpinned
+  int cpu(size_t hasher) const
+  {
+    return hasher < m_order.size() ? m_order[hasher] : -1;
+  }
+
+  const std::vector<int> &order() const
+  {
+    return m_order;
+  }
+
+  // 0 if the caches are unknown and the count has to be guessed
+  size_t threads() const
+  {
+    return m_threads;
+  }
+
+  // Pins the calling thread, false if the cpu is offline or the kernel refused
+  static bool pin(int cpu)
+  {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+  }
+
+private:
+  // One cpu per physical core, fastest first, then the cores the caches can't take, then SMT siblings
+  void plan()
+  {
+    std::vector<const Cpu *> cores;
+    std::vector<const Cpu *> siblings;
+    for (const Cpu &cpu : m_cpus)
+    {
+      (cpu.core == cpu.index ? cores : siblings).push_back(&cpu);
+    }
+    const auto faster = [](const Cpu *left, const Cpu *right) {
+      return left->capacity != right->capacity ? left->capacity > right->capacity : left->index < right->index;
+    };
+    std::stable_sort(cores.begin(), cores.end(), faster);
+    std::stable_sort(siblings.begin(), siblings.end(), faster);
+
+    bool cachesKnown = false;
+    std::map<int, uint64_t> l2Threads;
+    std::map<int, uint64_t> l3Threads;
+    std::vector<const Cpu *> rejected;
+    for (const Cpu *cpu : cores)
+    {
+      cachesKnown = cachesKnown || cpu->l2Size != 0 || cpu->l3Size != 0;
+      const bool l2Fits = cpu->l2Size == 0 || l2Threads[cpu->l2] < std::max<uint64_t>(1, cpu->l2Size / ScratchpadL2);
+      const bool l3Fits = cpu->l3Size == 0 || l3Threads[cpu->l3] < std::max<uint64_t>(1, cpu->l3Size / ScratchpadL3);
+      if (l2Fits && l3Fits)
+      {
+        ++l2Threads[cpu->l2];
+        ++l3Threads[cpu->l3];
+        m_order.push_back(cpu->index);
+      }
+      else
+      {
+        rejected.push_back(cpu);
+      }
+    }
+    m_threads = cachesKnown ? m_order.size() : 0;
+
+    for (const Cpu *cpu : rejected)
+    {
+      m_order.push_back(cpu->index);
+    }
+    for (const Cpu *cpu : siblings)
+    {
+      m_order.push_back(cpu->index);
+    }
+  }
+
+  static bool read(const std::string &path, std::string *value)
+  {
+    std::ifstream file(path);
+    return static_cast<bool>(file >> *value);
+  }
+
+  // "0-3,6,8-9"
+  static std::vector<int> parseCpuList(const std::string &list)
+  {
+    std::vector<int> cpus;
+    std::istringstream ranges(list);
+    std::string range;
+    while (std::getline(ranges, range, ','))
+    {
+      char *end;
+      const long first = std::strtol(range.c_str(), &end, 10);
+      const long last = *end == '-' ? std::strtol(end + 1, nullptr, 10) : first;
+      for (long cpu = first; cpu <= last && cpu >= 0; ++cpu)
+      {
+        cpus.push_back(static_cast<int>(cpu));
+      }
+    }
+    return cpus;
+  }
+
+  // "2048K", "32M"
+  static uint64_t parseSize(const std::string &size)
+  {
+    char *end;
+    const uint64_t value = std::strtoull(size.c_str(), &end, 10);
+    if (*end == 'K')
+    {
+      return value * 1024;
+    }
+    if (*end == 'M')
+    {
+      return value * 1024 * 1024;
+    }
+    return value;
+  }
+
+private:
+  std::vector<Cpu> m_cpus;
+  std::vector<int> m_order;
+  size_t m_threads;
+};
@@ -0,0 +1,287 @@
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Timestamped phases of the hashing, delivery and epoch threads, exported as Chrome trace JSON (chrome://tracing,
+// ui.perfetto.dev). Compiled in with MINER_TRACE only, otherwise every scope folds away to nothing. Each thread
+// writes to its own ring without locking, the oldest events are overwritten once it is full.
+class Trace
+{
+public:
+#ifdef MINER_TRACE
+  static constexpr const bool Enabled = true;
+#else
+  static constexpr const bool Enabled = false;
+#endif
+  // 16 bytes per event, 128 KiB per thread
+  static constexpr const size_t RingEvents = 8192;
+  static_assert((RingEvents & (RingEvents - 1)) == 0, "ring size must be a power of two");
+
+  enum Phase
+  {
+    Hash,
+    JobSwitch,
+    VmSwitch,
+    Wait,
+    Idle,
+    Sleep,
+    Park,
+    Deliver,
+    Calibrate,
+    CacheInit,
+    DatasetInit,
+    Phases
+  };
+
+  static const char *name(Phase phase)
+  {
+    static const char *const names[Phases] = {
+      "hash",
+      "job switch",
+      "vm switch",
+      "wait for job",
+      "idle",
+      "regulator sleep",
+      "regulator park",
+      "share delivery",
+      "calibration",
+      "cache init",
+      "dataset init",
+    };
+    return names[phase];
+  }
+
+  // Single writer, any number of readers. An event is two relaxed atomics so a reader racing the writer sees
+  // either the old or the new value of each half and drops the slots the writer may have lapped.
+  class Ring
+  {
+  public:
+    Ring(const std::string &name, size_t id)
+      : m_name(name)
+      , m_id(id)
+      , m_head(0)
+      , m_attached(true)
+    {
+    }
+
+    void record(Phase phase, uint64_t startNs, uint64_t endNs)
+    {
+      const uint64_t head = m_head.load(std::memory_order_relaxed);
+      Slot &slot = m_slots[head & (RingEvents - 1)];
+      slot.startNs.store(startNs, std::memory_order_relaxed);
+      slot.durationPhase.store(((endNs - startNs) << 8) | phase, std::memory_order_relaxed);
+      m_head.store(head + 1, std::memory_order_release);
+    }
+
+  private:
+    friend class Trace;
+
+    struct Slot
+    {
+      std::atomic<uint64_t> startNs;
+      // Duration in nanoseconds above the low byte holding the phase
+      std::atomic<uint64_t> durationPhase;
+    };
+
+    const std::string m_name;
+    const size_t m_id;
+    std::array<Slot, RingEvents> m_slots;
+    std::atomic<uint64_t> m_head;
+    // Cleared when the owning thread exits, a new thread with the same name takes the ring over
+    std::atomic<bool> m_attached;
+  };
+
+  // Records the time between construction and destruction on the calling thread's ring, if it has one
+  class Scope
+  {
+  public:
+    explicit Scope(Phase phase)
+      : m_phase(phase)
+      , m_startNs(Enabled && ring() != nullptr ? now() : 0)
+    {
+    }
+
+    ~Scope()
+    {
+      if (Enabled && m_startNs != 0)
+      {
+        ring()->record(m_phase, m_startNs, now());
+      }
+    }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    const Phase m_phase;
+    const uint64_t m_startNs;
+  };
+
+  // Gives the calling thread a ring labelled name, a no-op without MINER_TRACE
+  static void attach(const std::string &name)
+  {
+    if (!Enabled)
+    {
+      return;
+    }
+
+    Trace &trace = instance();
+    std::lock_guard<std::mutex> lock(trace.m_mutex);
+
+    std::shared_ptr<Ring> ring;
+    for (const auto &existing : trace.m_rings)
+    {
+      if (existing->m_name == name && !existing->m_attached.load(std::memory_order_relaxed))
+      {
+        ring = existing;
+        ring->m_attached.store(true, std::memory_order_relaxed);
+        break;
+      }
+    }
+    if (!ring)
+    {
+      ring = std::make_shared<Ring>(name, trace.m_rings.size() + 1);
+      trace.m_rings.push_back(ring);
+    }
+    holder().ring = std::move(ring);
+  }
+
+  // Writes every ring as Chrome trace JSON, false if tracing is compiled out or the file can't be written
+  static bool write(const std::string &file)
+  {
+    if (!Enabled)
+    {
+      return false;
+    }
+
+    std::vector<std::shared_ptr<Ring>> rings;
+    {
+      Trace &trace = instance();
+      std::lock_guard<std::mutex> lock(trace.m_mutex);
+      rings = trace.m_rings;
+    }
+
+    std::unique_ptr<FILE, int (*)(FILE *)> out(std::fopen(file.c_str(), "w"), &std::fclose);
+    if (!out)
+    {
+      return false;
+    }
+
+    std::fprintf(out.get(), "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    for (const auto &ring : rings)
+    {
+      std::fprintf(
+        out.get(),
+        "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":\"%s\"}}",
+        first ? "" : ",\n",
+        ring->m_id,
+        ring->m_name.c_str());
+      first = false;
+
+      const uint64_t head = ring->m_head.load(std::memory_order_acquire);
+      std::vector<std::pair<uint64_t, uint64_t>> events;
+      for (uint64_t index = head > RingEvents ? head - RingEvents : 0; index < head; ++index)
+      {
+        const Ring::Slot &slot = ring->m_slots[index & (RingEvents - 1)];
+        events.emplace_back(
+          slot.startNs.load(std::memory_order_relaxed), slot.durationPhase.load(std::memory_order_relaxed));
+      }
+      // Slots the writer reused while they were being copied are dropped
+      const uint64_t lapped = ring->m_head.load(std::memory_order_acquire);
+      const uint64_t valid = lapped > RingEvents ? lapped - RingEvents : 0;
+      const uint64_t begin = head > RingEvents ? head - RingEvents : 0;
+      for (size_t index = valid > begin ? valid - begin : 0; index < events.size(); ++index)
+      {
+        std::fprintf(
+          out.get(),
+          ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%zu,\"ts\":%.3f,\"dur\":%.3f}",
+          name(static_cast<Phase>(events[index].second & 0xff)),
+          ring->m_id,
+          events[index].first / 1000.0,
+          (events[index].second >> 8) / 1000.0);
+      }
+    }
+    std::fprintf(out.get(), "\n]}\n");
+    return std::ferror(out.get()) == 0;
+  }
+
+private:
+  struct Holder
+  {
+    ~Holder()
+    {
+      if (ring)
+      {
+        ring->m_attached.store(false, std::memory_order_relaxed);
+      }
+    }
+
+    std::shared_ptr<Ring> ring;
+  };
+
+  static Trace &instance()
+  {
+    static Trace trace;
+    return trace;
+  }
+
+  static Holder &holder()
+  {
+    static thread_local Holder holder;
+    return holder;
+  }
+
+  static Ring *ring()
+  {
+    return holder().ring.get();
+  }
+
+  static uint64_t now()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+  }
+
+private:
+  std::mutex m_mutex;
+  std::vector<std::shared_ptr<Ring>> m_rings;
+};
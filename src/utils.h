@@ -30,59 +30,157 @@
 
 #pragma once
 
-#include <iomanip>
+#include <cstdint>
+#include <fstream>
 #include <sstream>
 #include <string>
+#include <vector>
 
-#include <jni.h>
+#include <unistd.h>
 
-std::string bufferToHex(const uint8_t *buffer, size_t size)
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace detail
 {
-  std::stringstream ss;
-  for (size_t index = 0; index < size; ++index)
+  // Nibble value of every character, -1 for the ones that aren't hex digits
+  struct HexDigits
   {
-    ss << std::hex << std::setfill('0') << std::setw(2) << static_cast<uint32_t>(buffer[index]);
+    constexpr HexDigits()
+      : values()
+    {
+      for (int c = 0; c < 256; ++c)
+      {
+        values[c] = -1;
+      }
+      for (int c = 0; c < 10; ++c)
+      {
+        values['0' + c] = static_cast<int8_t>(c);
+      }
+      for (int c = 0; c < 6; ++c)
+      {
+        values['a' + c] = static_cast<int8_t>(10 + c);
+        values['A' + c] = static_cast<int8_t>(10 + c);
+      }
+    }
+
+    int8_t values[256];
+  };
+
+  constexpr const char HexAlphabet[] = "0123456789abcdef";
+} // namespace detail
+
+// Two lowercase digits per byte into out, which must hold 2 * size characters. Sixteen bytes at a time on SSE2 and
+// AArch64, a nibble table for the rest.
+inline void hexEncode(const uint8_t *buffer, size_t size, char *out)
+{
+  size_t index = 0;
+#if defined(__SSE2__)
+  const __m128i mask = _mm_set1_epi8(0x0f);
+  const __m128i nine = _mm_set1_epi8(9);
+  const __m128i zero = _mm_set1_epi8('0');
+  const __m128i letters = _mm_set1_epi8('a' - '0' - 10);
+  const auto digits = [&](__m128i nibbles) {
+    return _mm_add_epi8(_mm_add_epi8(nibbles, zero), _mm_and_si128(_mm_cmpgt_epi8(nibbles, nine), letters));
+  };
+  for (; index + 16 <= size; index += 16)
+  {
+    const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(buffer + index));
+    const __m128i high = _mm_and_si128(_mm_srli_epi16(bytes, 4), mask);
+    const __m128i low = _mm_and_si128(bytes, mask);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + index * 2), digits(_mm_unpacklo_epi8(high, low)));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + index * 2 + 16), digits(_mm_unpackhi_epi8(high, low)));
+  }
+#elif defined(__aarch64__)
+  const uint8x16_t alphabet = vld1q_u8(reinterpret_cast<const uint8_t *>(detail::HexAlphabet));
+  for (; index + 16 <= size; index += 16)
+  {
+    const uint8x16_t bytes = vld1q_u8(buffer + index);
+    const uint8x16x2_t digits =
+      vzipq_u8(vqtbl1q_u8(alphabet, vshrq_n_u8(bytes, 4)), vqtbl1q_u8(alphabet, vandq_u8(bytes, vdupq_n_u8(0x0f))));
+    vst1q_u8(reinterpret_cast<uint8_t *>(out + index * 2), digits.val[0]);
+    vst1q_u8(reinterpret_cast<uint8_t *>(out + index * 2 + 16), digits.val[1]);
+  }
+#endif
+  for (char *digit = out + index * 2; index < size; ++index)
+  {
+    *digit++ = detail::HexAlphabet[buffer[index] >> 4];
+    *digit++ = detail::HexAlphabet[buffer[index] & 0x0f];
   }
-  return ss.str();
 }
 
-std::string bufferToHex(const std::vector<uint8_t> &buffer)
+// size / 2 bytes from size hex digits into out, false on odd length or non-hex characters
+inline bool hexDecode(const char *hex, size_t size, uint8_t *out)
 {
-  return bufferToHex(&buffer[0], buffer.size());
+  static constexpr const detail::HexDigits digits;
+  if (size % 2 != 0)
+  {
+    return false;
+  }
+  int invalid = 0;
+  for (size_t index = 0; index < size / 2; ++index)
+  {
+    const int high = digits.values[static_cast<uint8_t>(hex[index * 2])];
+    const int low = digits.values[static_cast<uint8_t>(hex[index * 2 + 1])];
+    invalid |= high | low;
+    out[index] = static_cast<uint8_t>(high << 4 | low);
+  }
+  return invalid >= 0;
 }
 
-// by Mr Jerry https://stackoverflow.com/a/41820336
-std::string jstringTostring(JNIEnv *env, jstring jStr)
+inline std::string bufferToHex(const uint8_t *buffer, size_t size)
 {
-  if (!jStr)
-    return "";
-
-  const jclass stringClass = env->GetObjectClass(jStr);
-  const jmethodID getBytes = env->GetMethodID(stringClass, "getBytes", "(Ljava/lang/String;)[B");
-  const jbyteArray stringJbytes = (jbyteArray)env->CallObjectMethod(jStr, getBytes, env->NewStringUTF("UTF-8"));
-
-  size_t length = (size_t)env->GetArrayLength(stringJbytes);
-  jbyte *pBytes = env->GetByteArrayElements(stringJbytes, NULL);
+  std::string hex(size * 2, '\0');
+  hexEncode(buffer, size, &hex[0]);
+  return hex;
+}
 
-  std::string ret = std::string((char *)pBytes, length);
-  env->ReleaseByteArrayElements(stringJbytes, pBytes, JNI_ABORT);
+inline std::string bufferToHex(const std::vector<uint8_t> &buffer)
+{
+  return bufferToHex(buffer.data(), buffer.size());
+}
 
-  env->DeleteLocalRef(stringJbytes);
-  env->DeleteLocalRef(stringClass);
-  return ret;
+// Returns false on odd length or non-hex characters
+inline bool hexToBuffer(const std::string &hex, std::vector<uint8_t> *buffer)
+{
+  if (hex.size() % 2 != 0)
+  {
+    return false;
+  }
+  buffer->resize(hex.size() / 2);
+  return hexDecode(hex.data(), hex.size(), buffer->data());
 }
 
-// by Mustafa Kemal https://stackoverflow.com/a/25804198
-std::vector<uint8_t> jbyteArrayToVector(JNIEnv *env, jbyteArray jbIn)
+// Resident set size of the current process in bytes, 0 if unavailable
+inline size_t residentMemory()
 {
-  std::vector<uint8_t> result;
+  std::ifstream statm("/proc/self/statm");
+  size_t totalPages = 0;
+  size_t residentPages = 0;
+  if (!(statm >> totalPages >> residentPages))
+  {
+    return 0;
+  }
+  return residentPages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
 
-  size_t size = env->GetArrayLength(jbIn);
-  uint8_t *bufferIn = static_cast<uint8_t *>(env->GetPrimitiveArrayCritical(jbIn, nullptr));
-  if (bufferIn != nullptr)
+// MemAvailable from /proc/meminfo in bytes, 0 if unavailable
+inline uint64_t availableMemory()
+{
+  std::ifstream meminfo("/proc/meminfo");
+  std::string line;
+  while (std::getline(meminfo, line))
   {
-    result.assign(&bufferIn[0], &bufferIn[size]);
-    env->ReleasePrimitiveArrayCritical(jbIn, reinterpret_cast<void *>(bufferIn), 0);
+    std::istringstream fields(line);
+    std::string key;
+    uint64_t valueKb;
+    if (fields >> key >> valueKb && key == "MemAvailable:")
+    {
+      return valueKb * 1024;
+    }
   }
-  return result;
+  return 0;
 }
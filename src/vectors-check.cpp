@@ -0,0 +1,213 @@
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <randomx.h>
+
+#include "cache.h"
+#include "target.h"
+#include "utils.h"
+#include "vm.h"
+
+namespace
+{
+  struct HashVector
+  {
+    const char *key;
+    // Hex if hexInput is set, plain text otherwise
+    const char *input;
+    bool hexInput;
+    const char *hash;
+  };
+
+  // From RandomX's own tests
+  const HashVector HashVectors[] = {
+    {"test key 000", "This is a test", false, "639183aae1bf4c9a35884cb46b09cad9175f04efd7684e7262a0ac1c2f0b4e3f"},
+    {"test key 000",
+     "Lorem ipsum dolor sit amet",
+     false,
+     "300a0adb47603dedb42228ccb2b211104f4da45af709cd7547cd049e9489c969"},
+    {"test key 001",
+     "0b0b98bea7e805e0010a2126d287a2a0cc833d312cb786385a7c2f9de69d25537f584a9bc9977b00000000666fd8753bf61a8631f1298"
+     "4e3fd44f4014eca629276817b56f32e9b68bd82f416",
+     true,
+     "c56414121acda1713c2f2a819d8ae38aed7c80c35c2a769298d34f03833cd5f1"},
+  };
+
+  bool check(const std::string &name, bool passed)
+  {
+    std::printf("%s: %s\n", name.c_str(), passed ? "ok" : "MISMATCH");
+    return passed;
+  }
+
+  // Hash whose most significant 64-bit word is high, every other byte set
+  std::array<uint8_t, RANDOMX_HASH_SIZE> hashWithHigh(uint64_t high)
+  {
+    std::array<uint8_t, RANDOMX_HASH_SIZE> hash;
+    hash.fill(0xff);
+    std::memcpy(&hash[RANDOMX_HASH_SIZE - sizeof(high)], &high, sizeof(high));
+    return hash;
+  }
+
+  Target compactTarget(const char *hex)
+  {
+    std::vector<uint8_t> bytes;
+    hexToBuffer(hex, &bytes);
+    return Target(&bytes[0], bytes.size());
+  }
+
+  bool throws(const std::vector<uint8_t> &bytes)
+  {
+    try
+    {
+      Target(bytes.data(), bytes.size());
+    }
+    catch (const std::exception &)
+    {
+      return true;
+    }
+    return false;
+  }
+
+  bool checkTargets()
+  {
+    bool passed = true;
+
+    // Compact stratum targets and the difficulties pools send them for
+    passed &= check("4-byte ffffff00", compactTarget("ffffff00").difficulty() == 256);
+    passed &= check("4-byte b88d0600", compactTarget("b88d0600").difficulty() == 10000);
+    passed &= check("8-byte ffffffffffff0000", compactTarget("ffffffffffff0000").difficulty() == 65536);
+    for (const uint64_t difficulty : {1ULL, 256ULL, 10000ULL, 1000000ULL})
+    {
+      passed &= check(
+        "difficulty " + std::to_string(difficulty), Target::fromDifficulty(difficulty).difficulty() == difficulty);
+    }
+    passed &= check("invalid targets", throws({0, 0, 0, 0}) && throws({1, 2, 3}) && throws({}));
+    // No hash is below a zero target, in either size
+    passed &= check("zero 8-byte target", throws({0, 0, 0, 0, 0, 0, 0, 0}));
+
+    // The most significant word alone decides, equal to the target is not a share
+    const Target target = compactTarget("b88d0600");
+    passed &= check("below target", target > hashWithHigh(target.value() - 1) && target > hashWithHigh(0));
+    passed &= check(
+      "at or above target",
+      !(target > hashWithHigh(target.value())) && !(target > hashWithHigh(std::numeric_limits<uint64_t>::max())));
+    return passed;
+  }
+
+  bool checkHashes(randomx_flags flags)
+  {
+    bool passed = true;
+    const std::string mode = flags & RANDOMX_FLAG_JIT ? "jit" : "interpreter";
+
+    for (size_t index = 0; index < sizeof(HashVectors) / sizeof(HashVectors[0]); ++index)
+    {
+      const HashVector &vector = HashVectors[index];
+      const std::string name = mode + " vector " + std::to_string(index + 1);
+      std::vector<uint8_t> input;
+      if (vector.hexInput)
+      {
+        hexToBuffer(vector.input, &input);
+      }
+      else
+      {
+        input.assign(vector.input, vector.input + std::strlen(vector.input));
+      }
+
+      randomx_cache *cache = randomx_alloc_cache(flags);
+      randomx_vm *vm = cache != nullptr ? randomx_create_vm(flags, cache, nullptr) : nullptr;
+      if (vm == nullptr)
+      {
+        passed &= check(name + " vm", false);
+        if (cache != nullptr)
+        {
+          randomx_release_cache(cache);
+        }
+        continue;
+      }
+      randomx_init_cache(cache, vector.key, std::strlen(vector.key));
+      randomx_vm_set_cache(vm, cache);
+      uint8_t hash[RANDOMX_HASH_SIZE];
+      randomx_calculate_hash(vm, input.data(), input.size(), hash);
+      passed &= check(name, bufferToHex(hash, sizeof(hash)) == vector.hash);
+      randomx_destroy_vm(vm);
+      randomx_release_cache(cache);
+    }
+
+    // The hashers' pipelined path has to agree with one hash at a time
+    Cache::SeedHash seedHash;
+    seedHash.fill(0x5a);
+    const std::shared_ptr<const Cache> cache = std::make_shared<const Cache>(flags, seedHash);
+    Vm vm(flags, cache, nullptr);
+    std::vector<std::array<uint8_t, 76>> blobs(3);
+    std::vector<std::array<uint8_t, RANDOMX_HASH_SIZE>> expected(blobs.size());
+    for (size_t index = 0; index < blobs.size(); ++index)
+    {
+      blobs[index].fill(static_cast<uint8_t>(index));
+      vm.hash(&blobs[index][0], blobs[index].size(), &expected[index]);
+    }
+    std::vector<std::array<uint8_t, RANDOMX_HASH_SIZE>> pipelined(blobs.size());
+    vm.hashFirst(&blobs[0][0], blobs[0].size());
+    for (size_t index = 1; index < blobs.size(); ++index)
+    {
+      vm.hashNext(&blobs[index][0], blobs[index].size(), &pipelined[index - 1]);
+    }
+    vm.hashLast(&pipelined.back());
+    passed &= check(mode + " pipelined hashes", pipelined == expected);
+    return passed;
+  }
+} // namespace
+
+// Checks share targets and RandomX hashes against known vectors, exits with 1 on any mismatch
+int main(int argc, char *argv[])
+{
+  if (argc != 1)
+  {
+    std::fprintf(stderr, "usage: %s\n", argv[0]);
+    return 1;
+  }
+
+  bool passed = checkTargets();
+  passed &= checkHashes(RANDOMX_FLAG_DEFAULT);
+  const randomx_flags flags = randomx_get_flags();
+  if (flags & RANDOMX_FLAG_JIT)
+  {
+    passed &= checkHashes(flags);
+  }
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,145 @@
+// BSD 3-Clause License
+//
+// Copyright (c) 2020, xiphon <xiphon@protonmail.com>
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <randomx.h>
+
+#include "delivery.h"
+#include "shares.h"
+#include "vm.h"
+
+// Recomputes every found share on an interpreter VM before it reaches the sink, so a JIT miscompile or a core
+// computing garbage can't get the miner banned by the pool. Runs on the unpinned delivery thread, so the
+// recomputation usually lands on another core than the one that found the share, and never holds hashers up.
+class ShareVerifier : public ShareSink
+{
+public:
+  // Called on the delivery thread with the index of the hasher that found each verified share
+  typedef std::function<void(uint32_t thread, bool valid)> ResultCallback;
+
+  ShareVerifier(ShareSink &sink, ResultCallback onResult)
+    : m_sink(sink)
+    , m_onResult(std::move(onResult))
+    , m_enabled(false)
+  {
+  }
+
+  void setEnabled(bool enabled)
+  {
+    m_enabled = enabled;
+  }
+
+  bool enabled() const
+  {
+    return m_enabled;
+  }
+
+  void threadStarted() override
+  {
+    m_sink.threadStarted();
+  }
+
+  void threadStopped() override
+  {
+    m_sink.threadStopped();
+  }
+
+  void deliver(const Share *shares, size_t count) override
+  {
+    if (!m_enabled)
+    {
+      m_sink.deliver(shares, count);
+      return;
+    }
+
+    m_valid.clear();
+    for (size_t index = 0; index < count; ++index)
+    {
+      if (shares[index].exhausted || !shares[index].cache)
+      {
+        m_valid.push_back(shares[index]);
+        continue;
+      }
+
+      const bool valid = verify(shares[index]);
+      m_onResult(shares[index].thread, valid);
+      if (valid)
+      {
+        m_valid.push_back(shares[index]);
+      }
+    }
+    // The VM would keep the cache of a finished epoch alive, shares are rare enough to build one per batch
+    m_vm.reset();
+    if (!m_valid.empty())
+    {
+      m_sink.deliver(&m_valid[0], m_valid.size());
+    }
+    m_valid.clear();
+  }
+
+private:
+  // Interpreter with the AES and Argon2 flags the hashers use, so only the JIT and the hashing core differ
+  bool verify(const Share &share)
+  {
+    const randomx_flags flags = static_cast<randomx_flags>(
+      share.cache->flags() &
+      ~(RANDOMX_FLAG_JIT | RANDOMX_FLAG_SECURE | RANDOMX_FLAG_LARGE_PAGES | RANDOMX_FLAG_FULL_MEM));
+    if (!m_vm || m_flags != flags)
+    {
+      m_vm.reset(new Vm(flags, share.cache, nullptr));
+      m_flags = flags;
+    }
+    else if (m_vm->cache() != share.cache)
+    {
+      m_vm->setCache(share.cache);
+    }
+
+    std::array<uint8_t, RANDOMX_HASH_SIZE> result;
+    m_vm->hash(&share.blob[0], share.blobSize, &result);
+    return result == share.hash;
+  }
+
+private:
+  ShareSink &m_sink;
+  const ResultCallback m_onResult;
+  std::atomic<bool> m_enabled;
+
+  // Delivery thread only
+  std::unique_ptr<Vm> m_vm;
+  randomx_flags m_flags;
+  std::vector<Share> m_valid;
+};
@@ -30,26 +30,32 @@
 
 #pragma once
 
+#include <array>
+#include <memory>
 #include <stdexcept>
-#include <vector>
 
 #include <randomx.h>
 
+#include "cache.h"
+#include "dataset.h"
+#include "pages.h"
+
 class Vm
 {
 public:
-  Vm(const std::vector<uint8_t> &seedHash)
+  // Runs in fast mode when a dataset is given, light mode otherwise. The scratchpad falls back to regular pages
+  // if RANDOMX_FLAG_LARGE_PAGES can't be served, the RandomX API gives no way to advise transparent ones for it.
+  Vm(randomx_flags flags, std::shared_ptr<const Cache> cache, std::shared_ptr<const Dataset> dataset)
+    : m_cache(std::move(cache))
+    , m_dataset(std::move(dataset))
+    , m_pages(flags & RANDOMX_FLAG_LARGE_PAGES ? Pages::Huge : Pages::Regular)
   {
-    randomx_flags flags = randomx_get_flags();
-
-    m_cache = randomx_alloc_cache(flags);
-    if (m_cache == nullptr)
+    m_machine = create(flags);
+    if (m_machine == nullptr && m_pages == Pages::Huge)
     {
-      throw std::runtime_error("failed to allocate RandomX cache");
+      m_pages = Pages::Regular;
+      m_machine = create(static_cast<randomx_flags>(flags & ~RANDOMX_FLAG_LARGE_PAGES));
     }
-    randomx_init_cache(m_cache, &seedHash[0], seedHash.size());
-
-    m_machine = randomx_create_vm(flags, m_cache, NULL);
     if (m_machine == nullptr)
     {
       throw std::runtime_error("failed to create RandomX vm");
@@ -59,21 +65,77 @@ public:
   ~Vm()
   {
     randomx_destroy_vm(m_machine);
-    randomx_release_cache(m_cache);
   }
 
-  void setCache(const std::vector<uint8_t> &seedHash)
+  void setCache(std::shared_ptr<const Cache> cache)
+  {
+    randomx_vm_set_cache(m_machine, cache->get());
+    m_cache = std::move(cache);
+  }
+
+  void setDataset(std::shared_ptr<const Cache> cache, std::shared_ptr<const Dataset> dataset)
+  {
+    randomx_vm_set_dataset(m_machine, dataset->get());
+    m_cache = std::move(cache);
+    m_dataset = std::move(dataset);
+  }
+
+  const std::shared_ptr<const Cache> &cache() const
   {
-    randomx_init_cache(m_cache, &seedHash[0], seedHash.size());
-    randomx_vm_set_cache(m_machine, m_cache);
+    return m_cache;
   }
 
-  void hash(const std::vector<uint8_t> &blob, std::array<uint8_t, RANDOMX_HASH_SIZE> *result)
+  const std::shared_ptr<const Dataset> &dataset() const
   {
-    randomx_calculate_hash(m_machine, &blob[0], blob.size(), &(*result)[0]);
+    return m_dataset;
+  }
+
+  bool fullMem() const
+  {
+    return m_dataset != nullptr;
+  }
+
+  // Scratchpad pages
+  Pages::Kind pages() const
+  {
+    return m_pages;
+  }
+
+  void hash(const uint8_t *blob, size_t size, std::array<uint8_t, RANDOMX_HASH_SIZE> *result)
+  {
+    randomx_calculate_hash(m_machine, blob, size, &(*result)[0]);
+  }
+
+  // Pipelined hashing, hashNext() returns the result for the previous input while queueing the next one
+  void hashFirst(const uint8_t *blob, size_t size)
+  {
+    randomx_calculate_hash_first(m_machine, blob, size);
+  }
+
+  void hashNext(const uint8_t *nextBlob, size_t size, std::array<uint8_t, RANDOMX_HASH_SIZE> *result)
+  {
+    randomx_calculate_hash_next(m_machine, nextBlob, size, &(*result)[0]);
+  }
+
+  void hashLast(std::array<uint8_t, RANDOMX_HASH_SIZE> *result)
+  {
+    randomx_calculate_hash_last(m_machine, &(*result)[0]);
+  }
+
+private:
+  randomx_vm *create(randomx_flags flags) const
+  {
+    if (m_dataset)
+    {
+      return randomx_create_vm(
+        static_cast<randomx_flags>(flags | RANDOMX_FLAG_FULL_MEM), m_cache->get(), m_dataset->get());
+    }
+    return randomx_create_vm(flags, m_cache->get(), NULL);
   }
 
 private:
-  randomx_cache *m_cache;
+  std::shared_ptr<const Cache> m_cache;
+  std::shared_ptr<const Dataset> m_dataset;
+  Pages::Kind m_pages;
   randomx_vm *m_machine;
 };